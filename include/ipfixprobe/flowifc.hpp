@@ -45,6 +45,7 @@
 #endif
 
 #include "ipaddr.hpp"
+#include "recordExtPool.hpp"
 
 #include <string>
 
@@ -74,6 +75,12 @@ struct RecordExt {
 	{
 	}
 
+	/**
+	 * \brief Extensions are allocated from the pool of the pipeline, see RecordExtPool.
+	 */
+	static void* operator new(size_t size) { return RecordExtPool::allocate(size); }
+	static void operator delete(void* ptr) { RecordExtPool::deallocate(ptr); }
+
 #ifdef WITH_NEMEA
 	/**
 	 * \brief Fill unirec record with stored extension data.
@@ -144,22 +151,59 @@ struct RecordExt {
 };
 
 struct Record {
-	RecordExt* m_exts; /**< Extension headers. */
+	/** Maximal number of extension types, limited by the width of the extension mask. */
+	static const int MAX_EXTENSION_CNT = 64;
+
+	RecordExt* m_exts; /**< Extension headers in order of insertion. */
+	RecordExt* m_exts_tail; /**< Last extension header of the list. */
+	uint64_t m_ext_mask; /**< Bit set for every extension ID present in the record. */
+	RecordExt** m_ext_slots; /**< First extension header of every ID, nullptr when not indexed. */
+	uint32_t m_ext_slot_cnt; /**< Number of extension IDs with a slot. */
+
+	/**
+	 * \brief Index extensions of the record by their ID.
+	 *
+	 * The slots are owned by the caller, e.g. the flow cache keeps one array for all records.
+	 * Without slots, extensions are looked up in the list.
+	 *
+	 * \param [in] slots Array of extension slots.
+	 * \param [in] cnt Number of slots.
+	 */
+	void set_extension_slots(RecordExt** slots, uint32_t cnt)
+	{
+		m_ext_slots = slots;
+		m_ext_slot_cnt = cnt;
+		for (uint32_t id = 0; id < cnt; id++) {
+			m_ext_slots[id] = nullptr;
+		}
+		for (RecordExt* ext = m_exts; ext != nullptr; ext = ext->m_next) {
+			const uint32_t id = ext->m_ext_id;
+			if (id < cnt && m_ext_slots[id] == nullptr) {
+				m_ext_slots[id] = ext;
+			}
+		}
+	}
 
 	/**
 	 * \brief Add new extension header.
-	 * \param [in] ext Pointer to the extension header.
+	 * \param [in] ext Pointer to the extension header, can be a chain of extension headers.
 	 */
 	void add_extension(RecordExt* ext)
 	{
 		if (m_exts == nullptr) {
 			m_exts = ext;
 		} else {
-			RecordExt* ext_ptr = m_exts;
-			while (ext_ptr->m_next != nullptr) {
-				ext_ptr = ext_ptr->m_next;
+			m_exts_tail->m_next = ext;
+		}
+		for (; ext != nullptr; ext = ext->m_next) {
+			const uint64_t bit = static_cast<uint64_t>(1) << ext->m_ext_id;
+			if (!(m_ext_mask & bit)) {
+				m_ext_mask |= bit;
+				if (static_cast<uint32_t>(ext->m_ext_id) < m_ext_slot_cnt) {
+					m_ext_slots[ext->m_ext_id] = ext;
+				}
 			}
-			ext_ptr->m_next = ext;
+			m_exts_tail = ext;
 		}
 	}
 
@@ -170,15 +214,28 @@ struct Record {
 	 */
 	RecordExt* get_extension(int id) const
 	{
+		if (!has_extension(id)) {
+			return nullptr;
+		}
+		if (static_cast<uint32_t>(id) < m_ext_slot_cnt) {
+			return m_ext_slots[id];
+		}
 		RecordExt* ext = m_exts;
-		while (ext != nullptr) {
-			if (ext->m_ext_id == id) {
-				return ext;
-			}
+		while (ext->m_ext_id != id) {
 			ext = ext->m_next;
 		}
-		return nullptr;
+		return ext;
+	}
+
+	/**
+	 * \brief Check presence of given extension.
+	 * \param [in] id Type of extension.
+	 */
+	bool has_extension(int id) const
+	{
+		return id >= 0 && id < MAX_EXTENSION_CNT && (m_ext_mask >> id & 1);
 	}
+
 	/**
 	 * \brief Remove given extension.
 	 * \param [in] id Type of extension.
@@ -186,26 +243,40 @@ struct Record {
 	 */
 	bool remove_extension(int id)
 	{
+		if (!has_extension(id)) {
+			return false;
+		}
+
 		RecordExt* ext = m_exts;
 		RecordExt* prev_ext = nullptr;
-
-		while (ext != nullptr) {
-			if (ext->m_ext_id == id) {
-				if (prev_ext == nullptr) { // at beginning
-					m_exts = ext->m_next;
-				} else if (ext->m_next == nullptr) { // at end
-					prev_ext->m_next = nullptr;
-				} else { // in middle
-					prev_ext->m_next = ext->m_next;
-				}
-				ext->m_next = nullptr;
-				delete ext;
-				return true;
-			}
+		while (ext->m_ext_id != id) {
 			prev_ext = ext;
 			ext = ext->m_next;
 		}
-		return false;
+		if (prev_ext == nullptr) {
+			m_exts = ext->m_next;
+		} else {
+			prev_ext->m_next = ext->m_next;
+		}
+		if (m_exts_tail == ext) {
+			m_exts_tail = prev_ext;
+		}
+
+		// Another extension of the same type takes the slot
+		RecordExt* next = ext->m_next;
+		while (next != nullptr && next->m_ext_id != id) {
+			next = next->m_next;
+		}
+		if (static_cast<uint32_t>(id) < m_ext_slot_cnt) {
+			m_ext_slots[id] = next;
+		}
+		if (next == nullptr) {
+			m_ext_mask &= ~(static_cast<uint64_t>(1) << id);
+		}
+
+		ext->m_next = nullptr;
+		delete ext;
+		return true;
 	}
 
 	/**
@@ -215,8 +286,21 @@ struct Record {
 	{
 		if (m_exts != nullptr) {
 			delete m_exts;
-			m_exts = nullptr;
 		}
+		detach_extensions();
+	}
+
+	/**
+	 * \brief Forget extension headers without destroying them.
+	 *
+	 * Used when the extensions are owned by another record, e.g. after the record was copied.
+	 */
+	void detach_extensions()
+	{
+		clear_extension_slots();
+		m_exts = nullptr;
+		m_exts_tail = nullptr;
+		m_ext_mask = 0;
 	}
 
 	/**
@@ -224,13 +308,60 @@ struct Record {
 	 */
 	Record()
 		: m_exts(nullptr)
+		, m_exts_tail(nullptr)
+		, m_ext_mask(0)
+		, m_ext_slots(nullptr)
+		, m_ext_slot_cnt(0)
+	{
+	}
+
+	/**
+	 * \brief Copy shares the extensions of the other record, the copy is not indexed.
+	 */
+	Record(const Record& other)
+		: m_exts(other.m_exts)
+		, m_exts_tail(other.m_exts_tail)
+		, m_ext_mask(other.m_ext_mask)
+		, m_ext_slots(nullptr)
+		, m_ext_slot_cnt(0)
 	{
 	}
 
+	/**
+	 * \brief Assignment shares the extensions of the other record, the record keeps its slots.
+	 */
+	Record& operator=(const Record& other)
+	{
+		if (this != &other) {
+			clear_extension_slots();
+			m_exts = other.m_exts;
+			m_exts_tail = other.m_exts_tail;
+			m_ext_mask = other.m_ext_mask;
+			for (uint64_t mask = m_ext_mask; mask != 0; mask &= mask - 1) {
+				const int id = __builtin_ctzll(mask);
+				if (static_cast<uint32_t>(id) < m_ext_slot_cnt) {
+					m_ext_slots[id] = other.get_extension(id);
+				}
+			}
+		}
+		return *this;
+	}
+
 	/**
 	 * \brief Destructor.
 	 */
 	virtual ~Record() { remove_extensions(); }
+
+private:
+	void clear_extension_slots()
+	{
+		for (uint64_t mask = m_ext_mask; mask != 0; mask &= mask - 1) {
+			const int id = __builtin_ctzll(mask);
+			if (static_cast<uint32_t>(id) < m_ext_slot_cnt) {
+				m_ext_slots[id] = nullptr;
+			}
+		}
+	}
 };
 
 #define FLOW_END_INACTIVE 0x01
@@ -265,6 +396,11 @@ struct Flow : public Record {
 	uint8_t src_mac[6];
 	uint8_t dst_mac[6];
 	uint8_t end_reason;
+	uint8_t classified_pkts; /**< Payload packets classified while plugins were pending. */
+
+	uint64_t plugins_mask; /**< Process plugins interested in the flow, set by storage plugin. */
+	uint64_t plugins_active; /**< Interested process plugins not done with the flow yet. */
+	uint64_t plugins_pending; /**< Interested process plugins waiting for payload classification. */
 };
 
 } // namespace ipxp
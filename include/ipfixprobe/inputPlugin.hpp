@@ -57,6 +57,14 @@ public:
 	 */
 	virtual Result get(PacketBlock& packets) = 0;
 
+	/**
+	 * @brief Gets file descriptor which becomes readable when packets arrive.
+	 *
+	 * Used by workers to sleep on idle inputs instead of polling get() in a loop.
+	 * @return File descriptor usable with poll(), -1 when the input doesn't provide any.
+	 */
+	virtual int get_fd() const { return -1; }
+
 	/**
 	 * @brief Sets the telemetry directories for this plugin.
 	 * @param plugin_dir Shared pointer to the plugin-specific telemetry directory.
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Hugepage and NUMA aware allocation of large pipeline buffers
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "api.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ipxp {
+
+enum class PageType : uint8_t {
+	DEFAULT = 0, /**< Regular pages */
+	TRANSPARENT, /**< Transparent hugepages (madvise) */
+	HUGE_2M, /**< 2 MiB hugepages from the hugetlbfs pool */
+	HUGE_1G, /**< 1 GiB hugepages from the hugetlbfs pool */
+};
+
+/**
+ * \brief Placement of large long-living buffers of one pipeline.
+ *
+ * Flow cache tables and packet blocks are allocated through the memory policy of their
+ * pipeline. Memory can be backed by hugepages to reduce TLB misses and bound to the NUMA
+ * node the pipeline threads run on. Requested hugepages fall back to transparent hugepages
+ * when the hugetlbfs pool is exhausted, so the policy also counts what was really obtained.
+ */
+class IPXP_API MemoryPolicy {
+public:
+	static const size_t PAGE_TYPE_CNT = 4;
+
+	/**
+	 * \brief Memory obtained by allocate().
+	 */
+	struct Region {
+		void* ptr;
+		size_t size;
+		PageType pages;
+	};
+
+	/**
+	 * \brief Constructor.
+	 * \param pages Requested page type.
+	 * \param numa_node NUMA node the memory is bound to, -1 disables binding.
+	 */
+	explicit MemoryPolicy(PageType pages = PageType::DEFAULT, int numa_node = -1);
+
+	/**
+	 * \brief Allocate zero filled memory.
+	 *
+	 * Requests smaller than the requested hugepage get regular pages, transparent hugepages
+	 * are used from 2 MiB up.
+	 *
+	 * \param size Requested size in bytes.
+	 * \return Allocated region, throws std::bad_alloc when no memory is available.
+	 */
+	Region allocate(size_t size);
+
+	/**
+	 * \brief Release region returned by allocate().
+	 */
+	static void free(const Region& region);
+
+	PageType get_page_type() const { return m_pages; }
+	int get_numa_node() const { return m_numa_node; }
+
+	/**
+	 * \brief Bytes allocated with the given page type.
+	 */
+	uint64_t get_allocated(PageType pages) const
+	{
+		return m_allocated[static_cast<size_t>(pages)].load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * \brief Bytes successfully bound to the policy NUMA node.
+	 */
+	uint64_t get_numa_bound() const { return m_numa_bound.load(std::memory_order_relaxed); }
+
+	/**
+	 * \brief Parse page type name (thp, 2M or 1G).
+	 * \return False when the name is unknown.
+	 */
+	static bool parse_page_type(const std::string& str, PageType& pages);
+	static const char* page_type_name(PageType pages);
+
+	/**
+	 * \brief Get NUMA node of the CPUs.
+	 * \return NUMA node shared by all CPUs, -1 when unknown or the CPUs span more nodes.
+	 */
+	static int get_numa_node(const std::vector<int>& cpus);
+
+	/**
+	 * \brief Set memory policy used by buffers created in the calling thread.
+	 *
+	 * Plugins and packet blocks are created by the core, the current policy is set while the
+	 * pipeline they belong to is being created. nullptr means regular allocation.
+	 */
+	static void set_current(MemoryPolicy* policy);
+	static MemoryPolicy* get_current();
+
+private:
+	PageType m_pages;
+	int m_numa_node;
+	std::atomic<uint64_t> m_allocated[PAGE_TYPE_CNT];
+	std::atomic<uint64_t> m_numa_bound;
+};
+
+} // namespace ipxp
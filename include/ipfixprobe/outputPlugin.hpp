@@ -19,6 +19,7 @@
 #include "processPlugin.hpp"
 #include "telemetry-utils.hpp"
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -58,11 +59,27 @@ public:
 	 */
 	virtual int export_flow(const Flow& flow) = 0;
 
+	/**
+	 * \brief Send multiple flow records to output interface.
+	 *
+	 * Called by the output worker with all flows it got from the output queues at once.
+	 * Default implementation calls export_flow() for every flow, plugins may override it
+	 * to amortize per-flow overhead.
+	 * \param [in] flows Flows to send.
+	 * \param [in] count Number of flows.
+	 */
+	virtual void export_flows(Flow* const* flows, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			export_flow(*flows[i]);
+		}
+	}
+
 	/**
 	 * \brief Set the telemetry directory for this plugin.
 	 * \param [in] output_dir The telemetry directory for this plugin.
 	 */
-	void set_telemetry_dirs(std::shared_ptr<telemetry::Directory> output_dir);
+	virtual void set_telemetry_dirs(std::shared_ptr<telemetry::Directory> output_dir);
 
 	/**
 	 * \brief Force exporter to flush flows to collector.
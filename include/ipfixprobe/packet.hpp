@@ -34,6 +34,8 @@
 
 #include <ipfixprobe/flowifc.hpp>
 #include <ipfixprobe/ipaddr.hpp>
+#include <ipfixprobe/memory.hpp>
+#include <new>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/time.h>
@@ -152,15 +154,46 @@ struct PacketBlock {
 	size_t bytes;
 	size_t size;
 
+	/**
+	 * \brief Constructor, packets are allocated by the current memory policy when set.
+	 */
 	PacketBlock(size_t pkts_size)
 		: cnt(0)
 		, bytes(0)
 		, size(pkts_size)
+		, m_capacity(pkts_size)
+		, m_memory({nullptr, 0, PageType::DEFAULT})
+	{
+		MemoryPolicy* policy = MemoryPolicy::get_current();
+		if (policy == nullptr) {
+			pkts = new Packet[pkts_size];
+			return;
+		}
+		m_memory = policy->allocate(pkts_size * sizeof(Packet));
+		pkts = static_cast<Packet*>(m_memory.ptr);
+		for (size_t i = 0; i < m_capacity; i++) {
+			new (&pkts[i]) Packet();
+		}
+	}
+
+	~PacketBlock()
 	{
-		pkts = new Packet[pkts_size];
+		if (m_memory.ptr == nullptr) {
+			delete[] pkts;
+			return;
+		}
+		for (size_t i = 0; i < m_capacity; i++) {
+			pkts[i].~Packet();
+		}
+		MemoryPolicy::free(m_memory);
 	}
 
-	~PacketBlock() { delete[] pkts; }
+	PacketBlock(const PacketBlock&) = delete;
+	PacketBlock& operator=(const PacketBlock&) = delete;
+
+private:
+	size_t m_capacity;
+	MemoryPolicy::Region m_memory;
 };
 
 } // namespace ipxp
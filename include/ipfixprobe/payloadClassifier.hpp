@@ -0,0 +1,87 @@
+/**
+ * @file
+ * @brief Shared classification of packet payloads to application protocols
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "api.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ipxp {
+
+/**
+ * \brief Classifier of packet payloads to process plugins.
+ *
+ * Every plugin registers payload prefixes of its protocol and optionally the protocol name used
+ * in text request lines ("METHOD URI PROTO/VERSION"). Classification runs in stages, each of
+ * them only when the previous one left candidates unmatched:
+ *  1. first payload byte selects plugins with a prefix starting by that byte,
+ *  2. prefixes of the selected plugins are compared as masked 64-bit words,
+ *  3. request line is split once and its protocol name compared.
+ */
+class IPXP_API PayloadClassifier {
+public:
+	/** Longest payload prefix. */
+	static const size_t MAX_SIGNATURE_LEN = 8;
+	/** Longest method of a request line. */
+	static const size_t MAX_METHOD_LEN = 32;
+
+	PayloadClassifier();
+
+	/**
+	 * \brief Add protocol of a plugin.
+	 * \param plugin Bit of the plugin.
+	 * \param signatures Payload prefixes of the protocol.
+	 * \param request_line Protocol name in request lines, empty when the protocol has none.
+	 * \throw PluginError when a prefix is empty or longer than MAX_SIGNATURE_LEN.
+	 */
+	void add(
+		uint64_t plugin,
+		const std::vector<std::string>& signatures,
+		const std::string& request_line);
+
+	/**
+	 * \brief Get plugins whose protocol matches the payload.
+	 * \param payload Payload of the packet.
+	 * \param len Length of the payload.
+	 * \param candidates Plugins to consider.
+	 * \return Matching plugins, subset of candidates.
+	 */
+	uint64_t classify(const uint8_t* payload, size_t len, uint64_t candidates) const;
+
+	/** Plugins added to the classifier. */
+	uint64_t get_plugins() const { return m_plugins; }
+
+private:
+	struct Signature {
+		uint64_t plugin;
+		uint64_t value; /**< Prefix bytes, zero padded */
+		uint64_t mask; /**< Ones over the prefix bytes */
+		size_t len;
+	};
+
+	struct RequestLine {
+		uint64_t plugin;
+		std::string protocol;
+	};
+
+	uint64_t m_plugins;
+	uint64_t m_request_line_plugins;
+	uint64_t m_first_byte[256]; /**< Plugins with a prefix starting by the byte */
+	std::vector<Signature> m_signatures[256]; /**< Prefixes by their first byte */
+	std::vector<RequestLine> m_request_lines;
+
+	uint64_t match_request_line(const uint8_t* payload, size_t len, uint64_t candidates) const;
+};
+
+} // namespace ipxp
@@ -18,6 +18,9 @@
 #include "plugin.hpp"
 
 #include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace ipxp {
 
@@ -36,6 +39,48 @@ namespace ipxp {
  */
 #define FLOW_FLUSH_WITH_REINSERT 0x3
 
+/**
+ * \brief Tell storage plugin that the plugin does not need more packets of current flow.
+ * Can be combined with other options. When returned from post_create, pre_update or post_update,
+ * the plugin is not called for the following packets of the flow, pre_export is still called.
+ */
+#define FLOW_PLUGIN_DONE 0x4
+
+/**
+ * \brief Packets a process plugin wants to see.
+ *
+ * Storage plugin matches the protocol and ports when a flow is created and calls hooks of the
+ * plugin only for matching flows. Payload and direction are matched on every packet. Interest
+ * is only a filter, plugins keep checking packets they get on their own.
+ *
+ * Plugins with signatures or a request line are not called for a flow until the payload
+ * classifier assigns the flow to them. The plugin then gets the classified packet and all
+ * following packets of the flow. When none of the first StoragePlugin::CLASSIFY_PAYLOAD_PKTS
+ * payload packets of the flow matches, the plugin is never called for the flow.
+ */
+struct PacketInterest {
+	enum Protocol : uint8_t {
+		TCP = 0x01,
+		UDP = 0x02,
+		ICMP = 0x04, /**< ICMP and ICMPv6 */
+		OTHER = 0x08,
+		ANY = 0x0F,
+	};
+
+	enum Direction : uint8_t {
+		FORWARD = 0x01, /**< Packets in direction of the first packet of the flow */
+		REVERSE = 0x02,
+		BOTH = 0x03,
+	};
+
+	uint8_t protocols = ANY; /**< Mask of L4 protocols of the flow */
+	std::vector<uint16_t> ports; /**< Source or destination port of the flow, empty for any */
+	bool payload = false; /**< Only packets with L4 payload */
+	uint8_t direction = BOTH; /**< Mask of packet directions */
+	std::vector<std::string> signatures; /**< Payload prefixes of the protocol */
+	std::string request_line; /**< Protocol name in "METHOD URI PROTO/VERSION" request lines */
+};
+
 /**
  * \brief Class template for flow cache plugins.
  */
@@ -51,6 +96,12 @@ public:
 
 	virtual RecordExt* get_ext() const { return nullptr; }
 
+	/**
+	 * \brief Get packets the plugin wants to process, all packets by default.
+	 * \return Packet interest, queried once when the plugin is added to the storage plugin.
+	 */
+	virtual PacketInterest get_interest() const { return PacketInterest(); }
+
 	/**
 	 * \brief Called before a new flow record is created.
 	 * \param [in] pkt Parsed packet.
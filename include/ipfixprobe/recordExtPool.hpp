@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief Fixed-size pools of flow record extensions
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "api.hpp"
+#include "memory.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ipxp {
+
+/**
+ * \brief Allocator of flow record extensions of one pipeline.
+ *
+ * Process plugins create extensions for new flows and the flow cache destroys them when flows
+ * are exported, so extensions are allocated and freed at the flow rate. RecordExt allocations
+ * go through the pool of the calling thread. Objects of every size class are carved from slabs
+ * obtained from the memory policy of the pipeline and recycled through a free list.
+ *
+ * Objects can be freed by any thread. Objects of other pools are returned through a lock-free
+ * list which the owner thread reclaims when its own free list is empty. Threads without a pool
+ * and large objects use regular heap allocation.
+ */
+class IPXP_API RecordExtPool {
+public:
+	/** Granularity of size classes, also alignment of objects. */
+	static const size_t SIZE_ALIGN = 16;
+	/** Larger objects are allocated on the heap. */
+	static const size_t MAX_SIZE = 8192;
+	/** Minimal size of a slab of one size class. */
+	static const size_t SLAB_SIZE = 64 * 1024;
+	/** Slabs are carved from arenas of this size. */
+	static const size_t ARENA_SIZE = 2 * 1024 * 1024;
+
+	/**
+	 * \brief Occupancy of one size class.
+	 */
+	struct ClassStats {
+		size_t size; /**< Object size in bytes */
+		uint64_t used; /**< Allocated objects */
+		uint64_t capacity; /**< Objects which fit to the slabs of the class */
+	};
+
+	/**
+	 * \brief Constructor.
+	 * \param memory Memory policy of the pipeline, nullptr for regular pages.
+	 */
+	explicit RecordExtPool(MemoryPolicy* memory = nullptr);
+	~RecordExtPool();
+
+	RecordExtPool(const RecordExtPool&) = delete;
+	RecordExtPool& operator=(const RecordExtPool&) = delete;
+
+	/**
+	 * \brief Allocate object from the pool of the calling thread.
+	 * \throw std::bad_alloc when no memory is available.
+	 */
+	static void* allocate(size_t size);
+
+	/**
+	 * \brief Free object returned by allocate().
+	 */
+	static void deallocate(void* ptr);
+
+	/**
+	 * \brief Set pool used by allocations of the calling thread, nullptr means heap.
+	 */
+	static void set_current(RecordExtPool* pool);
+	static RecordExtPool* get_current();
+
+	/**
+	 * \brief Occupancy of size classes in use, safe to call from any thread.
+	 */
+	std::vector<ClassStats> get_stats() const;
+
+	/** Bytes of arenas obtained from the memory policy. */
+	uint64_t get_memory() const { return m_memory_size.load(std::memory_order_relaxed); }
+
+private:
+	struct SizeClass;
+	static const size_t CLASS_CNT = MAX_SIZE / SIZE_ALIGN + 1;
+
+	MemoryPolicy m_default_memory;
+	MemoryPolicy* m_memory;
+	std::vector<MemoryPolicy::Region> m_arenas;
+	uint8_t* m_arena_pos;
+	uint8_t* m_arena_end;
+	std::atomic<uint64_t> m_memory_size;
+	std::array<std::atomic<SizeClass*>, CLASS_CNT> m_classes;
+
+	void* alloc(size_t size);
+	SizeClass* get_class(size_t idx);
+	void add_slab(SizeClass* cls);
+};
+
+} // namespace ipxp
@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -51,6 +52,11 @@ typedef void ipx_msg_t;
  * @{
  */
 
+/** Default number of busy-wait iterations before a reader or writer parks */
+#define IPX_RING_DEFAULT_SPIN_CNT 1024
+/** Default maximum time of one park in milliseconds */
+#define IPX_RING_DEFAULT_PARK_TIMEOUT 100
+
 /** Internal ring buffer type  */
 struct IPX_API ipx_ring;
 typedef struct ipx_ring ipx_ring_t;
@@ -89,13 +95,87 @@ IPX_API void ipx_ring_push(ipx_ring_t* ring, ipx_msg_t* msg);
 /**
  * \brief Get a message from the ring buffer
  *
- * \note The function blocks until the message is ready.
+ * \note The function waits for the message at most the park timeout, see ipx_ring_set_wait().
  * \warning Cannot be used concurrently by multiple threads at the same time.
  * \param[in] ring Ring buffer
- * \return Pointer to the message
+ * \return Pointer to the message or NULL (no message is ready)
  */
 IPX_API ipx_msg_t* ipx_ring_pop(ipx_ring_t* ring);
 
+/**
+ * \brief Get a message from the ring buffer if there is any
+ *
+ * Same as ipx_ring_pop(), but returns immediately when the buffer is empty. Useful when
+ * a single reader serves multiple ring buffers.
+ * \warning Cannot be used concurrently by multiple threads at the same time.
+ * \param[in] ring Ring buffer
+ * \return Pointer to the message or NULL (the buffer is empty)
+ */
+IPX_API ipx_msg_t* ipx_ring_try_pop(ipx_ring_t* ring);
+
+/**
+ * \brief Get multiple messages from the ring buffer at once
+ *
+ * Pointers to the messages are copied to the \p msgs array. The messages are owned by the reader
+ * until the next call of any pop function, i.e. writers can't reuse them before that. Waits for
+ * messages at most the same time as ipx_ring_pop().
+ * \warning Cannot be used concurrently by multiple threads at the same time.
+ * \param[in]  ring Ring buffer
+ * \param[out] msgs Array of at least \p max pointers
+ * \param[in]  max  Maximum number of messages to get
+ * \return Number of messages (0 when no message is ready)
+ */
+IPX_API uint32_t ipx_ring_pop_burst(ipx_ring_t* ring, ipx_msg_t** msgs, uint32_t max);
+
+/**
+ * \brief Get multiple messages from the ring buffer if there are any
+ *
+ * Same as ipx_ring_pop_burst(), but returns immediately when the buffer is empty.
+ * \warning Cannot be used concurrently by multiple threads at the same time.
+ * \param[in]  ring Ring buffer
+ * \param[out] msgs Array of at least \p max pointers
+ * \param[in]  max  Maximum number of messages to get
+ * \return Number of messages (0 when the buffer is empty)
+ */
+IPX_API uint32_t ipx_ring_try_pop_burst(ipx_ring_t* ring, ipx_msg_t** msgs, uint32_t max);
+
+/**
+ * \brief Wait until any of the ring buffers contains a message
+ *
+ * Useful when a single reader serves multiple ring buffers. To be woken up by writers of all
+ * the rings, the rings must share the reader parking place, see ipx_ring_share_reader().
+ * Waiting strategy of the first ring is used.
+ * \warning Cannot be used concurrently with pop functions of the rings.
+ * \param[in] rings Ring buffers
+ * \param[in] cnt   Number of ring buffers
+ * \return True if a message is ready, false if the park timeout expired
+ */
+IPX_API bool ipx_ring_wait_any(ipx_ring_t* const* rings, size_t cnt);
+
+/**
+ * \brief Wake up the reader of \p ring the same way as the reader of \p leader
+ *
+ * After the call, writers of both ring buffers wake up the reader waiting in ipx_ring_wait_any().
+ * \warning Must be called before any writer starts to use the ring buffer.
+ * \param[in] ring   Ring buffer
+ * \param[in] leader Ring buffer whose reader parking place is used
+ */
+IPX_API void ipx_ring_share_reader(ipx_ring_t* ring, ipx_ring_t* leader);
+
+/**
+ * \brief Configure waiting on empty (reader) or full (writer) ring buffer
+ *
+ * A waiting thread first polls the ring buffer \p spin_cnt times with a CPU pause hint in
+ * between, which keeps wake up latency low under bursty load. Then it parks on a futex and
+ * the other side wakes it up only when it is really parked, so idle threads don't consume CPU.
+ * Blocking pop functions return without a message after \p park_timeout.
+ * \warning Must be called before the ring buffer is used.
+ * \param[in] ring         Ring buffer
+ * \param[in] spin_cnt     Number of busy-wait iterations before parking (0 = park immediately)
+ * \param[in] park_timeout Maximum time of one park in milliseconds
+ */
+IPX_API void ipx_ring_set_wait(ipx_ring_t* ring, uint32_t spin_cnt, uint32_t park_timeout);
+
 /**
  * \brief Change (i.e. disable/enable) multi-writer mode
  *
@@ -16,12 +16,17 @@
 #include "api.hpp"
 #include "flowifc.hpp"
 #include "packet.hpp"
+#include "payloadClassifier.hpp"
 #include "plugin.hpp"
 #include "processPlugin.hpp"
 #include "ring.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include <netinet/in.h>
 
 #include <telemetry.hpp>
 
@@ -32,10 +37,24 @@ namespace ipxp {
  */
 class IPXP_API StoragePlugin : public Plugin {
 public:
+	/** Maximal number of process plugins, plugins of a flow are stored in a bit mask. */
+	static const uint32_t MAX_PLUGIN_CNT = 64;
+	/**
+	 * Payload packets of a flow compared to the protocols of pending plugins, in any direction.
+	 * Two packets cover the request and the response of the first exchange.
+	 */
+	static const uint8_t CLASSIFY_PAYLOAD_PKTS = 2;
+
 	StoragePlugin()
 		: m_export_queue(nullptr)
 		, m_plugins(nullptr)
 		, m_plugin_cnt(0)
+		, m_protocol_plugins()
+		, m_any_port_plugins(0)
+		, m_port_interests()
+		, m_no_payload_plugins(0)
+		, m_direction_plugins()
+		, m_classifier()
 	{
 	}
 
@@ -53,6 +72,22 @@ public:
 	 */
 	virtual int put_pkt(Packet& pkt) = 0;
 
+	/**
+	 * \brief Put all packets of the block into the cache.
+	 *
+	 * Packets are processed in the order they are stored in the block. Implementations can
+	 * override this function to process packets in batches (e.g. hash and prefetch ahead).
+	 * \param [in] block Block of input parsed packets.
+	 * \return 0 on success.
+	 */
+	virtual int put_pkt_block(PacketBlock& block)
+	{
+		for (size_t i = 0; i < block.cnt; i++) {
+			put_pkt(block.pkts[i]);
+		}
+		return 0;
+	}
+
 	/**
 	 * \brief Set export queue
 	 */
@@ -77,6 +112,35 @@ public:
 	 */
 	void add_plugin(ProcessPlugin* plugin)
 	{
+		if (m_plugin_cnt == MAX_PLUGIN_CNT) {
+			throw PluginError(
+				"storage plugin supports at most " + std::to_string(MAX_PLUGIN_CNT)
+				+ " process plugins");
+		}
+
+		const uint64_t bit = static_cast<uint64_t>(1) << m_plugin_cnt;
+		const PacketInterest interest = plugin->get_interest();
+		for (unsigned int i = 0; i < PROTOCOL_CNT; i++) {
+			if (interest.protocols & (1 << i)) {
+				m_protocol_plugins[i] |= bit;
+			}
+		}
+		if (interest.ports.empty()) {
+			m_any_port_plugins |= bit;
+		} else {
+			m_port_interests.push_back({bit, interest.ports});
+		}
+		if (!interest.payload) {
+			m_no_payload_plugins |= bit;
+		}
+		if (interest.direction & PacketInterest::REVERSE) {
+			m_direction_plugins[0] |= bit;
+		}
+		if (interest.direction & PacketInterest::FORWARD) {
+			m_direction_plugins[1] |= bit;
+		}
+		m_classifier.add(bit, interest.signatures, interest.request_line);
+
 		if (m_plugins == nullptr) {
 			m_plugins = new ProcessPlugin*[8];
 		} else {
@@ -102,9 +166,12 @@ protected:
 	 */
 	int plugins_pre_create(Packet& pkt)
 	{
+		// Direction of the packet is not known yet
+		const uint64_t plugins = flow_plugins(pkt) & payload_plugins(pkt);
+
 		int ret = 0;
-		for (unsigned int i = 0; i < m_plugin_cnt; i++) {
-			ret |= m_plugins[i]->pre_create(pkt);
+		for (uint64_t mask = plugins; mask != 0; mask &= mask - 1) {
+			ret |= m_plugins[__builtin_ctzll(mask)]->pre_create(pkt);
 		}
 		return ret;
 	}
@@ -117,9 +184,16 @@ protected:
 	 */
 	int plugins_post_create(Flow& rec, const Packet& pkt)
 	{
+		rec.plugins_mask = flow_plugins(pkt);
+		rec.plugins_pending = rec.plugins_mask & m_classifier.get_plugins();
+		rec.plugins_active = rec.plugins_mask & ~rec.plugins_pending;
+		rec.classified_pkts = 0;
+		classify(rec, pkt);
+
 		int ret = 0;
-		for (unsigned int i = 0; i < m_plugin_cnt; i++) {
-			ret |= m_plugins[i]->post_create(rec, pkt);
+		for (uint64_t mask = packet_plugins(rec, pkt); mask != 0; mask &= mask - 1) {
+			const int plugin_ret = m_plugins[__builtin_ctzll(mask)]->post_create(rec, pkt);
+			ret |= check_done(rec, mask & -mask, plugin_ret);
 		}
 		return ret;
 	}
@@ -132,9 +206,12 @@ protected:
 	 */
 	int plugins_pre_update(Flow& rec, Packet& pkt)
 	{
+		classify(rec, pkt);
+
 		int ret = 0;
-		for (unsigned int i = 0; i < m_plugin_cnt; i++) {
-			ret |= m_plugins[i]->pre_update(rec, pkt);
+		for (uint64_t mask = packet_plugins(rec, pkt); mask != 0; mask &= mask - 1) {
+			const int plugin_ret = m_plugins[__builtin_ctzll(mask)]->pre_update(rec, pkt);
+			ret |= check_done(rec, mask & -mask, plugin_ret);
 		}
 		return ret;
 	}
@@ -147,8 +224,9 @@ protected:
 	int plugins_post_update(Flow& rec, const Packet& pkt)
 	{
 		int ret = 0;
-		for (unsigned int i = 0; i < m_plugin_cnt; i++) {
-			ret |= m_plugins[i]->post_update(rec, pkt);
+		for (uint64_t mask = packet_plugins(rec, pkt); mask != 0; mask &= mask - 1) {
+			const int plugin_ret = m_plugins[__builtin_ctzll(mask)]->post_update(rec, pkt);
+			ret |= check_done(rec, mask & -mask, plugin_ret);
 		}
 		return ret;
 	}
@@ -159,16 +237,128 @@ protected:
 	 */
 	void plugins_pre_export(Flow& rec)
 	{
-		for (unsigned int i = 0; i < m_plugin_cnt; i++) {
-			m_plugins[i]->pre_export(rec);
+		for (uint64_t mask = rec.plugins_mask & ~rec.plugins_pending; mask != 0; mask &= mask - 1) {
+			m_plugins[__builtin_ctzll(mask)]->pre_export(rec);
 		}
 	}
 
+	/**
+	 * \brief Check whether any plugin still needs packets of the flow.
+	 * \param [in] rec Stored flow record.
+	 * \return False when packets of the flow only update its counters.
+	 */
+	static bool plugins_needed(const Flow& rec)
+	{
+		return (rec.plugins_active | rec.plugins_pending) != 0;
+	}
+
 	ipx_ring_t* m_export_queue;
 
 private:
+	/** Protocols of PacketInterest in order of their bits. */
+	static const unsigned int PROTOCOL_CNT = 4;
+
+	/**
+	 * \brief Ports of flows a plugin is interested in.
+	 */
+	struct PortInterest {
+		uint64_t plugin; /**< Bit of the plugin */
+		std::vector<uint16_t> ports;
+	};
+
 	ProcessPlugin** m_plugins; /**< Array of plugins. */
 	uint32_t m_plugin_cnt;
+	uint64_t m_protocol_plugins[PROTOCOL_CNT]; /**< Plugins interested in TCP, UDP, ICMP, other */
+	uint64_t m_any_port_plugins; /**< Plugins interested in flows with any ports */
+	std::vector<PortInterest> m_port_interests;
+	uint64_t m_no_payload_plugins; /**< Plugins interested in packets without payload */
+	uint64_t m_direction_plugins[2]; /**< Plugins interested in reverse and forward packets */
+	PayloadClassifier m_classifier;
+
+	static unsigned int protocol_idx(uint8_t ip_proto)
+	{
+		switch (ip_proto) {
+		case IPPROTO_TCP:
+			return 0;
+		case IPPROTO_UDP:
+			return 1;
+		case IPPROTO_ICMP:
+		case IPPROTO_ICMPV6:
+			return 2;
+		default:
+			return 3;
+		}
+	}
+
+	/**
+	 * \brief Get plugins interested in the flow the packet belongs to.
+	 */
+	uint64_t flow_plugins(const Packet& pkt) const
+	{
+		const uint64_t plugins = m_protocol_plugins[protocol_idx(pkt.ip_proto)];
+		uint64_t port_plugins = m_any_port_plugins;
+		for (const auto& interest : m_port_interests) {
+			if (!(plugins & interest.plugin)) {
+				continue;
+			}
+			for (const auto port : interest.ports) {
+				if (port == pkt.src_port || port == pkt.dst_port) {
+					port_plugins |= interest.plugin;
+					break;
+				}
+			}
+		}
+		return plugins & port_plugins;
+	}
+
+	uint64_t payload_plugins(const Packet& pkt) const
+	{
+		return pkt.payload_len != 0 ? ~static_cast<uint64_t>(0) : m_no_payload_plugins;
+	}
+
+	/**
+	 * \brief Get plugins of the flow interested in the packet.
+	 */
+	uint64_t packet_plugins(const Flow& rec, const Packet& pkt) const
+	{
+		return rec.plugins_active & payload_plugins(pkt) & m_direction_plugins[pkt.source_pkt];
+	}
+
+	/**
+	 * \brief Hand the flow to plugins waiting for classification whose protocol the packet matches.
+	 *
+	 * Plugins still pending after CLASSIFY_PAYLOAD_PKTS payload packets are dropped from the flow,
+	 * so flows of other protocols stop being classified and can skip the plugins entirely.
+	 */
+	void classify(Flow& rec, const Packet& pkt) const
+	{
+		if (rec.plugins_pending == 0 || pkt.payload_len == 0) {
+			return;
+		}
+		const uint64_t matched
+			= m_classifier.classify(pkt.payload, pkt.payload_len, rec.plugins_pending);
+		rec.plugins_pending &= ~matched;
+		rec.plugins_active |= matched;
+		if (++rec.classified_pkts >= CLASSIFY_PAYLOAD_PKTS) {
+			rec.plugins_mask &= ~rec.plugins_pending;
+			rec.plugins_pending = 0;
+		}
+	}
+
+	/**
+	 * \brief Stop calling the plugin for the flow when it returned FLOW_PLUGIN_DONE.
+	 * \param [in,out] rec Flow record.
+	 * \param [in] plugin Bit of the plugin.
+	 * \param [in] ret Options returned by the plugin.
+	 * \return Options for flow cache.
+	 */
+	static int check_done(Flow& rec, uint64_t plugin, int ret)
+	{
+		if (ret & FLOW_PLUGIN_DONE) {
+			rec.plugins_active &= ~plugin;
+		}
+		return ret & ~FLOW_PLUGIN_DONE;
+	}
 };
 
 /**
@@ -355,6 +355,11 @@ def process_storage(config):
     if split_biflow:
         params.append("S")
 
+    # Direction-agnostic biflow key (flag if true)
+    canonical_key = storage.get("canonical_key", None)
+    if canonical_key:
+        params.append("C")
+
     # Fragmentation cache settings
     fragmentation_cache = storage.get("fragmentation_cache", {})
     if isinstance(fragmentation_cache, dict):
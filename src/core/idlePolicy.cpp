@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief Strategies of waiting for packets on idle inputs
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "idlePolicy.hpp"
+
+#include <cerrno>
+#include <ctime>
+
+#include <poll.h>
+
+namespace ipxp {
+
+static uint64_t elapsed_us(const struct timespec& begin, const struct timespec& end)
+{
+	return (end.tv_sec - begin.tv_sec) * 1000000L + (end.tv_nsec - begin.tv_nsec) / 1000;
+}
+
+IdlePolicy::IdlePolicy(Mode mode, int fd)
+	: m_mode(mode)
+	, m_fd(fd)
+	, m_idle_streak(0)
+	, m_busy_cycles(0)
+	, m_idle_cycles(0)
+	, m_idle_time(0)
+{
+}
+
+void IdlePolicy::backoff()
+{
+	if (m_idle_streak < SPIN_CYCLES) {
+		m_idle_streak++;
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+		return;
+	}
+
+	const uint32_t shift = m_idle_streak - SPIN_CYCLES;
+	uint32_t sleep_us = MAX_SLEEP_US;
+	if (shift < 32 && (1U << shift) < MAX_SLEEP_US) {
+		sleep_us = 1U << shift;
+		m_idle_streak++;
+	}
+
+	struct timespec begin;
+	struct timespec end;
+	struct timespec sleep_time = {0, static_cast<long>(sleep_us) * 1000L};
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	nanosleep(&sleep_time, nullptr);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	add(m_idle_time, elapsed_us(begin, end));
+}
+
+void IdlePolicy::idle()
+{
+	add(m_idle_cycles, 1);
+
+	if (m_mode == Mode::BUSY) {
+		return;
+	}
+	if (m_mode == Mode::BACKOFF || m_fd < 0) {
+		backoff();
+		return;
+	}
+
+	struct pollfd pfd = {m_fd, POLLIN, 0};
+	struct timespec begin;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (poll(&pfd, 1, BLOCK_TIMEOUT_MS) < 0 && errno != EINTR) {
+		// Descriptor is not pollable, wait for packets the other way
+		m_fd = -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	add(m_idle_time, elapsed_us(begin, end));
+}
+
+bool IdlePolicy::parse_mode(const std::string& str, Mode& mode)
+{
+	if (str == "busy") {
+		mode = Mode::BUSY;
+	} else if (str == "backoff") {
+		mode = Mode::BACKOFF;
+	} else if (str == "block") {
+		mode = Mode::BLOCK;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char* IdlePolicy::mode_name(Mode mode)
+{
+	switch (mode) {
+	case Mode::BUSY:
+		return "busy";
+	case Mode::BLOCK:
+		return "block";
+	default:
+		return "backoff";
+	}
+}
+
+} // namespace ipxp
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Strategies of waiting for packets on idle inputs
+ *
+ * An input plugin which has no packet returns TIMEOUT immediately. Calling it again in a tight
+ * loop keeps the core busy even on an idle link, so the worker asks its idle policy what to do
+ * between the calls: poll again, sleep with exponential backoff or block on the file descriptor
+ * of the input until packets arrive.
+ *
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ipxp {
+
+class IdlePolicy {
+public:
+	enum class Mode : uint8_t {
+		BUSY, /**< Poll the input again immediately */
+		BACKOFF, /**< Spin shortly, then sleep with exponentially growing time */
+		BLOCK, /**< Wait on the file descriptor of the input, backoff when it has none */
+	};
+
+	/** Number of idle cycles spent spinning before the backoff starts to sleep. */
+	static const uint32_t SPIN_CYCLES = 64;
+	/** Longest backoff sleep in microseconds. */
+	static const uint32_t MAX_SLEEP_US = 1000;
+	/** Longest block on the file descriptor in milliseconds. */
+	static const int BLOCK_TIMEOUT_MS = 100;
+
+	/**
+	 * \brief Constructor.
+	 * \param mode Idle strategy.
+	 * \param fd File descriptor signalling packets of the input, -1 when not available.
+	 */
+	explicit IdlePolicy(Mode mode = Mode::BACKOFF, int fd = -1);
+
+	/**
+	 * \brief Report cycle in which packets were received, resets the backoff.
+	 */
+	void busy()
+	{
+		add(m_busy_cycles, 1);
+		m_idle_streak = 0;
+	}
+
+	/**
+	 * \brief Report cycle without packets and wait according to the policy.
+	 */
+	void idle();
+
+	Mode get_mode() const { return m_mode; }
+	uint64_t get_busy_cycles() const { return m_busy_cycles.load(std::memory_order_relaxed); }
+	uint64_t get_idle_cycles() const { return m_idle_cycles.load(std::memory_order_relaxed); }
+	/** Time spent sleeping or blocking in microseconds. */
+	uint64_t get_idle_time() const { return m_idle_time.load(std::memory_order_relaxed); }
+
+	/**
+	 * \brief Parse mode name (busy, backoff or block).
+	 * \return False when the name is unknown.
+	 */
+	static bool parse_mode(const std::string& str, Mode& mode);
+	static const char* mode_name(Mode mode);
+
+private:
+	Mode m_mode;
+	int m_fd;
+	uint32_t m_idle_streak;
+	/* Written only by the worker thread, read by telemetry */
+	std::atomic<uint64_t> m_busy_cycles;
+	std::atomic<uint64_t> m_idle_cycles;
+	std::atomic<uint64_t> m_idle_time;
+
+	void backoff();
+
+	static void add(std::atomic<uint64_t>& counter, uint64_t value)
+	{
+		// Single writer, no need for atomic read-modify-write
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+};
+
+} // namespace ipxp
@@ -54,6 +54,7 @@ volatile sig_atomic_t terminate_export = 0;
 volatile sig_atomic_t terminate_input = 0;
 
 const uint32_t DEFAULT_IQUEUE_SIZE = 64;
+const uint32_t DEFAULT_IBLOCK_SIZE = 64;
 const uint32_t DEFAULT_OQUEUE_SIZE = 16536;
 const uint32_t DEFAULT_FPS = 0; // unlimited
 
@@ -211,11 +212,31 @@ void process_plugin_argline(
 	trim_str(params);
 }
 
-telemetry::Content get_ipx_ring_telemetry(ipx_ring_t* ring)
+telemetry::Content get_ipx_ring_telemetry(const std::vector<ipx_ring_t*>& rings)
 {
 	telemetry::Dict dict;
-	uint64_t size = ipx_ring_size(ring);
-	uint64_t count = ipx_ring_cnt(ring);
+	uint64_t size = 0;
+	uint64_t count = 0;
+	for (auto ring : rings) {
+		size += ipx_ring_size(ring);
+		count += ipx_ring_cnt(ring);
+	}
+	double usage = 0;
+	if (size) {
+		usage = (double) count / size * 100;
+	}
+
+	dict["size"] = size;
+	dict["count"] = count;
+	dict["usage"] = telemetry::ScalarWithUnit {usage, "%"};
+	return dict;
+}
+
+telemetry::Content get_input_queue_telemetry(const PacketBlockRing* ring)
+{
+	telemetry::Dict dict;
+	uint64_t size = ring->size();
+	uint64_t count = ring->count();
 	double usage = 0;
 	if (size) {
 		usage = (double) count / size * 100;
@@ -227,6 +248,77 @@ telemetry::Content get_ipx_ring_telemetry(ipx_ring_t* ring)
 	return dict;
 }
 
+/**
+ * \brief Makes memory policy current for the lifetime of the guard.
+ *
+ * Clears the current policy also when creating the pipeline plugins throws.
+ */
+class CurrentMemoryPolicy {
+public:
+	explicit CurrentMemoryPolicy(MemoryPolicy* memory) { MemoryPolicy::set_current(memory); }
+	~CurrentMemoryPolicy() { MemoryPolicy::set_current(nullptr); }
+
+	CurrentMemoryPolicy(const CurrentMemoryPolicy&) = delete;
+	CurrentMemoryPolicy& operator=(const CurrentMemoryPolicy&) = delete;
+};
+
+telemetry::Content get_memory_telemetry(const MemoryPolicy* memory)
+{
+	telemetry::Dict dict;
+	const PageType requested = memory->get_page_type();
+	dict["requested_pages"] = std::string(MemoryPolicy::page_type_name(requested));
+	dict["numa_node"] = static_cast<int64_t>(memory->get_numa_node());
+	dict["numa_bound_bytes"] = memory->get_numa_bound();
+	for (auto pages :
+		 {PageType::DEFAULT, PageType::TRANSPARENT, PageType::HUGE_2M, PageType::HUGE_1G}) {
+		dict[std::string(MemoryPolicy::page_type_name(pages)) + "_pages_bytes"]
+			= memory->get_allocated(pages);
+	}
+	return dict;
+}
+
+telemetry::Content get_idle_telemetry(const IdlePolicy* idle)
+{
+	telemetry::Dict dict;
+	const uint64_t busy = idle->get_busy_cycles();
+	const uint64_t idle_cycles = idle->get_idle_cycles();
+	double idle_ratio = 0;
+	if (busy + idle_cycles) {
+		idle_ratio = (double) idle_cycles / (busy + idle_cycles) * 100;
+	}
+
+	dict["mode"] = std::string(IdlePolicy::mode_name(idle->get_mode()));
+	dict["busy_cycles"] = busy;
+	dict["idle_cycles"] = idle_cycles;
+	dict["idle_ratio"] = telemetry::ScalarWithUnit {idle_ratio, "%"};
+	dict["idle_time"] = telemetry::ScalarWithUnit {idle->get_idle_time() / 1000000.0, "s"};
+	return dict;
+}
+
+telemetry::Content get_ext_pool_telemetry(const RecordExtPool* pool)
+{
+	telemetry::Dict dict;
+	uint64_t used = 0;
+	uint64_t capacity = 0;
+	for (const auto& cls : pool->get_stats()) {
+		const std::string name = std::to_string(cls.size) + "B";
+		dict[name + "_used"] = cls.used;
+		dict[name + "_capacity"] = cls.capacity;
+		used += cls.used;
+		capacity += cls.capacity;
+	}
+	double usage = 0;
+	if (capacity) {
+		usage = (double) used / capacity * 100;
+	}
+
+	dict["used"] = used;
+	dict["capacity"] = capacity;
+	dict["usage"] = telemetry::ScalarWithUnit {usage, "%"};
+	dict["memory_bytes"] = pool->get_memory();
+	return dict;
+}
+
 void set_thread_details(pthread_t thread, const std::string& name, const std::vector<int>& affinity)
 {
 	// Set thread name and affinity
@@ -262,7 +354,7 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 		if (affinity.size() != 0) {
 			throw IPXPError(
 				"cannot set CPU affinity for storage plugin (storage plugin is invoked inside "
-				"input threads)");
+				"input threads, use -T CPU_LIST for separate storage threads)");
 		}
 	}
 	std::vector<int> output_worker_affinity;
@@ -300,6 +392,11 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 		try {
 			auto& processPluginFactory = ProcessPluginFactory::getInstance();
 			const int pluginID = ProcessPluginIDGenerator::instance().generatePluginID();
+			if (pluginID >= Record::MAX_EXTENSION_CNT) {
+				throw IPXPError(
+					"at most " + std::to_string(Record::MAX_EXTENSION_CNT)
+					+ " process plugins are supported");
+			}
 			processPlugin
 				= processPluginFactory.createShared(process_name, process_params, pluginID);
 			if (processPlugin == nullptr) {
@@ -318,15 +415,30 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 	// telemetry
 	conf.telemetry_root_node = telemetry::Directory::create();
 
-	// Output
+	// Output, every pipeline exports flows to its own single writer ring
 	auto output_dir = conf.telemetry_root_node->addDir("output");
-	ipx_ring_t* output_queue = ipx_ring_init(conf.oqueue_size, 1);
-	if (output_queue == nullptr) {
-		throw IPXPError("unable to initialize ring buffer");
+	auto ipxRingTelemetryDir = output_dir->addDir("ipxRing");
+	std::vector<ipx_ring_t*> output_queues;
+	for (size_t i = 0; i < parser.m_input.size(); i++) {
+		ipx_ring_t* output_queue = ipx_ring_init(conf.oqueue_size, 0);
+		if (output_queue == nullptr) {
+			throw IPXPError("unable to initialize ring buffer");
+		}
+		ipx_ring_set_wait(output_queue, conf.oqueue_spin, conf.oqueue_park_timeout);
+		if (!output_queues.empty()) {
+			// Output worker waits for flows from all pipelines at once
+			ipx_ring_share_reader(output_queue, output_queues.front());
+		}
+		output_queues.push_back(output_queue);
+
+		telemetry::FileOps queueOps
+			= {[=]() { return get_ipx_ring_telemetry({output_queue}); }, nullptr};
+		auto queueFile = ipxRingTelemetryDir->addDir(std::to_string(i))->addFile("stats", queueOps);
+		conf.holder.add(queueFile);
 	}
 
-	auto ipxRingTelemetryDir = output_dir->addDir("ipxRing");
-	telemetry::FileOps statsOps = {[=]() { return get_ipx_ring_telemetry(output_queue); }, nullptr};
+	telemetry::FileOps statsOps
+		= {[=]() { return get_ipx_ring_telemetry(output_queues); }, nullptr};
 	auto statsFile = ipxRingTelemetryDir->addFile("stats", statsOps);
 	conf.holder.add(statsFile);
 
@@ -357,13 +469,13 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 			   new std::thread(
 				   output_worker,
 				   outputPlugin,
-				   output_queue,
+				   output_queues,
 				   output_res,
 				   output_stats,
 				   conf.fps),
 			   output_res,
 			   output_stats,
-			   output_queue};
+			   output_queues};
 		set_thread_details(
 			tmp.thread->native_handle(),
 			"out_" + output_name,
@@ -390,6 +502,42 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 		auto pipeline_queue_dir
 			= pipeline_dir->addDir("queues")->addDir(std::to_string(pipeline_idx));
 
+		std::vector<int> storage_affinity;
+		if (conf.storage_thread && !conf.storage_cpus.empty()) {
+			storage_affinity.push_back(conf.storage_cpus[pipeline_idx % conf.storage_cpus.size()]);
+		}
+
+		auto pipeline_cache_dir = flowcache_dir->addDir(std::to_string(pipeline_idx));
+
+		// Flow cache tables and packet blocks created for this pipeline use its memory policy,
+		// the pipeline takes the ownership once it is set up
+		std::unique_ptr<MemoryPolicy> memory;
+		if (conf.hugepages != PageType::DEFAULT || conf.numa) {
+			int numa_node = -1;
+			if (conf.numa) {
+				numa_node = MemoryPolicy::get_numa_node(
+					conf.storage_thread ? storage_affinity : affinity);
+				if (numa_node < 0) {
+					std::cerr << "warning - cannot determine NUMA node of pipeline "
+							  << pipeline_idx << ", memory is not bound" << std::endl;
+				}
+			}
+			memory = std::make_unique<MemoryPolicy>(conf.hugepages, numa_node);
+		}
+		CurrentMemoryPolicy current_memory(memory.get());
+
+		// Extensions of the pipeline flows are allocated in the storage thread from its pool
+		auto ext_pool = new RecordExtPool(memory.get());
+		conf.ext_pools.emplace_back(ext_pool);
+		telemetry::FileOps extPoolOps
+			= {[=]() { return get_ext_pool_telemetry(ext_pool); }, nullptr};
+		conf.holder.add(pipeline_cache_dir->addFile("extensions", extPoolOps));
+
+		IdlePolicy::Mode idle_mode = IdlePolicy::Mode::BACKOFF;
+		if (!conf.idle_modes.empty()) {
+			idle_mode = conf.idle_modes[conf.idle_modes.size() == 1 ? 0 : pipeline_idx];
+		}
+
 		try {
 			auto& inputPluginFactory = InputPluginFactory::getInstance();
 			inputPlugin = inputPluginFactory.createShared(input_name, input_params);
@@ -413,7 +561,10 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 		try {
 			auto& storagePluginFactory = StoragePluginFactory::getInstance();
 			storagePlugin
-				= storagePluginFactory.createShared(storage_name, storage_params, output_queue);
+				= storagePluginFactory.createShared(
+					storage_name,
+					storage_params,
+					output_queues[pipeline_idx]);
 			if (storagePlugin == nullptr) {
 				throw IPXPError("invalid storage plugin " + storage_name);
 			}
@@ -437,24 +588,74 @@ bool process_plugin_args(ipxp_conf_t& conf, IpfixprobeOptParser& parser)
 		}
 
 		std::promise<WorkerResult>* input_res = new std::promise<WorkerResult>();
-		conf.input_fut.push_back(input_res->get_future());
 
 		auto input_stats = new std::atomic<InputStats>();
 		conf.input_stats.push_back(input_stats);
 
+		auto idle = new IdlePolicy(idle_mode, inputPlugin->get_fd());
+		telemetry::FileOps idleOps = {[=]() { return get_idle_telemetry(idle); }, nullptr};
+		conf.holder.add(pipeline_queue_dir->addFile("idle", idleOps));
+
 		WorkPipeline tmp
-			= {{inputPlugin,
-				new std::thread(
-					input_storage_worker,
-					inputPlugin,
-					storagePlugin,
-					conf.iqueue_size,
-					conf.max_pkts,
-					input_res,
-					input_stats),
+			= {{inputPlugin, nullptr, input_res, input_stats},
+			   {storagePlugin, storage_process_plugins, nullptr, nullptr, nullptr},
+			   memory.release(),
+			   idle,
+			   ext_pool};
+		if (tmp.memory != nullptr) {
+			const MemoryPolicy* pipeline_memory = tmp.memory;
+			telemetry::FileOps memoryOps
+				= {[=]() { return get_memory_telemetry(pipeline_memory); }, nullptr};
+			conf.holder.add(pipeline_cache_dir->addFile("memory", memoryOps));
+		}
+		if (conf.storage_thread) {
+			auto queue
+				= new PacketBlockRing(conf.iqueue_size, conf.iblock_size, conf.pkt_bufsize);
+			std::promise<WorkerResult>* storage_res = new std::promise<WorkerResult>();
+			conf.input_fut.push_back(storage_res->get_future());
+
+			telemetry::FileOps queueOps
+				= {[=]() { return get_input_queue_telemetry(queue); }, nullptr};
+			conf.holder.add(pipeline_queue_dir->addFile("input-queue", queueOps));
+
+			tmp.storage.queue = queue;
+			tmp.storage.promise = storage_res;
+			tmp.storage.thread = new std::thread(
+				storage_worker,
+				inputPlugin,
+				storagePlugin,
+				queue,
+				input_res->get_future(),
+				ext_pool,
+				idle_mode,
+				storage_res,
+				input_stats);
+			tmp.input.thread = new std::thread(
+				input_worker,
+				inputPlugin,
+				queue,
+				conf.max_pkts,
+				idle,
+				input_res);
+
+			set_thread_details(
+				tmp.storage.thread->native_handle(),
+				"st_" + std::to_string(pipeline_idx) + "_" + storage_name,
+				storage_affinity);
+		} else {
+			conf.input_fut.push_back(input_res->get_future());
+			tmp.input.thread = new std::thread(
+				input_storage_worker,
+				inputPlugin,
+				storagePlugin,
+				conf.iblock_size,
+				conf.max_pkts,
+				tmp.memory,
+				ext_pool,
+				idle,
 				input_res,
-				input_stats},
-			   {storagePlugin, storage_process_plugins}};
+				input_stats);
+		}
 		set_thread_details(
 			tmp.input.thread->native_handle(),
 			"in_" + std::to_string(pipeline_idx) + "_" + input_name,
@@ -474,6 +675,9 @@ void finish(ipxp_conf_t& conf)
 	terminate_input = 1;
 	for (auto& it : conf.pipelines) {
 		it.input.thread->join();
+		if (it.storage.thread != nullptr) {
+			it.storage.thread->join();
+		}
 		it.input.inputPlugin->close();
 	}
 
@@ -728,15 +932,42 @@ int run(int argc, char* argv[])
 		status = EXIT_FAILURE;
 		goto EXIT;
 	}
+	if (parser.m_storage_thread && parser.m_pkt_bufsize < 1) {
+		error("packet buffer size must be at least 1 byte");
+		status = EXIT_FAILURE;
+		goto EXIT;
+	}
 	if (parser.m_oqueue < 1) {
 		error("output queue size must be at least 1 record");
 		status = EXIT_FAILURE;
 		goto EXIT;
 	}
+	if (parser.m_idle.size() > 1 && parser.m_idle.size() != parser.m_input.size()) {
+		error("number of idle policies must be 1 or equal to the number of inputs");
+		status = EXIT_FAILURE;
+		goto EXIT;
+	}
+	if (parser.m_oqueue_park_timeout < 1) {
+		error("output queue sleep time must be at least 1 millisecond");
+		status = EXIT_FAILURE;
+		goto EXIT;
+	}
 
 	conf.worker_cnt = parser.m_input.size();
 	conf.iqueue_size = parser.m_iqueue;
 	conf.oqueue_size = parser.m_oqueue;
+	conf.oqueue_spin = parser.m_oqueue_spin;
+	conf.oqueue_park_timeout = parser.m_oqueue_park_timeout;
+	conf.storage_thread = parser.m_storage_thread;
+	conf.storage_cpus = parser.m_storage_cpus;
+	conf.hugepages = parser.m_hugepages;
+	conf.numa = parser.m_numa;
+	conf.idle_modes = parser.m_idle;
+	if (parser.m_iblock) {
+		conf.iblock_size = parser.m_iblock;
+	} else {
+		conf.iblock_size = conf.storage_thread ? DEFAULT_IBLOCK_SIZE : parser.m_iqueue;
+	}
 	conf.fps = parser.m_fps;
 	conf.pkt_bufsize = parser.m_pkt_bufsize;
 	conf.max_pkts = parser.m_max_pkts;
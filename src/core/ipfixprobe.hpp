@@ -42,6 +42,7 @@
 
 #include <appFs.hpp>
 #include <ipfixprobe/inputPlugin.hpp>
+#include <ipfixprobe/memory.hpp>
 #include <ipfixprobe/options.hpp>
 #include <ipfixprobe/outputPlugin.hpp>
 #include <ipfixprobe/packet.hpp>
@@ -55,6 +56,7 @@
 namespace ipxp {
 
 extern const uint32_t DEFAULT_IQUEUE_SIZE;
+extern const uint32_t DEFAULT_IBLOCK_SIZE;
 extern const uint32_t DEFAULT_OQUEUE_SIZE;
 extern const uint32_t DEFAULT_FPS;
 
@@ -84,7 +86,10 @@ public:
 	std::string m_appfs_mount_point;
 	bool m_daemon;
 	uint32_t m_iqueue;
+	uint32_t m_iblock;
 	uint32_t m_oqueue;
+	uint32_t m_oqueue_spin;
+	uint32_t m_oqueue_park_timeout;
 	uint32_t m_fps;
 	uint32_t m_pkt_bufsize;
 	uint32_t m_max_pkts;
@@ -92,6 +97,11 @@ public:
 	std::string m_help_str;
 	bool m_version;
 	std::vector<int> m_cpu_mask;
+	bool m_storage_thread;
+	std::vector<int> m_storage_cpus;
+	PageType m_hugepages;
+	bool m_numa;
+	std::vector<IdlePolicy::Mode> m_idle;
 	std::string m_plugins_path;
 
 	IpfixprobeOptParser()
@@ -100,13 +110,19 @@ public:
 		, m_appfs_mount_point("")
 		, m_daemon(false)
 		, m_iqueue(DEFAULT_IQUEUE_SIZE)
+		, m_iblock(0)
 		, m_oqueue(DEFAULT_OQUEUE_SIZE)
+		, m_oqueue_spin(IPX_RING_DEFAULT_SPIN_CNT)
+		, m_oqueue_park_timeout(IPX_RING_DEFAULT_PARK_TIMEOUT)
 		, m_fps(DEFAULT_FPS)
 		, m_pkt_bufsize(1600)
 		, m_max_pkts(0)
 		, m_help(false)
 		, m_help_str("")
 		, m_version(false)
+		, m_storage_thread(false)
+		, m_hugepages(PageType::DEFAULT)
+		, m_numa(false)
 		, m_plugins_path(IPXP_DEFAULT_PLUGINS_DIR)
 	{
 		m_delim = ' ';
@@ -175,11 +191,25 @@ public:
 				return true;
 			},
 			OptionFlags::RequiredArgument);
+		register_option(
+			"-b",
+			"--iblock",
+			"SIZE",
+			"Size of input queue packet block (default: input queue size, or 64 with -T)",
+			[this](const char* arg) {
+				try {
+					m_iblock = str2num<decltype(m_iblock)>(arg);
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+				return true;
+			},
+			OptionFlags::RequiredArgument);
 		register_option(
 			"-Q",
 			"--oqueue",
 			"SIZE",
-			"Size of queue between storage and output plugins",
+			"Size of queue between storage and output plugins of each input pipeline",
 			[this](const char* arg) {
 				try {
 					m_oqueue = str2num<decltype(m_oqueue)>(arg);
@@ -189,6 +219,27 @@ public:
 				return true;
 			},
 			OptionFlags::RequiredArgument);
+		register_option(
+			"-W",
+			"--oqueue-wait",
+			"SPIN[:TIMEOUT]",
+			"Waiting on empty or full output queue: number of busy-wait iterations before the "
+			"thread sleeps and maximum sleep time in milliseconds (default 1024:100)",
+			[this](const char* arg) {
+				try {
+					std::string str(arg);
+					size_t pos = str.find(':');
+					m_oqueue_spin = str2num<decltype(m_oqueue_spin)>(str.substr(0, pos));
+					if (pos != std::string::npos) {
+						m_oqueue_park_timeout
+							= str2num<decltype(m_oqueue_park_timeout)>(str.substr(pos + 1));
+					}
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+				return true;
+			},
+			OptionFlags::RequiredArgument);
 		register_option(
 			"-B",
 			"--pbuf",
@@ -301,15 +352,84 @@ public:
 					return false;
 				}
 			});
+		register_option(
+			"-T",
+			"--storage-thread",
+			"CPU_LIST",
+			"Run storage and process plugins in a separate thread per input, input queue then "
+			"holds -q packet blocks. Storage threads are optionally pinned to CPU_LIST",
+			[this](const char* arg) {
+				m_storage_thread = true;
+				if (arg == nullptr) {
+					return true;
+				}
+				try {
+					std::stringstream ss(arg);
+					std::string tmp;
+					while (std::getline(ss, tmp, ',')) {
+						m_storage_cpus.emplace_back(str2num<uint16_t>(tmp));
+					}
+					return true;
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+			},
+			OptionFlags::OptionalArgument);
+		register_option(
+			"-I",
+			"--idle",
+			"MODE",
+			"Waiting of input workers for packets: busy (poll), backoff (sleep with growing time) "
+			"or block (sleep on the input descriptor, backoff when the input has none). Given once, "
+			"it applies to all inputs, otherwise the n-th MODE applies to the n-th input",
+			[this](const char* arg) {
+				IdlePolicy::Mode mode;
+				if (!IdlePolicy::parse_mode(arg, mode)) {
+					return false;
+				}
+				m_idle.push_back(mode);
+				return true;
+			},
+			OptionFlags::RequiredArgument);
+		register_option(
+			"-H",
+			"--hugepages",
+			"TYPE",
+			"Back flow cache tables and packet blocks with hugepages: thp, 2M or 1G. Transparent "
+			"hugepages are used when the hugepage pool is exhausted",
+			[this](const char* arg) { return MemoryPolicy::parse_page_type(arg, m_hugepages); },
+			OptionFlags::RequiredArgument);
+		register_option(
+			"-N",
+			"--numa",
+			"",
+			"Bind flow cache tables and packet blocks to the NUMA node of the pipeline CPU affinity",
+			[this](const char* arg) {
+				(void) arg;
+				m_numa = true;
+				return true;
+			},
+			OptionFlags::NoArgument);
 	}
 };
 
 struct ipxp_conf_t {
 	uint32_t iqueue_size;
+	uint32_t iblock_size;
 	uint32_t oqueue_size;
+	uint32_t oqueue_spin;
+	uint32_t oqueue_park_timeout;
 	uint32_t worker_cnt;
 	uint32_t fps;
 	uint32_t max_pkts;
+	bool storage_thread;
+	std::vector<int> storage_cpus;
+	PageType hugepages;
+	bool numa;
+	std::vector<IdlePolicy::Mode> idle_modes;
+
+	/** Declared before plugins, extensions of flows in the storage plugins are freed to them. */
+	std::vector<std::unique_ptr<RecordExtPool>> ext_pools;
 
 	std::vector<std::shared_ptr<InputPlugin>> inputPlugins;
 	std::vector<std::shared_ptr<StoragePlugin>> storagePlugins;
@@ -348,10 +468,16 @@ struct ipxp_conf_t {
 
 	ipxp_conf_t()
 		: iqueue_size(DEFAULT_IQUEUE_SIZE)
+		, iblock_size(DEFAULT_IQUEUE_SIZE)
 		, oqueue_size(DEFAULT_OQUEUE_SIZE)
+		, oqueue_spin(IPX_RING_DEFAULT_SPIN_CNT)
+		, oqueue_park_timeout(IPX_RING_DEFAULT_PARK_TIMEOUT)
 		, worker_cnt(0)
 		, fps(0)
 		, max_pkts(0)
+		, storage_thread(false)
+		, hugepages(PageType::DEFAULT)
+		, numa(false)
 		, pluginManager(false)
 		, pkt_bufsize(1600)
 		, blocks_cnt(0)
@@ -372,12 +498,22 @@ struct ipxp_conf_t {
 			}
 			delete it.input.thread;
 			delete it.input.promise;
+			if (it.storage.thread != nullptr) {
+				if (it.storage.thread->joinable()) {
+					it.storage.thread->join();
+				}
+				delete it.storage.thread;
+				delete it.storage.promise;
+				delete it.storage.queue;
+			}
 		}
 
 		for (auto& it : pipelines) {
 			for (auto& itp : it.storage.plugins) {
 				delete itp;
 			}
+			delete it.memory;
+			delete it.idle;
 		}
 
 		terminate_export = 1;
@@ -387,7 +523,9 @@ struct ipxp_conf_t {
 			}
 			delete it.thread;
 			delete it.promise;
-			ipx_ring_destroy(it.queue);
+			for (auto queue : it.queues) {
+				ipx_ring_destroy(queue);
+			}
 		}
 
 		for (auto& it : input_stats) {
@@ -0,0 +1,216 @@
+/**
+ * @file
+ * @brief Hugepage and NUMA aware allocation of large pipeline buffers
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <ipfixprobe/memory.hpp>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace ipxp {
+
+static const size_t HUGE_2M_SIZE = 1UL << 21;
+static const size_t HUGE_1G_SIZE = 1UL << 30;
+
+static thread_local MemoryPolicy* current_policy = nullptr;
+
+static size_t align_up(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+/**
+ * \brief Map hugetlbfs backed anonymous memory.
+ * \return Mapped memory or nullptr when the hugepage pool can't satisfy the request.
+ */
+static void* map_hugetlb(size_t size, size_t page_size)
+{
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+		| (page_size == HUGE_1G_SIZE ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+	void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+/**
+ * \brief Map regular anonymous memory, aligned to the size of transparent hugepage when it
+ * can hold one.
+ */
+static void* map_aligned(size_t size)
+{
+	if (size < HUGE_2M_SIZE) {
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return ptr == MAP_FAILED ? nullptr : ptr;
+	}
+
+	const size_t map_size = size + HUGE_2M_SIZE;
+	void* ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return nullptr;
+	}
+
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr);
+	const uintptr_t aligned = align_up(begin, HUGE_2M_SIZE);
+	if (aligned != begin) {
+		munmap(ptr, aligned - begin);
+	}
+	if (begin + map_size != aligned + size) {
+		munmap(reinterpret_cast<void*>(aligned + size), begin + map_size - aligned - size);
+	}
+	return reinterpret_cast<void*>(aligned);
+}
+
+static bool bind_numa_node(void* ptr, size_t size, int node)
+{
+	const size_t bits = sizeof(unsigned long) * 8;
+	std::vector<unsigned long> mask(node / bits + 1, 0);
+	mask[node / bits] |= 1UL << (node % bits);
+
+	// Preferred, memory can still be allocated on other nodes when the node is full
+	return syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1, 0)
+		== 0;
+}
+
+MemoryPolicy::MemoryPolicy(PageType pages, int numa_node)
+	: m_pages(pages)
+	, m_numa_node(numa_node)
+	, m_allocated()
+	, m_numa_bound(0)
+{
+}
+
+MemoryPolicy::Region MemoryPolicy::allocate(size_t size)
+{
+	Region region = {nullptr, 0, PageType::DEFAULT};
+
+	// Only tables of at least one hugepage are worth a hugetlb mapping of their own, smaller
+	// buffers would waste the rest of the page and drain the pool
+	const size_t page_size = m_pages == PageType::HUGE_1G ? HUGE_1G_SIZE : HUGE_2M_SIZE;
+	if ((m_pages == PageType::HUGE_2M || m_pages == PageType::HUGE_1G) && size >= page_size) {
+		region.size = align_up(size, page_size);
+		region.ptr = map_hugetlb(region.size, page_size);
+		region.pages = m_pages;
+	}
+	if (region.ptr == nullptr) {
+		region.size = align_up(size, sysconf(_SC_PAGESIZE));
+		region.ptr = map_aligned(region.size);
+		region.pages = PageType::DEFAULT;
+		if (region.ptr == nullptr) {
+			throw std::bad_alloc();
+		}
+		if (m_pages != PageType::DEFAULT && region.size >= HUGE_2M_SIZE
+			&& madvise(region.ptr, region.size, MADV_HUGEPAGE) == 0) {
+			region.pages = PageType::TRANSPARENT;
+		}
+	}
+
+	// Pages are not touched yet, binding decides where they will be faulted in
+	if (m_numa_node >= 0 && bind_numa_node(region.ptr, region.size, m_numa_node)) {
+		m_numa_bound += region.size;
+	}
+	m_allocated[static_cast<size_t>(region.pages)] += region.size;
+	return region;
+}
+
+void MemoryPolicy::free(const Region& region)
+{
+	if (region.ptr != nullptr) {
+		munmap(region.ptr, region.size);
+	}
+}
+
+bool MemoryPolicy::parse_page_type(const std::string& str, PageType& pages)
+{
+	if (str == "thp") {
+		pages = PageType::TRANSPARENT;
+	} else if (str == "2M") {
+		pages = PageType::HUGE_2M;
+	} else if (str == "1G") {
+		pages = PageType::HUGE_1G;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char* MemoryPolicy::page_type_name(PageType pages)
+{
+	switch (pages) {
+	case PageType::TRANSPARENT:
+		return "thp";
+	case PageType::HUGE_2M:
+		return "2M";
+	case PageType::HUGE_1G:
+		return "1G";
+	default:
+		return "default";
+	}
+}
+
+static int get_cpu_numa_node(int cpu)
+{
+	const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	DIR* dir = opendir(path.c_str());
+	if (dir == nullptr) {
+		return -1;
+	}
+
+	int node = -1;
+	while (struct dirent* entry = readdir(dir)) {
+		const std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(0, 4, "node") == 0
+			&& name.find_first_not_of("0123456789", 4) == std::string::npos) {
+			node = std::stoi(name.substr(4));
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+int MemoryPolicy::get_numa_node(const std::vector<int>& cpus)
+{
+	int node = -1;
+	for (auto cpu : cpus) {
+		const int cpu_node = get_cpu_numa_node(cpu);
+		if (cpu_node < 0 || (node >= 0 && cpu_node != node)) {
+			return -1;
+		}
+		node = cpu_node;
+	}
+	return node;
+}
+
+void MemoryPolicy::set_current(MemoryPolicy* policy)
+{
+	current_policy = policy;
+}
+
+MemoryPolicy* MemoryPolicy::get_current()
+{
+	return current_policy;
+}
+
+} // namespace ipxp
@@ -0,0 +1,156 @@
+/**
+ * @file
+ * @brief Single producer single consumer ring of recycled packet blocks
+ *
+ * The ring connects the input (parser) thread and the storage (flow cache) thread of one
+ * pipeline. All packet blocks are allocated once and recycled: the producer fills the block
+ * in the slot at the ring head, the consumer processes the block at the ring tail and hands the
+ * slot back just by moving the tail forward.
+ *
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <ipfixprobe/packet.hpp>
+
+namespace ipxp {
+
+class PacketBlockRing {
+public:
+	/**
+	 * @brief One recycled element of the ring.
+	 *
+	 * Input plugins fill packets with pointers into their own receive buffers which are only
+	 * valid until the next call of InputPlugin::get(). The slot therefore owns a data buffer
+	 * of `pkt_buffer_size` bytes per packet where the packet data are copied before the block
+	 * is handed over to the consumer.
+	 */
+	struct Slot {
+		PacketBlock block;
+		std::unique_ptr<uint8_t[]> data;
+		size_t pkt_buffer_size;
+
+		/// Input plugin counters at the time the block was pushed.
+		uint64_t seen;
+		uint64_t parsed;
+		uint64_t dropped;
+
+		Slot(size_t block_size, size_t buffer_size)
+			: block(block_size)
+			, data(new uint8_t[block_size * buffer_size])
+			, pkt_buffer_size(buffer_size)
+			, seen(0)
+			, parsed(0)
+			, dropped(0)
+		{
+		}
+	};
+
+	/**
+	 * @brief Constructor.
+	 * @param size Number of packet blocks in the ring.
+	 * @param block_size Number of packets in one block.
+	 * @param pkt_buffer_size Size of data buffer for one packet.
+	 */
+	PacketBlockRing(size_t size, size_t block_size, size_t pkt_buffer_size)
+		: m_head(0)
+		, m_tail(0)
+		, m_closed(false)
+		, m_aborted(false)
+	{
+		m_slots.reserve(size);
+		for (size_t i = 0; i < size; i++) {
+			m_slots.emplace_back(std::make_unique<Slot>(block_size, pkt_buffer_size));
+		}
+	}
+
+	/**
+	 * @brief Get a free slot at the ring head (producer only).
+	 * @return Pointer to the slot or nullptr when the ring is full.
+	 */
+	Slot* begin_push()
+	{
+		const uint64_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == m_slots.size()) {
+			return nullptr;
+		}
+		return m_slots[head % m_slots.size()].get();
+	}
+
+	/**
+	 * @brief Publish the slot returned by begin_push() to the consumer (producer only).
+	 */
+	void commit_push() { m_head.fetch_add(1, std::memory_order_release); }
+
+	/**
+	 * @brief Get the oldest filled slot (consumer only).
+	 * @return Pointer to the slot or nullptr when the ring is empty.
+	 */
+	Slot* begin_pop()
+	{
+		const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		if (m_head.load(std::memory_order_acquire) == tail) {
+			return nullptr;
+		}
+		return m_slots[tail % m_slots.size()].get();
+	}
+
+	/**
+	 * @brief Return the slot returned by begin_pop() back to the producer (consumer only).
+	 */
+	void commit_pop() { m_tail.fetch_add(1, std::memory_order_release); }
+
+	/**
+	 * @brief Tell the consumer that no more blocks will be pushed (producer only).
+	 */
+	void close() { m_closed.store(true, std::memory_order_release); }
+
+	/**
+	 * @brief Check whether the producer has finished.
+	 */
+	bool is_closed() const { return m_closed.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Tell the producer that no more blocks will be consumed (consumer only).
+	 */
+	void abort() { m_aborted.store(true, std::memory_order_release); }
+
+	/**
+	 * @brief Check whether the consumer has given up.
+	 */
+	bool is_aborted() const { return m_aborted.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Number of filled blocks waiting for the consumer.
+	 */
+	size_t count() const
+	{
+		return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Total number of blocks in the ring.
+	 */
+	size_t size() const { return m_slots.size(); }
+
+private:
+	std::vector<std::unique_ptr<Slot>> m_slots;
+
+	alignas(64) std::atomic<uint64_t> m_head;
+	alignas(64) std::atomic<uint64_t> m_tail;
+	alignas(64) std::atomic<bool> m_closed;
+	std::atomic<bool> m_aborted;
+};
+
+} // namespace ipxp
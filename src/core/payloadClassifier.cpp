@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Shared classification of packet payloads to application protocols
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <ipfixprobe/payloadClassifier.hpp>
+#include <ipfixprobe/plugin.hpp>
+
+namespace ipxp {
+
+/**
+ * \brief Load up to 8 bytes of payload as a zero padded word.
+ */
+static inline uint64_t load_prefix(const uint8_t* data, size_t len)
+{
+	uint64_t word = 0;
+	std::memcpy(&word, data, std::min(len, sizeof(word)));
+	return word;
+}
+
+PayloadClassifier::PayloadClassifier()
+	: m_plugins(0)
+	, m_request_line_plugins(0)
+	, m_first_byte()
+	, m_signatures()
+	, m_request_lines()
+{
+}
+
+void PayloadClassifier::add(
+	uint64_t plugin,
+	const std::vector<std::string>& signatures,
+	const std::string& request_line)
+{
+	for (const auto& signature : signatures) {
+		if (signature.empty() || signature.size() > MAX_SIGNATURE_LEN) {
+			throw PluginError(
+				"payload signature must have 1 to " + std::to_string(MAX_SIGNATURE_LEN)
+				+ " bytes");
+		}
+
+		const auto* data = reinterpret_cast<const uint8_t*>(signature.data());
+		const uint64_t ones = ~static_cast<uint64_t>(0);
+		Signature sig;
+		sig.plugin = plugin;
+		sig.value = load_prefix(data, signature.size());
+		sig.mask = load_prefix(reinterpret_cast<const uint8_t*>(&ones), signature.size());
+		sig.len = signature.size();
+		m_signatures[data[0]].push_back(sig);
+		m_first_byte[data[0]] |= plugin;
+		m_plugins |= plugin;
+	}
+
+	if (!request_line.empty()) {
+		m_request_lines.push_back({plugin, request_line});
+		m_request_line_plugins |= plugin;
+		m_plugins |= plugin;
+	}
+}
+
+uint64_t PayloadClassifier::classify(const uint8_t* payload, size_t len, uint64_t candidates) const
+{
+	if (len == 0) {
+		return 0;
+	}
+
+	uint64_t matched = 0;
+	if (m_first_byte[payload[0]] & candidates) {
+		const uint64_t prefix = load_prefix(payload, len);
+		for (const auto& sig : m_signatures[payload[0]]) {
+			if ((candidates & sig.plugin) && sig.len <= len && (prefix & sig.mask) == sig.value) {
+				matched |= sig.plugin;
+			}
+		}
+	}
+
+	if (m_request_line_plugins & candidates & ~matched) {
+		matched |= match_request_line(payload, len, candidates & ~matched);
+	}
+	return matched;
+}
+
+uint64_t
+PayloadClassifier::match_request_line(const uint8_t* payload, size_t len, uint64_t candidates) const
+{
+	// METHOD URI PROTOCOL/VERSION
+	const uint8_t* end = payload + len;
+	const size_t method_len = len < MAX_METHOD_LEN ? len : MAX_METHOD_LEN;
+	const auto* method_end = static_cast<const uint8_t*>(std::memchr(payload, ' ', method_len));
+	if (method_end == nullptr) {
+		return 0;
+	}
+	const auto* uri_end
+		= static_cast<const uint8_t*>(std::memchr(method_end + 1, ' ', end - method_end - 1));
+	if (uri_end == nullptr) {
+		return 0;
+	}
+
+	const uint8_t* protocol = uri_end + 1;
+	uint64_t matched = 0;
+	for (const auto& line : m_request_lines) {
+		const size_t size = line.protocol.size();
+		if ((candidates & line.plugin) && static_cast<size_t>(end - protocol) >= size
+			&& std::memcmp(protocol, line.protocol.data(), size) == 0) {
+			matched |= line.plugin;
+		}
+	}
+	return matched;
+}
+
+} // namespace ipxp
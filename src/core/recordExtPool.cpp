@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief Fixed-size pools of flow record extensions
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include <ipfixprobe/recordExtPool.hpp>
+
+namespace ipxp {
+
+static thread_local RecordExtPool* current_pool = nullptr;
+
+struct FreeNode {
+	FreeNode* next;
+};
+
+/**
+ * \brief Header preceding every object, identifies the size class the object belongs to.
+ */
+struct alignas(RecordExtPool::SIZE_ALIGN) ObjectHeader {
+	void* cls; /**< Size class, nullptr for heap allocated objects */
+};
+
+struct RecordExtPool::SizeClass {
+	RecordExtPool* pool;
+	size_t size; /**< Block size including the header */
+	FreeNode* free_list; /**< Owner thread only */
+	uint8_t* slab_pos; /**< Not yet used part of the last slab */
+	uint8_t* slab_end;
+	std::atomic<FreeNode*> remote_free; /**< Blocks freed by other threads */
+	std::atomic<uint64_t> remote_cnt; /**< Number of blocks in the remote free list */
+	/* Written only by the owner thread, read by telemetry */
+	std::atomic<uint64_t> used;
+	std::atomic<uint64_t> capacity;
+};
+
+static inline void add(std::atomic<uint64_t>& counter, int64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+RecordExtPool::RecordExtPool(MemoryPolicy* memory)
+	: m_default_memory()
+	, m_memory(memory != nullptr ? memory : &m_default_memory)
+	, m_arenas()
+	, m_arena_pos(nullptr)
+	, m_arena_end(nullptr)
+	, m_memory_size(0)
+{
+	for (auto& cls : m_classes) {
+		cls.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+RecordExtPool::~RecordExtPool()
+{
+	for (auto& cls : m_classes) {
+		delete cls.load(std::memory_order_relaxed);
+	}
+	for (const auto& arena : m_arenas) {
+		MemoryPolicy::free(arena);
+	}
+}
+
+RecordExtPool::SizeClass* RecordExtPool::get_class(size_t idx)
+{
+	SizeClass* cls = m_classes[idx].load(std::memory_order_relaxed);
+	if (cls != nullptr) {
+		return cls;
+	}
+
+	cls = new SizeClass();
+	cls->pool = this;
+	cls->size = sizeof(ObjectHeader) + idx * SIZE_ALIGN;
+	cls->free_list = nullptr;
+	cls->slab_pos = nullptr;
+	cls->slab_end = nullptr;
+	cls->remote_free.store(nullptr, std::memory_order_relaxed);
+	cls->remote_cnt.store(0, std::memory_order_relaxed);
+	cls->used.store(0, std::memory_order_relaxed);
+	cls->capacity.store(0, std::memory_order_relaxed);
+	m_classes[idx].store(cls, std::memory_order_release);
+	return cls;
+}
+
+void RecordExtPool::add_slab(SizeClass* cls)
+{
+	size_t slab_size = SLAB_SIZE;
+	if (slab_size < cls->size * 16) {
+		slab_size = (cls->size * 16 + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE;
+	}
+
+	if (static_cast<size_t>(m_arena_end - m_arena_pos) < slab_size) {
+		const size_t arena_size = slab_size > ARENA_SIZE ? slab_size : ARENA_SIZE;
+		MemoryPolicy::Region arena = m_memory->allocate(arena_size);
+		m_arenas.push_back(arena);
+		m_arena_pos = static_cast<uint8_t*>(arena.ptr);
+		m_arena_end = m_arena_pos + arena.size;
+		add(m_memory_size, arena.size);
+	}
+
+	cls->slab_pos = m_arena_pos;
+	cls->slab_end = m_arena_pos + slab_size / cls->size * cls->size;
+	m_arena_pos += slab_size;
+	add(cls->capacity, slab_size / cls->size);
+}
+
+void* RecordExtPool::alloc(size_t size)
+{
+	SizeClass* cls = get_class((size + SIZE_ALIGN - 1) / SIZE_ALIGN);
+
+	FreeNode* block = cls->free_list;
+	if (block == nullptr) {
+		// Reclaim blocks freed by other threads
+		block = cls->remote_free.exchange(nullptr, std::memory_order_acquire);
+		uint64_t reclaimed = 0;
+		for (FreeNode* node = block; node != nullptr; node = node->next) {
+			reclaimed++;
+		}
+		cls->remote_cnt.fetch_sub(reclaimed, std::memory_order_relaxed);
+		add(cls->used, -static_cast<int64_t>(reclaimed));
+	}
+	if (block != nullptr) {
+		cls->free_list = block->next;
+	} else {
+		if (cls->slab_pos == cls->slab_end) {
+			add_slab(cls);
+		}
+		block = reinterpret_cast<FreeNode*>(cls->slab_pos);
+		cls->slab_pos += cls->size;
+	}
+	add(cls->used, 1);
+
+	ObjectHeader* header = reinterpret_cast<ObjectHeader*>(block);
+	header->cls = cls;
+	return header + 1;
+}
+
+void* RecordExtPool::allocate(size_t size)
+{
+	if (current_pool != nullptr && size <= MAX_SIZE) {
+		return current_pool->alloc(size);
+	}
+
+	ObjectHeader* header = static_cast<ObjectHeader*>(std::malloc(sizeof(ObjectHeader) + size));
+	if (header == nullptr) {
+		throw std::bad_alloc();
+	}
+	header->cls = nullptr;
+	return header + 1;
+}
+
+void RecordExtPool::deallocate(void* ptr)
+{
+	if (ptr == nullptr) {
+		return;
+	}
+
+	ObjectHeader* header = static_cast<ObjectHeader*>(ptr) - 1;
+	SizeClass* cls = static_cast<SizeClass*>(header->cls);
+	if (cls == nullptr) {
+		std::free(header);
+		return;
+	}
+
+	FreeNode* block = reinterpret_cast<FreeNode*>(header);
+	if (cls->pool == current_pool) {
+		block->next = cls->free_list;
+		cls->free_list = block;
+		add(cls->used, -1);
+		return;
+	}
+
+	// Object of other thread, the owner reclaims it later
+	cls->remote_cnt.fetch_add(1, std::memory_order_relaxed);
+	FreeNode* head = cls->remote_free.load(std::memory_order_relaxed);
+	do {
+		block->next = head;
+	} while (!cls->remote_free.compare_exchange_weak(
+		head,
+		block,
+		std::memory_order_release,
+		std::memory_order_relaxed));
+}
+
+void RecordExtPool::set_current(RecordExtPool* pool)
+{
+	current_pool = pool;
+}
+
+RecordExtPool* RecordExtPool::get_current()
+{
+	return current_pool;
+}
+
+std::vector<RecordExtPool::ClassStats> RecordExtPool::get_stats() const
+{
+	std::vector<ClassStats> stats;
+	for (const auto& it : m_classes) {
+		const SizeClass* cls = it.load(std::memory_order_acquire);
+		if (cls == nullptr) {
+			continue;
+		}
+		// Blocks freed by other threads are not reclaimed by the owner yet
+		const uint64_t used = cls->used.load(std::memory_order_relaxed);
+		const uint64_t remote = cls->remote_cnt.load(std::memory_order_relaxed);
+		stats.push_back(
+			{cls->size - sizeof(ObjectHeader),
+			 used > remote ? used - remote : 0,
+			 cls->capacity.load(std::memory_order_relaxed)});
+	}
+	return stats;
+}
+
+} // namespace ipxp
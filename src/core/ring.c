@@ -25,11 +25,16 @@
  */
 
 #define _ISOC11_SOURCE
+#define _GNU_SOURCE // syscall
 #include <stdlib.h> // aligned_malloc
 // #include <unistd.h>
 #include <ipfixprobe/ring.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
 
 // START TODO: move into header files
 #include <assert.h>
@@ -87,7 +92,7 @@ struct ring_reader {
 	 */
 	uint32_t div_block;
 
-	/** Previously read messages - only 0 or 1 */
+	/** Number of previously read messages (still owned by the reader) */
 	uint32_t last;
 };
 
@@ -141,11 +146,14 @@ struct ring_sync {
 	uint32_t read_idx;
 	/** \brief Synchronization mutex (MUST be always used to access data structures here)    */
 	pthread_mutex_t mutex;
+};
 
-	/** \brief Reader condition variable (empty buffer) */
-	pthread_cond_t cond_reader;
-	/** \brief Writer condition variable (full buffer)  */
-	pthread_cond_t cond_writer;
+/** \brief Parking place of a waiting reader or writer */
+struct ring_waiter {
+	/** \brief Futex word, incremented on every wake up */
+	uint32_t seq;
+	/** \brief Non-zero when the waiting side is (going to be) parked on the futex */
+	uint32_t parked;
 };
 
 /** \brief Ring buffer */
@@ -158,6 +166,16 @@ struct ipx_ring {
 	pthread_spinlock_t writer_lock __ipx_cache_aligned;
 	/** Synchronization structure (cache-aligned)       */
 	struct ring_sync sync __ipx_cache_aligned;
+	/** Parking place of the reader (cache-aligned)     */
+	struct ring_waiter reader_local __ipx_cache_aligned;
+	/** Parking place of writers (cache-aligned)        */
+	struct ring_waiter writer_wait __ipx_cache_aligned;
+	/** Reader parking place, can be shared by more rings */
+	struct ring_waiter* reader_wait __ipx_cache_aligned;
+	/** Number of busy-wait iterations before parking   */
+	uint32_t spin_cnt;
+	/** Maximum time of one park in milliseconds        */
+	uint32_t park_timeout;
 	/** Multiple writers mode                           */
 	bool mw_mode;
 	/** Ring data (array of pointers)                   */
@@ -188,44 +206,12 @@ ipx_ring_t* ipx_ring_init(uint32_t size, bool mw_mode)
 		goto exit_B;
 	}
 
-	// Initialize sync mutex and conditional variables
+	// Initialize sync mutex
 	if ((rc = pthread_mutex_init(&ring->sync.mutex, NULL)) != 0) {
 		IPX_ERROR(module, "pthread_mutex_init() failed! (%s:%d, err: %d)", __FILE__, __LINE__, rc);
 		goto exit_C;
 	}
 
-	pthread_condattr_t cond_attr;
-	if ((rc = pthread_condattr_init(&cond_attr)) != 0) {
-		IPX_ERROR(
-			module,
-			"pthread_condattr_init() failed! (%s:%d, err: %d)",
-			__FILE__,
-			__LINE__,
-			rc);
-		goto exit_D;
-	}
-
-	if ((rc = pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC)) != 0) {
-		IPX_ERROR(
-			module,
-			"pthread_condattr_setclock() failed! (%s:%d, err: %d)",
-			__FILE__,
-			__LINE__,
-			rc);
-		goto exit_E;
-	}
-
-	if ((rc = pthread_cond_init(&ring->sync.cond_reader, &cond_attr)) != 0) {
-		IPX_ERROR(module, "pthread_cond_init() failed! (%s:%d, err: %d)", __FILE__, __LINE__, rc);
-		goto exit_E;
-	}
-
-	if ((rc = pthread_cond_init(&ring->sync.cond_writer, &cond_attr)) != 0) {
-		IPX_ERROR(module, "pthread_cond_init() failed! (%s:%d, err: %d)", __FILE__, __LINE__, rc);
-		goto exit_F;
-	}
-	pthread_condattr_destroy(&cond_attr);
-
 	// Initialize ring variables
 	ring->reader.size = size;
 	ring->reader.div_block = size / 8;
@@ -245,16 +231,18 @@ ipx_ring_t* ipx_ring_init(uint32_t size, bool mw_mode)
 	ring->sync.read_idx = 0;
 	ring->sync.write_idx = size;
 
+	ring->reader_local.seq = 0;
+	ring->reader_local.parked = 0;
+	ring->writer_wait.seq = 0;
+	ring->writer_wait.parked = 0;
+	ring->reader_wait = &ring->reader_local;
+	ring->spin_cnt = IPX_RING_DEFAULT_SPIN_CNT;
+	ring->park_timeout = IPX_RING_DEFAULT_PARK_TIMEOUT;
+
 	ring->mw_mode = mw_mode;
 	return ring;
 
 	// In case failure
-exit_F:
-	pthread_cond_destroy(&ring->sync.cond_reader);
-exit_E:
-	pthread_condattr_destroy(&cond_attr);
-exit_D:
-	pthread_mutex_destroy(&ring->sync.mutex);
 exit_C:
 	pthread_spin_destroy(&ring->writer_lock);
 exit_B:
@@ -276,35 +264,102 @@ void ipx_ring_destroy(ipx_ring_t* ring)
 			cnt);
 	}
 
-	pthread_cond_destroy(&ring->sync.cond_writer);
-	pthread_cond_destroy(&ring->sync.cond_reader);
 	pthread_mutex_destroy(&ring->sync.mutex);
 	pthread_spin_destroy(&ring->writer_lock);
 	free(ring->data);
 	free(ring);
 }
 
+/** \brief Hint the CPU that the thread is busy-waiting */
+static inline void ring_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/** \brief Check whether the reader of all the rings has any message to read */
+static bool ring_reader_ready(ipx_ring_t* const* rings, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; i++) {
+		const struct ring_reader* reader = &rings[i]->reader;
+		if (__atomic_load_n(&rings[i]->writer.write_idx, __ATOMIC_SEQ_CST) - reader->read_idx
+			> reader->last) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/** \brief Check whether the reader released any space for a writer */
+static bool ring_writer_ready(ipx_ring_t* const* rings, size_t cnt)
+{
+	(void) cnt;
+	return __atomic_load_n(&rings[0]->sync.write_idx, __ATOMIC_SEQ_CST)
+		- rings[0]->writer.write_idx
+		> 0;
+}
+
 /**
- * \brief Wrapper around condition wait
- * \param[in] cond  Condition variable
- * \param[in] mutex Locked mutex
- * \param[in] msec  Number of milliseconds to wait
- * \return Same as the function pthread_cond_timedwait
+ * \brief Wait until the condition holds
+ *
+ * At first, the condition is polled for \p spin_cnt iterations. Then the thread is parked on
+ * the futex of the \p waiter until the other side wakes it up or \p park_timeout expires.
+ * \param[in] waiter       Parking place
+ * \param[in] spin_cnt     Number of busy-wait iterations
+ * \param[in] park_timeout Maximum park time in milliseconds
+ * \param[in] ready        Condition to wait for
+ * \param[in] rings        Ring buffers passed to the condition
+ * \param[in] cnt          Number of ring buffers
+ * \return True if the condition holds, false after timeout
  */
-static inline int ring_cond_timedwait(
-	pthread_cond_t* __restrict__ cond,
-	pthread_mutex_t* __restrict__ mutex,
-	long msec)
+static bool ring_wait(
+	struct ring_waiter* waiter,
+	uint32_t spin_cnt,
+	uint32_t park_timeout,
+	bool (*ready)(ipx_ring_t* const*, size_t),
+	ipx_ring_t* const* rings,
+	size_t cnt)
 {
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	ts.tv_nsec += msec * 1000000;
-	if (ts.tv_nsec >= 1000000000) {
-		ts.tv_nsec %= 1000000000;
-		ts.tv_sec += 1;
+	for (uint32_t i = 0; i < spin_cnt; i++) {
+		if (ready(rings, cnt)) {
+			return true;
+		}
+		ring_cpu_relax();
+	}
+
+	// The other side checks the flag after its update, so either it sees the flag or we see
+	// the update. Wake ups between reading of the sequence and parking are not lost.
+	uint32_t seq = __atomic_load_n(&waiter->seq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&waiter->parked, 1, __ATOMIC_SEQ_CST);
+	bool ret = ready(rings, cnt);
+	if (!ret) {
+		struct timespec ts = {park_timeout / 1000, (park_timeout % 1000) * 1000000L};
+		syscall(SYS_futex, &waiter->seq, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+		ret = ready(rings, cnt);
 	}
+	__atomic_store_n(&waiter->parked, 0, __ATOMIC_RELAXED);
+	return ret;
+}
 
-	return pthread_cond_timedwait(cond, mutex, &ts);
+/**
+ * \brief Wake up parked side of the ring
+ * \note Only the flag is read when nobody is parked, no system call is performed.
+ * \param[in] waiter Parking place
+ */
+static inline void ring_wake(struct ring_waiter* waiter)
+{
+	if (__atomic_load_n(&waiter->parked, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+	if (__atomic_exchange_n(&waiter->parked, 0, __ATOMIC_SEQ_CST) == 0) {
+		// Somebody else is already waking it up
+		return;
+	}
+	__atomic_add_fetch(&waiter->seq, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &waiter->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
 }
 
 /**
@@ -327,16 +382,18 @@ static inline ipx_msg_t** ipx_ring_begin(ipx_ring_t* ring)
 	}
 
 	// Get an empty space -> reader-writer synchronization
-	pthread_mutex_lock(&ring->sync.mutex);
-	ring->writer.exchange_idx = ring->sync.write_idx;
+	ring->writer.exchange_idx = __atomic_load_n(&ring->sync.write_idx, __ATOMIC_SEQ_CST);
 	while (ring->writer.exchange_idx - ring->writer.write_idx == 0) {
-		// After sync the buffer is still full, try again later
-		pthread_cond_signal(&ring->sync.cond_reader);
-		ring_cond_timedwait(&ring->sync.cond_writer, &ring->sync.mutex, 10);
-		ring->writer.exchange_idx = ring->sync.write_idx;
+		// After sync the buffer is still full, wait for the reader
+		ring_wait(
+			&ring->writer_wait,
+			ring->spin_cnt,
+			ring->park_timeout,
+			ring_writer_ready,
+			&ring,
+			1);
+		ring->writer.exchange_idx = __atomic_load_n(&ring->sync.write_idx, __ATOMIC_SEQ_CST);
 	}
-	pthread_cond_signal(&ring->sync.cond_reader);
-	pthread_mutex_unlock(&ring->sync.mutex);
 
 	assert(ring->writer.exchange_idx - ring->writer.write_idx > 0);
 	return msg;
@@ -358,6 +415,7 @@ static inline void ipx_ring_commit(ipx_ring_t* ring)
 
 	// Atomic update of writer index (Note: new_idx will be the same as writer.write_idx)
 	new_idx += __sync_fetch_and_add(&ring->writer.write_idx, new_idx);
+	ring_wake(ring->reader_wait);
 
 	// Sync positions with a reader, if necessary
 	if (new_idx - ring->writer.write_commit_idx >= ring->writer.div_block) {
@@ -365,7 +423,6 @@ static inline void ipx_ring_commit(ipx_ring_t* ring)
 		ring->sync.read_idx = new_idx;
 		ring->writer.exchange_idx = ring->sync.write_idx;
 		ring->writer.write_commit_idx = new_idx;
-		pthread_cond_signal(&ring->sync.cond_reader);
 		pthread_mutex_unlock(&ring->sync.mutex);
 	}
 }
@@ -387,67 +444,179 @@ void ipx_ring_push(ipx_ring_t* ring, ipx_msg_t* msg)
 	}
 }
 
-ipx_msg_t* ipx_ring_pop(ipx_ring_t* ring)
+/**
+ * \brief Release previously read message and prepare the next one
+ *
+ * \param[in] ring Ring buffer
+ * \return Pointer to the place of the next message (valid only if the reader owns it)
+ */
+static inline ipx_msg_t** ipx_ring_read_begin(ipx_ring_t* ring)
 {
 	// Consider previous memory block as processed
 	ring->reader.data_idx += ring->reader.last;
 	ring->reader.read_idx += ring->reader.last;
 	ring->reader.last = 0;
 
-	if (ring->reader.size == ring->reader.data_idx) {
+	if (ring->reader.data_idx >= ring->reader.size) {
 		// The end of the ring buffer has been reached -> skip to the beginning
-		ring->reader.data_idx = 0;
+		ring->reader.data_idx -= ring->reader.size;
 	}
 
-	// Prepare the next pointer to read
-	ipx_msg_t** msg = &ring->data[ring->reader.data_idx];
-
 	// Sync positions with writers, if necessary
 	if (ring->reader.read_idx - ring->reader.read_commit_idx >= ring->reader.div_block) {
 		pthread_mutex_lock(&ring->sync.mutex);
-		ring->sync.write_idx += ring->reader.read_idx - ring->reader.read_commit_idx;
+		__atomic_store_n(
+			&ring->sync.write_idx,
+			ring->sync.write_idx + ring->reader.read_idx - ring->reader.read_commit_idx,
+			__ATOMIC_SEQ_CST);
 		ring->reader.exchange_idx = ring->sync.read_idx;
 		ring->reader.read_commit_idx = ring->reader.read_idx;
-		pthread_cond_signal(&ring->sync.cond_writer);
 		pthread_mutex_unlock(&ring->sync.mutex);
+		ring_wake(&ring->writer_wait);
 	}
 
-	if (ring->reader.exchange_idx - ring->reader.read_idx > 0) {
-		// Ok, the reader owns this part of the buffer
-		// TODO: prefetch
-		ring->reader.last = 1;
-		return *msg; // Now, we can dereference the pointer
+	return &ring->data[ring->reader.data_idx];
+}
+
+/**
+ * \brief Take all messages committed by writers, even if they didn't perform sync yet
+ * \param[in] ring Ring buffer
+ */
+static inline void ipx_ring_read_steal(ipx_ring_t* ring)
+{
+	pthread_mutex_lock(&ring->sync.mutex);
+	ring->sync.read_idx = ring->reader.exchange_idx
+		= __sync_fetch_and_add(&ring->writer.write_idx, 0);
+	pthread_mutex_unlock(&ring->sync.mutex);
+}
+
+ipx_msg_t* ipx_ring_try_pop(ipx_ring_t* ring)
+{
+	ipx_msg_t** msg = ipx_ring_read_begin(ring);
+
+	if (ring->reader.exchange_idx - ring->reader.read_idx == 0) {
+		if (!ring_reader_ready(&ring, 1)) {
+			return NULL;
+		}
+		ipx_ring_read_steal(ring);
 	}
 
-	while (1) {
-		// The reader has reached the end of the filled memory -> try to sync
-		pthread_mutex_lock(&ring->sync.mutex);
-		pthread_cond_signal(&ring->sync.cond_writer);
-		// Wait until a writer sends a signal or a timeout expires
-		ring_cond_timedwait(&ring->sync.cond_reader, &ring->sync.mutex, 10);
-		ring->reader.exchange_idx = ring->sync.read_idx;
-		pthread_mutex_unlock(&ring->sync.mutex);
+	ring->reader.last = 1;
+	return *msg;
+}
+
+/**
+ * \brief Copy messages owned by the reader to the array and mark them as read
+ * \param[in]  ring Ring buffer
+ * \param[out] msgs Output array
+ * \param[in]  max  Size of the output array
+ * \return Number of copied messages
+ */
+static inline uint32_t ipx_ring_read_copy(ipx_ring_t* ring, ipx_msg_t** msgs, uint32_t max)
+{
+	uint32_t cnt = ring->reader.exchange_idx - ring->reader.read_idx;
+	if (cnt > max) {
+		cnt = max;
+	}
+
+	// Messages can wrap around the end of the buffer
+	uint32_t first = ring->reader.size - ring->reader.data_idx;
+	if (first > cnt) {
+		first = cnt;
+	}
+	memcpy(msgs, &ring->data[ring->reader.data_idx], first * sizeof(*msgs));
+	memcpy(msgs + first, ring->data, (cnt - first) * sizeof(*msgs));
+
+	ring->reader.last = cnt;
+	return cnt;
+}
+
+uint32_t ipx_ring_try_pop_burst(ipx_ring_t* ring, ipx_msg_t** msgs, uint32_t max)
+{
+	ipx_ring_read_begin(ring);
 
-		if (ring->reader.exchange_idx - ring->reader.read_idx > 0) {
-			// TODO: prefetch
-			ring->reader.last = 1;
-			return *msg; // Now, we can dereference the pointer
+	if (ring->reader.exchange_idx - ring->reader.read_idx == 0) {
+		if (!ring_reader_ready(&ring, 1)) {
+			return 0;
 		}
+		ipx_ring_read_steal(ring);
+	}
+	return ipx_ring_read_copy(ring, msgs, max);
+}
 
-		// Writer still didn't perform sync -> try to steal all committed messages from writer
-		pthread_mutex_lock(&ring->sync.mutex);
-		ring->sync.read_idx = ring->reader.exchange_idx
-			= __sync_fetch_and_add(&ring->writer.write_idx, 0);
-		pthread_mutex_unlock(&ring->sync.mutex);
+uint32_t ipx_ring_pop_burst(ipx_ring_t* ring, ipx_msg_t** msgs, uint32_t max)
+{
+	ipx_ring_read_begin(ring);
+
+	if (ring->reader.exchange_idx - ring->reader.read_idx == 0) {
+		// Wait until a writer commits a message, then steal it
+		if (!ring_reader_ready(&ring, 1)
+			&& !ring_wait(
+				ring->reader_wait,
+				ring->spin_cnt,
+				ring->park_timeout,
+				ring_reader_ready,
+				&ring,
+				1)) {
+			return 0;
+		}
+		ipx_ring_read_steal(ring);
+	}
+	return ipx_ring_read_copy(ring, msgs, max);
+}
 
-		if (ring->reader.exchange_idx - ring->reader.read_idx > 0) {
-			// TODO: prefetch
-			ring->reader.last = 1;
-			return *msg; // Now, we can dereference the pointer
+ipx_msg_t* ipx_ring_pop(ipx_ring_t* ring)
+{
+	// Prepare the next pointer to read
+	ipx_msg_t** msg = ipx_ring_read_begin(ring);
+
+	if (ring->reader.exchange_idx - ring->reader.read_idx == 0) {
+		// The reader has reached the end of the filled memory -> wait for a writer
+		if (!ring_reader_ready(&ring, 1)
+			&& !ring_wait(
+				ring->reader_wait,
+				ring->spin_cnt,
+				ring->park_timeout,
+				ring_reader_ready,
+				&ring,
+				1)) {
+			return NULL;
 		}
-		break;
+		// Writer probably didn't perform sync -> steal all committed messages from writer
+		ipx_ring_read_steal(ring);
 	}
-	return NULL;
+
+	// Ok, the reader owns this part of the buffer
+	ring->reader.last = 1;
+	return *msg; // Now, we can dereference the pointer
+}
+
+bool ipx_ring_wait_any(ipx_ring_t* const* rings, size_t cnt)
+{
+	if (cnt == 0) {
+		return false;
+	}
+	if (ring_reader_ready(rings, cnt)) {
+		return true;
+	}
+	return ring_wait(
+		rings[0]->reader_wait,
+		rings[0]->spin_cnt,
+		rings[0]->park_timeout,
+		ring_reader_ready,
+		rings,
+		cnt);
+}
+
+void ipx_ring_share_reader(ipx_ring_t* ring, ipx_ring_t* leader)
+{
+	ring->reader_wait = leader->reader_wait;
+}
+
+void ipx_ring_set_wait(ipx_ring_t* ring, uint32_t spin_cnt, uint32_t park_timeout)
+{
+	ring->spin_cnt = spin_cnt;
+	ring->park_timeout = park_timeout;
 }
 
 void ipx_ring_mw_mode(ipx_ring_t* ring, bool mode)
@@ -30,6 +30,9 @@
 
 #include "ipfixprobe.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -37,31 +40,93 @@ namespace ipxp {
 
 #define MICRO_SEC 1000000L
 
+/** Maximum number of flows passed to the output plugin at once. */
+static const uint32_t OUTPUT_BURST_SIZE = 64;
+
+#ifdef __linux__
+static const clockid_t clk_id = CLOCK_MONOTONIC_COARSE;
+#else
+static const clockid_t clk_id = CLOCK_MONOTONIC;
+#endif
+
+/**
+ * \brief Put all packets of the block into the storage plugin and update statistics.
+ */
+static void store_block(StoragePlugin& storagePlugin, PacketBlock& block, InputStats& stats)
+{
+	struct timespec start_cache;
+	struct timespec end_cache;
+
+	stats.bytes += block.bytes;
+	clock_gettime(clk_id, &start_cache);
+	storagePlugin.put_pkt_block(block);
+	clock_gettime(clk_id, &end_cache);
+
+	int64_t time = end_cache.tv_nsec - start_cache.tv_nsec;
+	if (start_cache.tv_sec != end_cache.tv_sec) {
+		time += 1000000000;
+	}
+	stats.qtime += time;
+}
+
+/**
+ * \brief Export expired flows when no packets are received.
+ *
+ * Packet timestamps are not available during timeout, so the time of the last received packet
+ * is shifted by the time elapsed since the timeout started.
+ */
+static void timeout_export_expired(
+	StoragePlugin& storagePlugin,
+	const struct timeval& ts,
+	struct timespec& begin,
+	bool& timeout)
+{
+	struct timespec end;
+
+	clock_gettime(clk_id, &end);
+	if (!timeout) {
+		timeout = true;
+		begin = end;
+	}
+	struct timespec diff = {end.tv_sec - begin.tv_sec, end.tv_nsec - begin.tv_nsec};
+	if (diff.tv_nsec < 0) {
+		diff.tv_nsec += 1000000000;
+		diff.tv_sec--;
+	}
+	storagePlugin.export_expired(ts.tv_sec + diff.tv_sec);
+}
+
+static void wait_for_export(StoragePlugin& storagePlugin)
+{
+	storagePlugin.finish();
+	auto outq = storagePlugin.get_queue();
+	while (ipx_ring_cnt(outq)) {
+		usleep(1);
+	}
+}
+
 void input_storage_worker(
 	std::shared_ptr<InputPlugin> inputPlugin,
 	std::shared_ptr<StoragePlugin> storagePlugin,
 	size_t queue_size,
 	uint64_t pkt_limit,
+	MemoryPolicy* memory,
+	RecordExtPool* ext_pool,
+	IdlePolicy* idle,
 	std::promise<WorkerResult>* out,
 	std::atomic<InputStats>* out_stats)
 {
-	struct timespec start_cache;
-	struct timespec end_cache;
 	struct timespec begin = {0, 0};
-	struct timespec end = {0, 0};
 	struct timeval ts = {0, 0};
 	bool timeout = false;
 	InputPlugin::Result ret;
 	InputStats stats = {0, 0, 0, 0, 0};
 	WorkerResult res = {false, ""};
 
+	MemoryPolicy::set_current(memory);
 	PacketBlock block(queue_size);
-
-#ifdef __linux__
-	const clockid_t clk_id = CLOCK_MONOTONIC_COARSE;
-#else
-	const clockid_t clk_id = CLOCK_MONOTONIC;
-#endif
+	MemoryPolicy::set_current(nullptr);
+	RecordExtPool::set_current(ext_pool);
 
 	while (!terminate_input) {
 		block.cnt = 0;
@@ -81,29 +146,17 @@ void input_storage_worker(
 			break;
 		}
 		if (ret == InputPlugin::Result::TIMEOUT) {
-			clock_gettime(clk_id, &end);
-			if (!timeout) {
-				timeout = true;
-				begin = end;
-			}
-			struct timespec diff = {end.tv_sec - begin.tv_sec, end.tv_nsec - begin.tv_nsec};
-			if (diff.tv_nsec < 0) {
-				diff.tv_nsec += 1000000000;
-				diff.tv_sec--;
-			}
-			storagePlugin->export_expired(ts.tv_sec + diff.tv_sec);
-			usleep(1);
+			timeout_export_expired(*storagePlugin, ts, begin, timeout);
+			idle->idle();
 			continue;
-		} else if (ret == InputPlugin::Result::PARSED) {
+		}
+		idle->busy();
+		if (ret == InputPlugin::Result::PARSED) {
 			stats.packets = inputPlugin->m_seen;
 			stats.parsed = inputPlugin->m_parsed;
 			stats.dropped = inputPlugin->m_dropped;
-			stats.bytes += block.bytes;
-			clock_gettime(clk_id, &start_cache);
 			try {
-				for (unsigned i = 0; i < block.cnt; i++) {
-					storagePlugin->put_pkt(block.pkts[i]);
-				}
+				store_block(*storagePlugin, block, stats);
 				ts = block.pkts[block.cnt - 1].ts;
 			} catch (PluginError& e) {
 				res.error = true;
@@ -111,13 +164,6 @@ void input_storage_worker(
 				break;
 			}
 			timeout = false;
-			clock_gettime(clk_id, &end_cache);
-
-			int64_t time = end_cache.tv_nsec - start_cache.tv_nsec;
-			if (start_cache.tv_sec != end_cache.tv_sec) {
-				time += 1000000000;
-			}
-			stats.qtime += time;
 
 			out_stats->store(stats);
 		} else if (ret == InputPlugin::Result::ERROR) {
@@ -133,11 +179,181 @@ void input_storage_worker(
 	stats.parsed = inputPlugin->m_parsed;
 	stats.dropped = inputPlugin->m_dropped;
 	out_stats->store(stats);
-	storagePlugin->finish();
-	auto outq = storagePlugin->get_queue();
-	while (ipx_ring_cnt(outq)) {
-		usleep(1);
+	wait_for_export(*storagePlugin);
+	out->set_value(res);
+}
+
+/**
+ * \brief Copy packet data into the buffer owned by the ring slot.
+ *
+ * Packets point into receive buffers of the input plugin, which are reused by the next call
+ * of InputPlugin::get(). Custom data are stored at the end of the slot packet buffer, packet data
+ * which do not fit in front of them are truncated.
+ */
+static void copy_packet_data(PacketBlockRing::Slot& slot)
+{
+	for (size_t i = 0; i < slot.block.cnt; i++) {
+		Packet& pkt = slot.block.pkts[i];
+		uint8_t* buffer = slot.data.get() + i * slot.pkt_buffer_size;
+
+		size_t custom_len = 0;
+		if (pkt.custom != nullptr) {
+			custom_len = std::min<size_t>(pkt.custom_len, slot.pkt_buffer_size);
+			memcpy(buffer + slot.pkt_buffer_size - custom_len, pkt.custom, custom_len);
+			pkt.custom = buffer + slot.pkt_buffer_size - custom_len;
+			pkt.custom_len = custom_len;
+		}
+		if (pkt.packet == nullptr) {
+			continue;
+		}
+
+		const size_t len = std::min<size_t>(pkt.packet_len, slot.pkt_buffer_size - custom_len);
+		size_t payload_offset = pkt.payload ? pkt.payload - pkt.packet : len;
+		if (payload_offset > len) {
+			payload_offset = len;
+		}
+
+		memcpy(buffer, pkt.packet, len);
+		pkt.buffer = buffer;
+		pkt.buffer_size = slot.pkt_buffer_size;
+		pkt.packet = buffer;
+		pkt.packet_len = len;
+		pkt.payload = buffer + payload_offset;
+		if (pkt.payload_len > len - payload_offset) {
+			pkt.payload_len = len - payload_offset;
+		}
 	}
+}
+
+void input_worker(
+	std::shared_ptr<InputPlugin> inputPlugin,
+	PacketBlockRing* queue,
+	uint64_t pkt_limit,
+	IdlePolicy* idle,
+	std::promise<WorkerResult>* out)
+{
+	InputPlugin::Result ret;
+	WorkerResult res = {false, ""};
+	// Waiting for the storage thread can't block on the input descriptor
+	const bool busy = idle->get_mode() == IdlePolicy::Mode::BUSY;
+	IdlePolicy full_idle(busy ? IdlePolicy::Mode::BUSY : IdlePolicy::Mode::BACKOFF);
+
+	while (!terminate_input) {
+		PacketBlockRing::Slot* slot = queue->begin_push();
+		if (slot == nullptr) {
+			if (queue->is_aborted()) {
+				// Storage thread has failed, nobody will free the ring
+				break;
+			}
+			// Storage thread is not keeping up
+			full_idle.idle();
+			continue;
+		}
+		full_idle.busy();
+
+		PacketBlock& block = slot->block;
+		const size_t block_size = block.size;
+		block.cnt = 0;
+		block.bytes = 0;
+		if (pkt_limit && inputPlugin->m_parsed + block.size >= pkt_limit) {
+			if (inputPlugin->m_parsed >= pkt_limit) {
+				break;
+			}
+			block.size = pkt_limit - inputPlugin->m_parsed;
+		}
+		try {
+			ret = inputPlugin->get(block);
+		} catch (PluginError& e) {
+			res.error = true;
+			res.msg = e.what();
+			break;
+		}
+		// Slots are recycled, the packet limit must not shrink the block for good
+		block.size = block_size;
+		if (ret == InputPlugin::Result::TIMEOUT) {
+			idle->idle();
+			continue;
+		}
+		idle->busy();
+		if (ret == InputPlugin::Result::PARSED) {
+			copy_packet_data(*slot);
+			slot->seen = inputPlugin->m_seen;
+			slot->parsed = inputPlugin->m_parsed;
+			slot->dropped = inputPlugin->m_dropped;
+			queue->commit_push();
+		} else if (ret == InputPlugin::Result::ERROR) {
+			res.error = true;
+			res.msg = "error occured during reading";
+			break;
+		} else if (ret == InputPlugin::Result::END_OF_FILE) {
+			break;
+		}
+	}
+
+	out->set_value(res);
+	queue->close();
+}
+
+void storage_worker(
+	std::shared_ptr<InputPlugin> inputPlugin,
+	std::shared_ptr<StoragePlugin> storagePlugin,
+	PacketBlockRing* queue,
+	std::future<WorkerResult> input_res,
+	RecordExtPool* ext_pool,
+	IdlePolicy::Mode idle_mode,
+	std::promise<WorkerResult>* out,
+	std::atomic<InputStats>* out_stats)
+{
+	struct timespec begin = {0, 0};
+	struct timeval ts = {0, 0};
+	bool timeout = false;
+	InputStats stats = {0, 0, 0, 0, 0};
+	WorkerResult res = {false, ""};
+	// Storage thread has no descriptor to block on, it waits for the input thread
+	IdlePolicy idle(
+		idle_mode == IdlePolicy::Mode::BUSY ? IdlePolicy::Mode::BUSY : IdlePolicy::Mode::BACKOFF);
+
+	RecordExtPool::set_current(ext_pool);
+
+	while (1) {
+		PacketBlockRing::Slot* slot = queue->begin_pop();
+		if (slot == nullptr) {
+			if (queue->is_closed() && !queue->count()) {
+				break;
+			}
+			timeout_export_expired(*storagePlugin, ts, begin, timeout);
+			idle.idle();
+			continue;
+		}
+		idle.busy();
+
+		stats.packets = slot->seen;
+		stats.parsed = slot->parsed;
+		stats.dropped = slot->dropped;
+		try {
+			store_block(*storagePlugin, slot->block, stats);
+			ts = slot->block.pkts[slot->block.cnt - 1].ts;
+		} catch (PluginError& e) {
+			res.error = true;
+			res.msg = e.what();
+			queue->abort();
+			break;
+		}
+		queue->commit_pop();
+		timeout = false;
+
+		out_stats->store(stats);
+	}
+
+	if (!res.error) {
+		// Input thread has already finished, its result is available
+		res = input_res.get();
+		stats.packets = inputPlugin->m_seen;
+		stats.parsed = inputPlugin->m_parsed;
+		stats.dropped = inputPlugin->m_dropped;
+	}
+	out_stats->store(stats);
+	wait_for_export(*storagePlugin);
 	out->set_value(res);
 }
 
@@ -146,9 +362,56 @@ static long timeval_diff(const struct timeval* start, const struct timeval* end)
 	return (end->tv_sec - start->tv_sec) * MICRO_SEC + (end->tv_usec - start->tv_usec);
 }
 
+/**
+ * \brief Get the next burst of flows from output queues in round-robin order.
+ *
+ * Every queue with flows gets one turn, so a busy pipeline can't starve the others.
+ * \return Number of flows stored to the array, 0 when all queues are empty.
+ */
+static uint32_t try_pop_next_flows(
+	std::vector<ipx_ring_t*>& queues,
+	size_t& queue_idx,
+	Flow** flows,
+	uint32_t max)
+{
+	ipx_msg_t** msgs = reinterpret_cast<ipx_msg_t**>(flows);
+	for (size_t i = 0; i < queues.size(); i++) {
+		queue_idx = queue_idx + 1 == queues.size() ? 0 : queue_idx + 1;
+		uint32_t cnt = ipx_ring_try_pop_burst(queues[queue_idx], msgs, max);
+		if (cnt) {
+			return cnt;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \brief Get the next burst of flows, wait for flows on any queue when all queues are empty.
+ * \return Number of flows stored to the array, 0 when no flow is ready.
+ */
+static uint32_t pop_next_flows(
+	std::vector<ipx_ring_t*>& queues,
+	size_t& queue_idx,
+	Flow** flows,
+	uint32_t max)
+{
+	uint32_t cnt = try_pop_next_flows(queues, queue_idx, flows, max);
+	if (!cnt && ipx_ring_wait_any(queues.data(), queues.size())) {
+		cnt = try_pop_next_flows(queues, queue_idx, flows, max);
+	}
+	return cnt;
+}
+
+static bool output_queues_empty(const std::vector<ipx_ring_t*>& queues)
+{
+	return std::all_of(queues.begin(), queues.end(), [](const ipx_ring_t* queue) {
+		return ipx_ring_cnt(queue) == 0;
+	});
+}
+
 void output_worker(
 	std::shared_ptr<OutputPlugin> outputPlugin,
-	ipx_ring_t* queue,
+	std::vector<ipx_ring_t*> queues,
 	std::promise<WorkerResult>* out,
 	std::atomic<OutputStats>* out_stats,
 	uint32_t fps)
@@ -161,9 +424,14 @@ void output_worker(
 	struct timeval last_flush;
 	uint32_t pkts_from_begin = 0;
 	double time_per_pkt = 0;
+	size_t queue_idx = 0;
+	Flow* flows[OUTPUT_BURST_SIZE];
+	uint32_t burst_size = OUTPUT_BURST_SIZE;
 
 	if (fps != 0) {
 		time_per_pkt = 1000000.0 / fps; // [micro seconds]
+		// Keep bursts short enough to not break the rate limiting
+		burst_size = std::max(1U, std::min(burst_size, fps / 1000));
 	}
 
 	// Rate limiting algorithm from
@@ -173,32 +441,34 @@ void output_worker(
 	while (1) {
 		gettimeofday(&end, nullptr);
 
-		Flow* flow = static_cast<Flow*>(ipx_ring_pop(queue));
-		if (!flow) {
+		uint32_t cnt = pop_next_flows(queues, queue_idx, flows, burst_size);
+		if (!cnt) {
 			if (end.tv_sec - last_flush.tv_sec > 1) {
 				last_flush = end;
 				outputPlugin->flush();
 			}
-			if (terminate_export && !ipx_ring_cnt(queue)) {
+			if (terminate_export && output_queues_empty(queues)) {
 				break;
 			}
 			continue;
 		}
 
-		stats.biflows++;
-		stats.bytes += flow->src_bytes + flow->dst_bytes;
-		stats.packets += flow->src_packets + flow->dst_packets;
-		stats.dropped = outputPlugin->m_flows_dropped;
-		out_stats->store(stats);
+		stats.biflows += cnt;
+		for (uint32_t i = 0; i < cnt; i++) {
+			stats.bytes += flows[i]->src_bytes + flows[i]->dst_bytes;
+			stats.packets += flows[i]->src_packets + flows[i]->dst_packets;
+		}
 		try {
-			outputPlugin->export_flow(*flow);
+			outputPlugin->export_flows(flows, cnt);
 		} catch (PluginError& e) {
 			res.error = true;
 			res.msg = e.what();
 			break;
 		}
+		stats.dropped = outputPlugin->m_flows_dropped;
+		out_stats->store(stats);
 
-		pkts_from_begin++;
+		pkts_from_begin += cnt;
 		if (fps == 0) {
 			// Limit for packets/s is not enabled
 			continue;
@@ -29,15 +29,20 @@
 #ifndef IPXP_WORKERS_HPP
 #define IPXP_WORKERS_HPP
 
+#include "idlePolicy.hpp"
+#include "packetBlockRing.hpp"
 #include "stats.hpp"
 
 #include <atomic>
 #include <future>
+#include <vector>
 
 #include <ipfixprobe/inputPlugin.hpp>
+#include <ipfixprobe/memory.hpp>
 #include <ipfixprobe/outputPlugin.hpp>
 #include <ipfixprobe/packet.hpp>
 #include <ipfixprobe/processPlugin.hpp>
+#include <ipfixprobe/recordExtPool.hpp>
 #include <ipfixprobe/ring.h>
 #include <ipfixprobe/storagePlugin.hpp>
 
@@ -60,7 +65,13 @@ struct WorkPipeline {
 	struct {
 		std::shared_ptr<StoragePlugin> storagePlugin;
 		std::vector<ProcessPlugin*> plugins;
+		std::thread* thread; /**< Dedicated storage thread, nullptr when run by input thread */
+		std::promise<WorkerResult>* promise;
+		PacketBlockRing* queue; /**< Queue between input and storage thread */
 	} storage;
+	MemoryPolicy* memory; /**< Placement of flow cache and packet blocks, nullptr when default */
+	IdlePolicy* idle; /**< Waiting of the input worker for packets */
+	RecordExtPool* ext_pool; /**< Flow extensions created by the storage and process plugins */
 };
 
 struct OutputWorker {
@@ -68,7 +79,7 @@ struct OutputWorker {
 	std::thread* thread;
 	std::promise<WorkerResult>* promise;
 	std::atomic<OutputStats>* stats;
-	ipx_ring_t* queue;
+	std::vector<ipx_ring_t*> queues; /**< Output queue of each pipeline */
 };
 
 void input_storage_worker(
@@ -76,11 +87,29 @@ void input_storage_worker(
 	std::shared_ptr<StoragePlugin> storagePlugin,
 	size_t queue_size,
 	uint64_t pkt_limit,
+	MemoryPolicy* memory,
+	RecordExtPool* ext_pool,
+	IdlePolicy* idle,
+	std::promise<WorkerResult>* out,
+	std::atomic<InputStats>* out_stats);
+void input_worker(
+	std::shared_ptr<InputPlugin> inputPlugin,
+	PacketBlockRing* queue,
+	uint64_t pkt_limit,
+	IdlePolicy* idle,
+	std::promise<WorkerResult>* out);
+void storage_worker(
+	std::shared_ptr<InputPlugin> inputPlugin,
+	std::shared_ptr<StoragePlugin> storagePlugin,
+	PacketBlockRing* queue,
+	std::future<WorkerResult> input_res,
+	RecordExtPool* ext_pool,
+	IdlePolicy::Mode idle_mode,
 	std::promise<WorkerResult>* out,
 	std::atomic<InputStats>* out_stats);
 void output_worker(
 	std::shared_ptr<OutputPlugin> outputPlugin,
-	ipx_ring_t* queue,
+	std::vector<ipx_ring_t*> queues,
 	std::promise<WorkerResult>* out,
 	std::atomic<OutputStats>* out_stats,
 	uint32_t fps);
@@ -292,6 +292,15 @@ InputPlugin::Result PcapReader::get(PacketBlock& packets)
 	return Result::NOT_PARSED;
 }
 
+int PcapReader::get_fd() const
+{
+	// Files never time out, the descriptor is useful only for live capture
+	if (m_handle == nullptr || !m_live) {
+		return -1;
+	}
+	return pcap_get_selectable_fd(m_handle);
+}
+
 static const PluginRegistrar<PcapReader, InputPluginFactory> pcapRegistrar(pcapPluginManifest);
 
 } // namespace ipxp
@@ -124,6 +124,7 @@ public:
 	OptionsParser* get_parser() const { return new PcapOptParser(); }
 	std::string get_name() const { return "pcap"; }
 	InputPlugin::Result get(PacketBlock& packets);
+	int get_fd() const;
 
 private:
 	pcap_t* m_handle; /**< libpcap file handle */
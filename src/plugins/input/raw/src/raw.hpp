@@ -123,6 +123,7 @@ public:
 	OptionsParser* get_parser() const { return new RawOptParser(); }
 	std::string get_name() const { return "raw"; }
 	InputPlugin::Result get(PacketBlock& packets);
+	int get_fd() const { return m_sock; }
 
 private:
 	int m_sock;
@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @brief Asynchronous sender of IPFIX messages over a stream socket
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ipfix-sender.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+namespace ipxp {
+
+IpfixSender::IpfixSender(size_t capacity, unsigned drainTimeout)
+	: m_buffer(capacity)
+	, m_head(0)
+	, m_size(0)
+	, m_headSent(0)
+	, m_fd(-1)
+	, m_broken(false)
+	, m_stop(false)
+	, m_drainTimeout(drainTimeout)
+	, m_droppedFlows(0)
+	, m_droppedMessages(0)
+	, m_sentBytes(0)
+{
+	m_thread = std::thread(&IpfixSender::run, this);
+}
+
+IpfixSender::~IpfixSender()
+{
+	stop();
+}
+
+void IpfixSender::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+void IpfixSender::start(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags != -1) {
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fd = fd;
+		m_broken = false;
+	}
+	m_cond.notify_one();
+}
+
+bool IpfixSender::push(const uint8_t* data, size_t len, uint32_t flows)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_stop || m_broken || m_fd < 0 || len > m_buffer.size() - m_size) {
+			m_droppedMessages++;
+			return false;
+		}
+
+		// Copy behind the queued data, wrap around the end of the buffer
+		const size_t tail = (m_head + m_size) % m_buffer.size();
+		const size_t first = std::min(len, m_buffer.size() - tail);
+		memcpy(&m_buffer[tail], data, first);
+		memcpy(&m_buffer[0], data + first, len - first);
+		m_size += len;
+		m_messages.push_back({len, flows});
+	}
+	m_cond.notify_one();
+	return true;
+}
+
+bool IpfixSender::is_broken()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_broken;
+}
+
+uint64_t IpfixSender::take_dropped_flows()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const uint64_t flows = m_droppedFlows;
+	m_droppedFlows = 0;
+	return flows;
+}
+
+uint64_t IpfixSender::get_sent_bytes()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sentBytes;
+}
+
+uint64_t IpfixSender::get_queued_bytes()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_size;
+}
+
+uint64_t IpfixSender::get_dropped_messages()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_droppedMessages;
+}
+
+void IpfixSender::drop_all()
+{
+	for (const auto& msg : m_messages) {
+		m_droppedFlows += msg.flows;
+	}
+	m_droppedMessages += m_messages.size();
+	m_messages.clear();
+	m_head = 0;
+	m_size = 0;
+	m_headSent = 0;
+}
+
+void IpfixSender::consume(size_t len)
+{
+	m_head = (m_head + len) % m_buffer.size();
+	m_size -= len;
+	m_sentBytes += len;
+
+	// Remove completely sent messages
+	m_headSent += len;
+	while (!m_messages.empty() && m_headSent >= m_messages.front().len) {
+		m_headSent -= m_messages.front().len;
+		m_messages.pop_front();
+	}
+}
+
+void IpfixSender::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	std::chrono::steady_clock::time_point deadline;
+	bool draining = false;
+
+	while (true) {
+		m_cond.wait(lock, [this] { return m_stop || (m_size > 0 && m_fd >= 0 && !m_broken); });
+
+		if (m_stop) {
+			if (m_size == 0 || m_fd < 0 || m_broken) {
+				return;
+			}
+			if (!draining) {
+				deadline = std::chrono::steady_clock::now() + m_drainTimeout;
+				draining = true;
+			} else if (std::chrono::steady_clock::now() >= deadline) {
+				drop_all();
+				return;
+			}
+		}
+
+		// Queued data form at most two segments of the ring buffer
+		struct iovec iov[2];
+		const size_t first = std::min(m_size, m_buffer.size() - m_head);
+		iov[0].iov_base = &m_buffer[m_head];
+		iov[0].iov_len = first;
+		iov[1].iov_base = &m_buffer[0];
+		iov[1].iov_len = m_size - first;
+		const int iovcnt = iov[1].iov_len > 0 ? 2 : 1;
+		const int fd = m_fd;
+
+		// Producers only append behind the queued data, the segments stay valid
+		lock.unlock();
+		struct pollfd pfd = {fd, POLLOUT, 0};
+		ssize_t ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
+		if (ret > 0) {
+			ret = writev(fd, iov, iovcnt);
+		}
+		const int err = errno;
+		lock.lock();
+
+		if (ret > 0) {
+			consume(ret);
+		} else if (ret < 0 && err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
+			m_broken = true;
+			drop_all();
+		}
+	}
+}
+
+} // namespace ipxp
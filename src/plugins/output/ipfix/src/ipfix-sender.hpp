@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief Asynchronous sender of IPFIX messages over a stream socket
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ipxp {
+
+/**
+ * \brief Sender thread decoupling serialization of IPFIX messages from their transmission.
+ *
+ * Messages are copied to a ring buffer of fixed size and written to the socket with writev()
+ * by a dedicated thread. When the buffer is full, new messages are rejected, so a slow collector
+ * never blocks the caller.
+ *
+ * When a write fails, the connection is marked as broken and all queued messages are dropped.
+ * The sender then waits until the owner reconnects and hands it the new socket with start().
+ */
+class IpfixSender {
+public:
+	/** Interval of checking the stop request while the socket is not writable. */
+	static const int POLL_TIMEOUT_MS = 100;
+
+	/**
+	 * \brief Constructor, starts the sender thread.
+	 * \param capacity Size of the ring buffer in bytes.
+	 * \param drainTimeout Time given to send the queued messages when stopping, in seconds.
+	 */
+	IpfixSender(size_t capacity, unsigned drainTimeout);
+
+	/**
+	 * \brief Destructor, stops the thread unless already stopped.
+	 */
+	~IpfixSender();
+
+	IpfixSender(const IpfixSender&) = delete;
+	IpfixSender& operator=(const IpfixSender&) = delete;
+
+	/**
+	 * \brief Start sending to a connected socket, clears the broken state.
+	 *
+	 * The socket is switched to non-blocking mode.
+	 */
+	void start(int fd);
+
+	/**
+	 * \brief Send the queued messages until the drain timeout and stop the thread.
+	 *
+	 * Later messages are rejected, the counters stay readable.
+	 */
+	void stop();
+
+	/**
+	 * \brief Queue message.
+	 * \param data Message data.
+	 * \param len Message length.
+	 * \param flows Number of records in the message, counted as dropped when it is not sent.
+	 * \return False when the message does not fit to the buffer, the connection is broken or the
+	 *         sender is stopped.
+	 */
+	bool push(const uint8_t* data, size_t len, uint32_t flows);
+
+	/**
+	 * \brief Check whether a write failed since the last start().
+	 *
+	 * The sender does not touch the socket while broken, the owner may close it.
+	 */
+	bool is_broken();
+
+	/**
+	 * \brief Get number of records in dropped messages since the last call.
+	 */
+	uint64_t take_dropped_flows();
+
+	/** Bytes written to the socket. */
+	uint64_t get_sent_bytes();
+	/** Bytes waiting in the buffer. */
+	uint64_t get_queued_bytes();
+	/** Messages rejected by push() or dropped from the buffer. */
+	uint64_t get_dropped_messages();
+
+private:
+	/**
+	 * \brief Message in the ring buffer.
+	 */
+	struct Message {
+		size_t len;
+		uint32_t flows;
+	};
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+
+	std::vector<uint8_t> m_buffer; /**< Ring buffer of message data */
+	size_t m_head; /**< Offset of the first unsent byte */
+	size_t m_size; /**< Number of unsent bytes */
+	std::deque<Message> m_messages; /**< Messages with unsent data, in order */
+	size_t m_headSent; /**< Bytes of the first message already sent */
+
+	int m_fd;
+	bool m_broken;
+	bool m_stop;
+	std::chrono::seconds m_drainTimeout;
+
+	uint64_t m_droppedFlows; /**< Not taken by take_dropped_flows() yet */
+	uint64_t m_droppedMessages;
+	uint64_t m_sentBytes;
+
+	void run();
+	void drop_all();
+	void consume(size_t len);
+};
+
+} // namespace ipxp
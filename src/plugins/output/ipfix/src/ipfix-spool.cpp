@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @brief Disk-backed spool of IPFIX messages which could not be sent
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ipfix-spool.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <ipfixprobe/plugin.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ipxp {
+
+IpfixSpool::IpfixSpool(const std::string& path, size_t capacity)
+	: m_fd(-1)
+	, m_data(nullptr)
+	, m_capacity(capacity & ~(ALIGN - 1))
+	, m_head(0)
+	, m_tail(0)
+	, m_used(0)
+	, m_count(0)
+	, m_droppedFlows(0)
+{
+	if (m_capacity == 0) {
+		throw PluginError("spool size must be at least " + std::to_string(ALIGN) + " bytes");
+	}
+
+	m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (m_fd == -1) {
+		throw PluginError("unable to open spool file " + path + ": " + strerror(errno));
+	}
+	if (ftruncate(m_fd, m_capacity) == -1) {
+		const std::string err = strerror(errno);
+		close(m_fd);
+		throw PluginError("unable to resize spool file " + path + ": " + err);
+	}
+
+	void* data = mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		const std::string err = strerror(errno);
+		close(m_fd);
+		throw PluginError("unable to map spool file " + path + ": " + err);
+	}
+	m_data = static_cast<uint8_t*>(data);
+	madvise(m_data, m_capacity, MADV_SEQUENTIAL);
+}
+
+IpfixSpool::~IpfixSpool()
+{
+	munmap(m_data, m_capacity);
+	close(m_fd);
+}
+
+void IpfixSpool::reset()
+{
+	m_head = 0;
+	m_tail = 0;
+	m_used = 0;
+}
+
+bool IpfixSpool::push(const uint8_t* data, size_t len, uint32_t flows)
+{
+	const size_t need = record_size(len);
+	if (len == 0 || need > m_capacity) {
+		return false;
+	}
+	if (m_count == 0) {
+		reset();
+	}
+
+	if (m_tail + need > m_capacity) {
+		// Wrap to the file start, messages up to the file end are the oldest ones
+		while (m_count > 0 && m_head >= m_tail) {
+			drop_oldest();
+		}
+		if (m_count == 0) {
+			reset();
+		} else {
+			if (m_capacity - m_tail >= sizeof(Header)) {
+				const Header wrap = {0, 0};
+				memcpy(m_data + m_tail, &wrap, sizeof(wrap));
+			}
+			m_used += m_capacity - m_tail;
+			m_tail = 0;
+		}
+	}
+
+	// Overwrite the oldest messages in the way
+	while (m_count > 0 && m_head >= m_tail && m_head - m_tail < need) {
+		drop_oldest();
+	}
+	if (m_count == 0) {
+		reset();
+	}
+
+	const Header hdr = {static_cast<uint32_t>(len), flows};
+	memcpy(m_data + m_tail, &hdr, sizeof(hdr));
+	memcpy(m_data + m_tail + sizeof(hdr), data, len);
+	m_tail += need;
+	m_used += need;
+	m_count++;
+	return true;
+}
+
+bool IpfixSpool::front(const uint8_t*& data, size_t& len, uint32_t& flows) const
+{
+	if (m_count == 0) {
+		return false;
+	}
+
+	Header hdr;
+	memcpy(&hdr, m_data + m_head, sizeof(hdr));
+	data = m_data + m_head + sizeof(hdr);
+	len = hdr.len;
+	flows = hdr.flows;
+	return true;
+}
+
+void IpfixSpool::pop()
+{
+	if (m_count == 0) {
+		return;
+	}
+
+	Header hdr;
+	memcpy(&hdr, m_data + m_head, sizeof(hdr));
+	const size_t size = record_size(hdr.len);
+	m_head += size;
+	m_used -= size;
+	m_count--;
+	if (m_count == 0) {
+		reset();
+		return;
+	}
+
+	// Skip the unused file end
+	hdr.len = 0;
+	if (m_capacity - m_head >= sizeof(Header)) {
+		memcpy(&hdr, m_data + m_head, sizeof(hdr));
+	}
+	if (hdr.len == 0) {
+		m_used -= m_capacity - m_head;
+		m_head = 0;
+	}
+}
+
+void IpfixSpool::drop_oldest()
+{
+	Header hdr;
+	memcpy(&hdr, m_data + m_head, sizeof(hdr));
+	m_droppedFlows += hdr.flows;
+	pop();
+}
+
+uint64_t IpfixSpool::take_dropped_flows()
+{
+	const uint64_t flows = m_droppedFlows;
+	m_droppedFlows = 0;
+	return flows;
+}
+
+} // namespace ipxp
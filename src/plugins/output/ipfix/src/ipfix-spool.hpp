@@ -0,0 +1,101 @@
+/**
+ * @file
+ * @brief Disk-backed spool of IPFIX messages which could not be sent
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ipxp {
+
+/**
+ * \brief Ring of IPFIX messages in a memory-mapped file of fixed size.
+ *
+ * Messages are appended sequentially behind the newest one and read from the oldest one. When
+ * the file is full, the oldest messages are overwritten. The file is truncated when the spool is
+ * opened, it only bridges collector outages of the running exporter.
+ */
+class IpfixSpool {
+public:
+	/**
+	 * \brief Create spool file and map it.
+	 * \param path Path of the file.
+	 * \param capacity Size of the file in bytes.
+	 * \throw PluginError when the file cannot be created or mapped.
+	 */
+	IpfixSpool(const std::string& path, size_t capacity);
+	~IpfixSpool();
+
+	IpfixSpool(const IpfixSpool&) = delete;
+	IpfixSpool& operator=(const IpfixSpool&) = delete;
+
+	/**
+	 * \brief Append message, overwrite the oldest messages when there is no space.
+	 * \param data Message data.
+	 * \param len Message length.
+	 * \param flows Number of records in the message.
+	 * \return False when the message is larger than the spool.
+	 */
+	bool push(const uint8_t* data, size_t len, uint32_t flows);
+
+	/**
+	 * \brief Get the oldest message.
+	 * \return False when the spool is empty.
+	 */
+	bool front(const uint8_t*& data, size_t& len, uint32_t& flows) const;
+
+	/**
+	 * \brief Remove the oldest message.
+	 */
+	void pop();
+
+	bool empty() const { return m_count == 0; }
+
+	/** Number of spooled messages. */
+	uint64_t get_messages() const { return m_count; }
+	/** Bytes of spooled messages including their headers. */
+	uint64_t get_bytes() const { return m_used; }
+
+	/**
+	 * \brief Get number of records in overwritten messages since the last call.
+	 */
+	uint64_t take_dropped_flows();
+
+private:
+	/**
+	 * \brief Header preceding every message, zero length marks the wrap to the file start.
+	 */
+	struct Header {
+		uint32_t len;
+		uint32_t flows;
+	};
+
+	static const size_t ALIGN = sizeof(Header);
+
+	int m_fd;
+	uint8_t* m_data;
+	size_t m_capacity;
+	size_t m_head; /**< Offset of the oldest message */
+	size_t m_tail; /**< Offset behind the newest message */
+	size_t m_used; /**< Bytes between head and tail including skipped file end */
+	uint64_t m_count;
+	uint64_t m_droppedFlows;
+
+	static size_t record_size(size_t len)
+	{
+		return (sizeof(Header) + len + ALIGN - 1) & ~(ALIGN - 1);
+	}
+
+	void reset();
+	void drop_oldest();
+};
+
+} // namespace ipxp
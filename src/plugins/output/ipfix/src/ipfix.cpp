@@ -12,6 +12,7 @@
 
 #include <csignal>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <arpa/inet.h>
@@ -108,12 +109,15 @@ const char* basic_tmplt_v4[] = {BASIC_TMPLT_V4(IPFIX_FIELD_NAMES) nullptr};
 /* Basic IPv6 template. */
 const char* basic_tmplt_v6[] = {BASIC_TMPLT_V6(IPFIX_FIELD_NAMES) nullptr};
 
-IPFIXExporter::IPFIXExporter(const std::string& params, ProcessPlugins& plugins)
-	: extensions(nullptr)
+IPFIXExporter::IPFIXExporter()
+	: shards()
+	, shardFlows()
+	, failover(false)
 	, extension_cnt(0)
+	, tmpltCache(TEMPLATE_CACHE_SIZE)
+	, tmpltCacheCount(0)
 	, templates(nullptr)
 	, templatesDataSize(0)
-	, basic_ifc_num(-1)
 	, verbose(false)
 	, sequenceNum(0)
 	, exportedPackets(0)
@@ -126,6 +130,15 @@ IPFIXExporter::IPFIXExporter(const std::string& params, ProcessPlugins& plugins)
 	, flags(0)
 	, non_blocking_tcp(false)
 	, packetDataBuffer()
+	, udpSendCalls(0)
+	, udpSentMessages(0)
+	, udpDroppedMessages(0)
+	, sender()
+	, spool()
+	, spoolRate(SPOOL_REPLAY_RATE)
+	, spoolCredit(0)
+	, spoolLastReplay()
+	, spoolReplayedMessages(0)
 	, reconnectTimeout(RECONNECT_TIMEOUT)
 	, lastReconnect(0)
 	, odid(0)
@@ -134,10 +147,27 @@ IPFIXExporter::IPFIXExporter(const std::string& params, ProcessPlugins& plugins)
 	, dir_bit_field(0)
 	, mtu(DEFAULT_MTU)
 	, tmpltMaxBufferSize(mtu - IPFIX_HEADER_SIZE)
+{
+}
+
+IPFIXExporter::IPFIXExporter(const std::string& params, ProcessPlugins& plugins)
+	: IPFIXExporter()
 {
 	init(params.c_str(), plugins);
 }
 
+/**
+ * \brief Create exporter of one collector of a sharded export
+ *
+ * @param parser Parsed parameters of the sharded export
+ * @param shard Index of the collector
+ */
+IPFIXExporter::IPFIXExporter(const IpfixOptParser& parser, size_t shard)
+	: IPFIXExporter()
+{
+	configure(parser, shard);
+}
+
 IPFIXExporter::~IPFIXExporter()
 {
 	close();
@@ -158,13 +188,38 @@ void IPFIXExporter::init(const char* params)
 		throw PluginError("Compression (c) is not supported with udp (u)");
 	}
 
+	if (parser.m_ports.size() != 1 && parser.m_ports.size() != parser.m_hosts.size()) {
+		throw PluginError("Number of ports (p) must be one or match the number of hosts (h)");
+	}
+
+	if (parser.m_hosts.size() > 1) {
+		/* Every collector gets its own exporter with own templates and sequence numbers */
+		failover = parser.m_failover;
+		for (size_t i = 0; i < parser.m_hosts.size(); i++) {
+			shards.emplace_back(new IPFIXExporter(parser, i));
+		}
+		shardFlows.resize(shards.size());
+		return;
+	}
+
+	configure(parser, 0);
+}
+
+/**
+ * \brief Configure exporter and connect to the collector
+ *
+ * @param parser Parsed parameters
+ * @param shard Index of the collector in the parameters
+ */
+void IPFIXExporter::configure(const IpfixOptParser& parser, size_t shard)
+{
 	verbose = parser.m_verbose;
 	if (verbose) {
 		fprintf(stderr, "VERBOSE: IPFIX export plugin init start\n");
 	}
 
-	host = parser.m_host;
-	port = parser.m_port;
+	host = parser.m_hosts[shard];
+	port = parser.m_ports.size() == 1 ? parser.m_ports[0] : parser.m_ports[shard];
 	odid = parser.m_id;
 	mtu = parser.m_mtu;
 	dir_bit_field = parser.m_dir;
@@ -189,6 +244,10 @@ void IPFIXExporter::init(const char* params)
 
 	if (parser.m_udp) {
 		protocol = IPPROTO_UDP;
+		udpBatchData.resize(UDP_BATCH_SIZE * mtu);
+		udpBatchMsgs.resize(UDP_BATCH_SIZE);
+		udpBatchIov.resize(UDP_BATCH_SIZE);
+		udpBatchFlows.resize(UDP_BATCH_SIZE);
 	}
 
 	if (parser.m_non_blocking_tcp) {
@@ -201,6 +260,23 @@ void IPFIXExporter::init(const char* params)
 	}
 	tmpltMaxBufferSize = mtu - IPFIX_HEADER_SIZE;
 
+	if (protocol != IPPROTO_UDP && parser.m_sender_queue_size > 0) {
+		if (parser.m_sender_queue_size < mtu) {
+			throw PluginError("TCP send queue must be at least mtu bytes");
+		}
+		sender = std::make_unique<IpfixSender>(parser.m_sender_queue_size, SENDER_DRAIN_TIMEOUT);
+	}
+
+	if (!parser.m_spool_path.empty()) {
+		std::string path = parser.m_spool_path;
+		if (parser.m_hosts.size() > 1) {
+			path += "." + std::to_string(shard);
+		}
+		spool = std::make_unique<IpfixSpool>(path, parser.m_spool_size);
+		spoolRate = parser.m_spool_rate;
+		spoolLastReplay = std::chrono::steady_clock::now();
+	}
+
 	int ret = connect_to_collector();
 	if (ret) {
 		lastReconnect = time(nullptr);
@@ -222,10 +298,6 @@ void IPFIXExporter::init(const char* params, ProcessPlugins& plugins)
 	if (extension_cnt > 64) {
 		throw PluginError("output plugin operates only with up to 64 running plugins");
 	}
-	extensions = new RecordExt*[extension_cnt];
-	for (int i = 0; i < extension_cnt; i++) {
-		extensions[i] = nullptr;
-	}
 	for (auto& it : plugins) {
 		std::string name = it.first;
 		std::shared_ptr<ProcessPlugin> plugin = it.second;
@@ -240,6 +312,56 @@ void IPFIXExporter::init(const char* params, ProcessPlugins& plugins)
 		}
 		delete ext;
 	}
+
+	for (auto& shard : shards) {
+		shard->extension_cnt = extension_cnt;
+	}
+}
+
+void IPFIXExporter::set_telemetry_dirs(std::shared_ptr<telemetry::Directory> output_dir)
+{
+	OutputPlugin::set_telemetry_dirs(output_dir);
+	for (size_t i = 0; i < shards.size(); i++) {
+		shards[i]->set_telemetry_dirs(output_dir->addDir("shard-" + std::to_string(i)));
+	}
+	if (sender != nullptr) {
+		telemetry::FileOps senderStatsOps = {
+			[this]() {
+				telemetry::Dict dict;
+				dict["sent-bytes"] = sender->get_sent_bytes();
+				dict["queued-bytes"] = sender->get_queued_bytes();
+				dict["dropped-messages"] = sender->get_dropped_messages();
+				return telemetry::Content(dict);
+			},
+			nullptr};
+		register_file(output_dir, "tcp-sender-stats", senderStatsOps);
+	}
+	if (spool != nullptr) {
+		telemetry::FileOps spoolStatsOps = {
+			[this]() {
+				telemetry::Dict dict;
+				dict["spooled-messages"] = spool->get_messages();
+				dict["spooled-bytes"] = spool->get_bytes();
+				dict["replayed-messages"] = spoolReplayedMessages;
+				return telemetry::Content(dict);
+			},
+			nullptr};
+		register_file(output_dir, "spool-stats", spoolStatsOps);
+	}
+	if (protocol != IPPROTO_UDP) {
+		return;
+	}
+
+	telemetry::FileOps udpStatsOps = {
+		[this]() {
+			telemetry::Dict dict;
+			dict["send-calls"] = udpSendCalls;
+			dict["sent-messages"] = udpSentMessages;
+			dict["dropped-messages"] = udpDroppedMessages;
+			return telemetry::Content(dict);
+		},
+		nullptr};
+	register_file(output_dir, "udp-stats", udpStatsOps);
 }
 
 void IPFIXExporter::close()
@@ -247,6 +369,12 @@ void IPFIXExporter::close()
 	/* Try to flush any remaining data */
 	flush();
 
+	/* Let the sender send the queued data before the socket is closed, keep it for telemetry */
+	if (sender != nullptr) {
+		sender->stop();
+		m_flows_dropped += sender->take_dropped_flows();
+	}
+
 	/* Close the connection */
 	if (fd != -1) {
 		::close(fd);
@@ -263,25 +391,42 @@ void IPFIXExporter::close()
 		tmp = templates;
 	}
 	templates = nullptr;
+	tmpltCache.assign(TEMPLATE_CACHE_SIZE, TmpltCacheSlot());
+	tmpltCacheCount = 0;
 
-	packetDataBuffer.close();
+	/* Shards flush and disconnect themselves */
+	shards.clear();
 
-	if (extensions != nullptr) {
-		delete[] extensions;
-		extensions = nullptr;
-	}
+	packetDataBuffer.close();
 }
 
 uint64_t IPFIXExporter::get_template_id(const Record& flow)
 {
-	RecordExt* ext = flow.m_exts;
-	uint64_t tmpltIdx = 0;
-	while (ext != nullptr) {
-		tmpltIdx |= ((uint64_t) 1 << ext->m_ext_id);
-		ext = ext->m_next;
+	return flow.m_ext_mask;
+}
+
+/**
+ * \brief Find slot of the extension bitmask or the free slot where it belongs
+ */
+IPFIXExporter::TmpltCacheSlot* IPFIXExporter::find_template_slot(uint64_t extMask)
+{
+	const size_t mask = tmpltCache.size() - 1;
+	size_t idx = (extMask * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+	while (tmpltCache[idx].tmplt[TMPLT_IDX_V4] != nullptr && tmpltCache[idx].extMask != extMask) {
+		idx = (idx + 1) & mask;
 	}
+	return &tmpltCache[idx];
+}
 
-	return tmpltIdx;
+void IPFIXExporter::grow_template_cache()
+{
+	std::vector<TmpltCacheSlot> old(tmpltCache.size() * 2);
+	old.swap(tmpltCache);
+	for (const auto& slot : old) {
+		if (slot.tmplt[TMPLT_IDX_V4] != nullptr) {
+			*find_template_slot(slot.extMask) = slot;
+		}
+	}
 }
 
 template_t* IPFIXExporter::get_template(const Flow& flow)
@@ -289,92 +434,84 @@ template_t* IPFIXExporter::get_template(const Flow& flow)
 	int ipTmpltIdx = flow.ip_version == IP::v6 ? TMPLT_IDX_V6 : TMPLT_IDX_V4;
 	uint64_t tmpltIdx = get_template_id(flow);
 
-	if (tmpltMap[ipTmpltIdx].find(tmpltIdx) == tmpltMap[ipTmpltIdx].end()) {
-		std::vector<const char*> all_fields;
-
-		RecordExt* ext = flow.m_exts;
-		while (ext != nullptr) {
-			if (ext->m_ext_id < 0 || ext->m_ext_id >= extension_cnt) {
-				throw PluginError("encountered invalid extension id");
-			}
-			extensions[ext->m_ext_id] = ext;
-			ext = ext->m_next;
-		}
-		for (int i = 0; i < extension_cnt; i++) {
-			if (extensions[i] == nullptr) {
-				continue;
-			}
-			const char** fields = extensions[i]->get_ipfix_tmplt();
-			extensions[i] = nullptr;
-			if (fields == nullptr) {
-				throw PluginError(
-					"missing template fields for extension with ID " + std::to_string(i));
-			}
-			while (*fields != nullptr) {
-				all_fields.push_back(*fields);
-				fields++;
-			}
-		}
-		all_fields.push_back(nullptr);
-
-		tmpltMap[TMPLT_IDX_V4][tmpltIdx] = create_template(basic_tmplt_v4, all_fields.data());
-		tmpltMap[TMPLT_IDX_V6][tmpltIdx] = create_template(basic_tmplt_v6, all_fields.data());
+	TmpltCacheSlot* slot = find_template_slot(tmpltIdx);
+	if (slot->tmplt[TMPLT_IDX_V4] != nullptr) {
+		return slot->tmplt[ipTmpltIdx];
 	}
 
-	return tmpltMap[ipTmpltIdx][tmpltIdx];
-}
+	std::vector<const char*> all_fields;
+	uint8_t extIDs[Record::MAX_EXTENSION_CNT];
+	uint8_t extCount = 0;
 
-int IPFIXExporter::fill_extensions(RecordExt* ext, uint8_t* buffer, int size)
-{
-	int length = 0;
-	int extCnt = 0;
-	while (ext != nullptr) {
-		extensions[ext->m_ext_id] = ext;
-		extCnt++;
-		ext = ext->m_next;
+	if (extension_cnt < Record::MAX_EXTENSION_CNT && tmpltIdx >> extension_cnt != 0) {
+		throw PluginError("encountered invalid extension id");
 	}
-	// TODO: export multiple extension header of same type
-	for (int i = 0; i < extension_cnt; i++) {
-		if (extensions[i] == nullptr) {
-			continue;
+	for (uint64_t mask = tmpltIdx; mask != 0; mask &= mask - 1) {
+		const int i = __builtin_ctzll(mask);
+		const char** fields = flow.get_extension(i)->get_ipfix_tmplt();
+		if (fields == nullptr) {
+			throw PluginError("missing template fields for extension with ID " + std::to_string(i));
 		}
-		int length_ext = extensions[i]->fill_ipfix(buffer + length, size - length);
-		extensions[i] = nullptr;
-		if (length_ext < 0) {
-			for (int j = i; j < extension_cnt; j++) {
-				extensions[j] = nullptr;
-			}
-			return -1;
+		while (*fields != nullptr) {
+			all_fields.push_back(*fields);
+			fields++;
 		}
-		length += length_ext;
+		extIDs[extCount++] = i;
 	}
-	return length;
+	all_fields.push_back(nullptr);
+
+	template_t* tmplt[TMPLT_MAP_IDX_CNT];
+	tmplt[TMPLT_IDX_V4] = create_template(basic_tmplt_v4, all_fields.data());
+	tmplt[TMPLT_IDX_V6] = create_template(basic_tmplt_v6, all_fields.data());
+	if (tmplt[TMPLT_IDX_V4] == nullptr || tmplt[TMPLT_IDX_V6] == nullptr) {
+		throw PluginError("unable to create IPFIX template");
+	}
+	for (template_t* it : tmplt) {
+		memcpy(it->extIDs, extIDs, extCount);
+		it->extCount = extCount;
+	}
+
+	// Keep the load factor at most 1/2
+	if (2 * (tmpltCacheCount + 1) > tmpltCache.size()) {
+		grow_template_cache();
+		slot = find_template_slot(tmpltIdx);
+	}
+	slot->extMask = tmpltIdx;
+	slot->tmplt[TMPLT_IDX_V4] = tmplt[TMPLT_IDX_V4];
+	slot->tmplt[TMPLT_IDX_V6] = tmplt[TMPLT_IDX_V6];
+	tmpltCacheCount++;
+
+	return tmplt[ipTmpltIdx];
 }
 
+/**
+ * \brief Serialize flow to the template buffer
+ *
+ * Space for the record with empty variable-length fields is checked once, extensions check only
+ * their variable-length data.
+ *
+ * @param flow Flow to serialize
+ * @param tmplt Template of the flow
+ * @return False when the record does not fit to the buffer
+ */
 bool IPFIXExporter::fill_template(const Flow& flow, template_t* tmplt)
 {
-	RecordExt* ext = flow.m_exts;
-	int length = 0;
+	if (tmplt->bufferSize + tmplt->minRecordSize > tmpltMaxBufferSize) {
+		return false;
+	}
 
-	if (basic_ifc_num >= 0 && ext == nullptr) {
-		length = fill_basic_flow(flow, tmplt);
-		if (length < 0) {
-			return false;
-		}
-	} else {
-		length = fill_basic_flow(flow, tmplt);
-		if (length < 0) {
-			return false;
-		}
+	int length = fill_basic_flow(flow, tmplt);
+	uint8_t* buffer = tmplt->buffer + tmplt->bufferSize;
+	const int size = tmpltMaxBufferSize - tmplt->bufferSize;
 
-		int ext_written = fill_extensions(
-			ext,
-			tmplt->buffer + tmplt->bufferSize + length,
-			tmpltMaxBufferSize - tmplt->bufferSize - length);
-		if (ext_written < 0) {
+	// TODO: export multiple extension header of same type
+	for (uint8_t i = 0; i < tmplt->extCount; i++) {
+		RecordExt* ext = flow.get_extension(tmplt->extIDs[i]);
+		int length_ext = ext->fill_ipfix(buffer + length, size - length);
+		if (length_ext < 0) {
 			return false;
 		}
-		length += ext_written;
+		length += length_ext;
 	}
 
 	tmplt->bufferSize += length;
@@ -382,10 +519,15 @@ bool IPFIXExporter::fill_template(const Flow& flow, template_t* tmplt)
 	return true;
 }
 
-int IPFIXExporter::export_flow(const Flow& flow)
+/**
+ * \brief Add flow to the template buffer, flush buffers when the template is full
+ *
+ * @param flow Flow to add
+ * @param tmplt Template of the flow
+ * @return 0 on success, 1 when the flow was dropped
+ */
+int IPFIXExporter::add_flow(const Flow& flow, template_t* tmplt)
 {
-	m_flows_seen++;
-	template_t* tmplt = get_template(flow);
 	if (!fill_template(flow, tmplt)) {
 		flush();
 
@@ -397,6 +539,142 @@ int IPFIXExporter::export_flow(const Flow& flow)
 	return 0;
 }
 
+/**
+ * \brief Hash flow key with the endpoints in canonical order
+ *
+ * Flow hash of the storage plugin is computed from the key of the first packet, so the two
+ * unidirectional records of a connection exported with split biflows have different hashes.
+ *
+ * @return Hash which does not depend on the flow direction
+ */
+static uint64_t flow_shard_hash(const Flow& flow)
+{
+	const size_t ipLen = flow.ip_version == IP::v6 ? 16 : 4;
+	const uint8_t* lowIp = flow.src_ip.v6;
+	const uint8_t* highIp = flow.dst_ip.v6;
+	uint16_t lowPort = flow.src_port;
+	uint16_t highPort = flow.dst_port;
+	const int cmp = memcmp(lowIp, highIp, ipLen);
+	if (cmp > 0 || (cmp == 0 && lowPort > highPort)) {
+		std::swap(lowIp, highIp);
+		std::swap(lowPort, highPort);
+	}
+
+	// Key is zero padded to whole words, IPv4 endpoints leave the rest of the addresses zero
+	uint64_t key[5] = {};
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(key);
+	memcpy(ptr, lowIp, ipLen);
+	memcpy(ptr + 16, highIp, ipLen);
+	memcpy(ptr + 32, &lowPort, sizeof(lowPort));
+	memcpy(ptr + 34, &highPort, sizeof(highPort));
+	ptr[36] = flow.ip_proto;
+
+	uint64_t hash = flow.ip_version;
+	for (uint64_t word : key) {
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+/**
+ * \brief Select shard of the flow
+ *
+ * Both directions of a connection go to the same collector, also when they are exported as
+ * separate records. With failover, flows of a disconnected collector go to the next connected one.
+ *
+ * @return Index of the shard
+ */
+size_t IPFIXExporter::select_shard(const Flow& flow)
+{
+	const size_t idx = flow_shard_hash(flow) % shards.size();
+	if (!failover || shards[idx]->is_connected()) {
+		return idx;
+	}
+
+	for (size_t i = 1; i < shards.size(); i++) {
+		const size_t next = (idx + i) % shards.size();
+		if (shards[next]->is_connected()) {
+			return next;
+		}
+	}
+	return idx;
+}
+
+/**
+ * \brief Check whether the collector is connected
+ */
+bool IPFIXExporter::is_connected()
+{
+	return fd != -1 && (sender == nullptr || !sender->is_broken());
+}
+
+/**
+ * \brief Sum drops of shards, flows are counted as seen when they are distributed
+ */
+void IPFIXExporter::update_shard_stats()
+{
+	uint64_t dropped = 0;
+	for (const auto& shard : shards) {
+		dropped += shard->m_flows_dropped;
+	}
+	m_flows_dropped = dropped;
+}
+
+int IPFIXExporter::export_flow(const Flow& flow)
+{
+	if (!shards.empty()) {
+		m_flows_seen++;
+		const int ret = shards[select_shard(flow)]->export_flow(flow);
+		update_shard_stats();
+		return ret;
+	}
+
+	m_flows_seen++;
+	return add_flow(flow, get_template(flow));
+}
+
+void IPFIXExporter::export_flows(Flow* const* flows, size_t count)
+{
+	template_t* tmplt = nullptr;
+	uint64_t tmpltIdx = 0;
+	uint8_t ipVersion = 0;
+
+	if (!shards.empty()) {
+		m_flows_seen += count;
+		for (auto& list : shardFlows) {
+			list.clear();
+		}
+		for (size_t i = 0; i < count; i++) {
+			shardFlows[select_shard(*flows[i])].push_back(flows[i]);
+		}
+		for (size_t i = 0; i < shards.size(); i++) {
+			if (!shardFlows[i].empty()) {
+				shards[i]->export_flows(shardFlows[i].data(), shardFlows[i].size());
+			}
+		}
+		update_shard_stats();
+		return;
+	}
+
+	m_flows_seen += count;
+	for (size_t i = 0; i < count; i++) {
+		const Flow& flow = *flows[i];
+		if (i + 1 < count) {
+			__builtin_prefetch(flows[i + 1]);
+		}
+
+		/* Consecutive flows usually share the template, skip the template map lookup */
+		const uint64_t flowTmpltIdx = get_template_id(flow);
+		if (tmplt == nullptr || flowTmpltIdx != tmpltIdx || flow.ip_version != ipVersion) {
+			tmplt = get_template(flow);
+			tmpltIdx = flowTmpltIdx;
+			ipVersion = flow.ip_version;
+		}
+		add_flow(flow, tmplt);
+	}
+}
+
 /**
  * \brief Initialise buffer for record with Data Set Header
  *
@@ -557,6 +835,8 @@ template_t* IPFIXExporter::create_template(const char** tmplt, const char** ext)
 
 	newTemplate->fieldCount = 0;
 	newTemplate->recordCount = 0;
+	newTemplate->minRecordSize = 0;
+	newTemplate->extCount = 0;
 	newTemplate->buffer = (uint8_t*) malloc(sizeof(uint8_t) * tmpltMaxBufferSize);
 	if (!newTemplate->buffer) {
 		free(newTemplate);
@@ -616,6 +896,8 @@ template_t* IPFIXExporter::create_template(const char** tmplt, const char** ext)
 
 				/* Update template size */
 				newTemplate->templateSize += 4;
+				/* Variable-length field takes at least its 1 byte length */
+				newTemplate->minRecordSize += tmpFileRecord->length > 0 ? len : 1;
 
 				/* Add enterprise number if required */
 				if (tmpFileRecord->enterpriseNumber != 0) {
@@ -803,7 +1085,10 @@ void IPFIXExporter::send_templates()
 		/* Send template packet */
 		/* After error, the plugin sends all templates after reconnection,
 		 * so we need not concern about it here */
-		send_packet(&pkt);
+		if (send_packet(&pkt) != 0 && sender != nullptr && fd != -1) {
+			/* Dropped from the full send queue, send them again next time */
+			expire_templates();
+		}
 	}
 }
 
@@ -814,6 +1099,11 @@ void IPFIXExporter::send_data()
 {
 	ipfix_packet_t pkt;
 
+	if (protocol == IPPROTO_UDP) {
+		send_data_batch();
+		return;
+	}
+
 	/* Send all new templates
 	 * Loop ends when len = create_data_packet() is 0
 	 */
@@ -834,20 +1124,242 @@ void IPFIXExporter::send_data()
 			/* Collector reconnected, resend the packet */
 			ret = send_packet(&pkt);
 		}
-		if (ret != 0) {
+		if (ret != 0 && !spool_packet(pkt.data, pkt.length, pkt.flows)) {
 			m_flows_dropped += pkt.flows;
 		}
 	}
 }
 
+/**
+ * \brief Store data message which could not be sent to the spool
+ *
+ * @return False when there is no spool or the message does not fit in it
+ */
+bool IPFIXExporter::spool_packet(const uint8_t* data, size_t len, uint32_t flows)
+{
+	if (spool == nullptr) {
+		return false;
+	}
+
+	const bool spooled = spool->push(data, len, flows);
+	/* Records of the overwritten messages are lost */
+	m_flows_dropped += spool->take_dropped_flows();
+	return spooled;
+}
+
+/**
+ * \brief Send spooled messages, at most spoolRate messages per second
+ *
+ * Messages are renumbered to follow the records sent on the current connection. Templates they
+ * refer to are never removed and are sent again after every reconnect.
+ */
+void IPFIXExporter::replay_spool()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const double elapsed = std::chrono::duration<double>(now - spoolLastReplay).count();
+	spoolLastReplay = now;
+	/* Allow bursts of at most one second worth of messages */
+	spoolCredit = std::min(spoolCredit + elapsed * spoolRate, (double) spoolRate);
+
+	const uint8_t* data;
+	size_t len;
+	uint32_t flows;
+	while (fd != -1 && spoolCredit >= 1 && spool->front(data, len, flows)) {
+		ipfix_packet_t pkt;
+		pkt.data = packetDataBuffer.getWriteBufferOrReset(len);
+		if (!pkt.data) {
+			return;
+		}
+		memcpy(pkt.data, data, len);
+		((ipfix_header_t*) pkt.data)->sequenceNumber = htonl(sequenceNum);
+		pkt.length = len;
+		pkt.flows = flows;
+
+		int ret = send_packet(&pkt);
+		if (ret == 1) {
+			/* Collector reconnected, resend the packet */
+			ret = send_packet(&pkt);
+		}
+		if (ret != 0) {
+			/* Keep the message spooled */
+			packetDataBuffer.shrinkTo(0);
+			return;
+		}
+
+		spool->pop();
+		spoolCredit -= 1;
+		spoolReplayedMessages++;
+	}
+}
+
+/**
+ * \brief Check whether send error means that the connection is broken
+ */
+static bool is_connection_error(int err)
+{
+	switch (err) {
+	case ECONNRESET:
+	case EINTR:
+	case ENOTCONN:
+	case ENOTSOCK:
+	case EPIPE:
+	case EHOSTUNREACH:
+	case ENETDOWN:
+	case ENETUNREACH:
+	case ENOBUFS:
+	case ENOMEM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * \brief Close broken connection, the next send reconnects immediately
+ */
+void IPFIXExporter::close_connection()
+{
+	/* free resources */
+	::close(fd);
+	fd = -1;
+	freeaddrinfo(addrinfo);
+	addrinfo = nullptr;
+
+	/* Set last connection try time so that we would reconnect immediatelly */
+	lastReconnect = 1;
+
+	/* Reset the sequences number since it is unique per connection */
+	sequenceNum = 0;
+}
+
+/**
+ * \brief Send data in all buffers to collector, UDP messages are sent in batches
+ */
+void IPFIXExporter::send_data_batch()
+{
+	size_t count;
+
+	do {
+		/* Fill the batch, loop ends when create_data_packet() is 0 */
+		for (count = 0; count < UDP_BATCH_SIZE; count++) {
+			ipfix_packet_t pkt;
+			pkt.data = &udpBatchData[count * mtu];
+			if (create_data_packet(&pkt) == 0) {
+				break;
+			}
+			udpBatchIov[count].iov_base = pkt.data;
+			udpBatchIov[count].iov_len = pkt.length;
+			udpBatchFlows[count] = pkt.flows;
+		}
+
+		if (count > 0) {
+			send_batch(count);
+		}
+	} while (count == UDP_BATCH_SIZE);
+}
+
+/**
+ * \brief Send batch of UDP messages with sendmmsg()
+ *
+ * Every message keeps its own sequence number. Messages which could not be sent are dropped.
+ *
+ * \param count Number of messages in the batch
+ */
+void IPFIXExporter::send_batch(size_t count)
+{
+	size_t sent = 0;
+	bool reconnected = false;
+
+	while (sent < count && reconnect() == 0) {
+		/* Sequence numbers of the messages follow the records sent so far */
+		uint32_t seq = sequenceNum;
+		for (size_t i = sent; i < count; i++) {
+			((ipfix_header_t*) udpBatchIov[i].iov_base)->sequenceNumber = htonl(seq);
+			seq += udpBatchFlows[i];
+
+			struct msghdr* hdr = &udpBatchMsgs[i].msg_hdr;
+			memset(hdr, 0, sizeof(*hdr));
+			hdr->msg_name = addrinfo->ai_addr;
+			hdr->msg_namelen = addrinfo->ai_addrlen;
+			hdr->msg_iov = &udpBatchIov[i];
+			hdr->msg_iovlen = 1;
+		}
+
+		int ret = sendmmsg(fd, &udpBatchMsgs[sent], count - sent, 0);
+		udpSendCalls++;
+		if (ret == -1) {
+			if (errno == EAGAIN) {
+				continue;
+			}
+			if (!reconnected && is_connection_error(errno)) {
+				if (verbose) {
+					fprintf(stderr, "VERBOSE: Collector closed connection\n");
+				}
+				/* Try to connect and send the rest of the batch again */
+				close_connection();
+				reconnected = true;
+				continue;
+			}
+			if (verbose) {
+				perror("VERBOSE: Cannot send data to collector");
+			}
+			break;
+		}
+
+		for (int i = 0; i < ret; i++) {
+			sequenceNum += udpBatchFlows[sent + i];
+		}
+		sent += ret;
+		exportedPackets += ret;
+		udpSentMessages += ret;
+	}
+
+	for (size_t i = sent; i < count; i++) {
+		const auto* data = static_cast<const uint8_t*>(udpBatchIov[i].iov_base);
+		if (!spool_packet(data, udpBatchIov[i].iov_len, udpBatchFlows[i])) {
+			m_flows_dropped += udpBatchFlows[i];
+		}
+	}
+	udpDroppedMessages += count - sent;
+
+	if (verbose) {
+		fprintf(
+			stderr,
+			"VERBOSE: %zu of %zu packets sent to %s on port %" PRIu16
+			". Next sequence number is %i\n",
+			sent,
+			count,
+			host.c_str(),
+			port,
+			sequenceNum);
+	}
+}
+
 /**
  * \brief Export stored flows.
  */
 void IPFIXExporter::flush()
 {
+	if (!shards.empty()) {
+		for (auto& shard : shards) {
+			shard->flush();
+		}
+		update_shard_stats();
+		return;
+	}
+
+	if (sender != nullptr) {
+		check_sender();
+	}
+
 	/* Send all new templates */
 	send_templates();
 
+	/* Send older messages first, replay is rate limited not to overload the collector */
+	if (spool != nullptr && !spool->empty()) {
+		replay_spool();
+	}
+
 	/* Send the data packet */
 	send_data();
 }
@@ -868,6 +1380,10 @@ int IPFIXExporter::send_packet(ipfix_packet_t* packet)
 	int ret; /* Return value of sendto */
 	int sent = 0; /* Sent data size */
 
+	if (sender != nullptr) {
+		return queue_packet(packet);
+	}
+
 	/* Check that connection is OK or drop packet */
 	if (reconnect()) {
 		return -1;
@@ -889,46 +1405,25 @@ int IPFIXExporter::send_packet(ipfix_packet_t* packet)
 
 		/* Check that the data were sent correctly */
 		if (ret == -1) {
-			switch (errno) {
-			case 0:
-				break; /* OK */
-			case ECONNRESET:
-			case EINTR:
-			case ENOTCONN:
-			case ENOTSOCK:
-			case EPIPE:
-			case EHOSTUNREACH:
-			case ENETDOWN:
-			case ENETUNREACH:
-			case ENOBUFS:
-			case ENOMEM:
-
+			if (errno == 0) {
+				/* OK */
+			} else if (is_connection_error(errno)) {
 				/* The connection is broken */
 				if (verbose) {
 					fprintf(stderr, "VERBOSE: Collector closed connection\n");
 				}
 
-				/* free resources */
-				::close(fd);
-				fd = -1;
-				freeaddrinfo(addrinfo);
-				addrinfo = nullptr;
-
-				/* Set last connection try time so that we would reconnect immediatelly */
-				lastReconnect = 1;
-
-				/* Reset the sequences number since it is unique per connection */
-				sequenceNum = 0;
+				close_connection();
 				((ipfix_header_t*) packetDataBuffer.reviveLast())->sequenceNumber
 					= 0; /* no need to change byteorder of 0 */
 
 				/* Say that we should try to connect and send data again */
 				return 1;
-			case EAGAIN:
+			} else if (errno == EAGAIN) {
 				// EAGAIN is returned when the socket is non-blocking and the send buffer is full
 				// possible wait and stop flag check
 				continue;
-			default:
+			} else {
 				/* Unknown error */
 				if (verbose) {
 					perror("VERBOSE: Cannot send data to collector");
@@ -1034,6 +1529,55 @@ static int connect_non_blocking(int fd, struct addrinfo* addr_info, bool verbose
 	return -1;
 }
 
+/**
+ * \brief Pass packet to the sender thread
+ *
+ * The packet data is taken from the packetDataBuffer. The packet is dropped when the send queue
+ * is full or the collector is disconnected, the sender is never waited for.
+ *
+ * \param packet Packet to send
+ * \return 0 on success, -1 when the packet was dropped, -2 on compress error
+ */
+int IPFIXExporter::queue_packet(ipfix_packet_t* packet)
+{
+	auto dataLen = packetDataBuffer.compress();
+	if (dataLen < 0) {
+		return -2;
+	}
+
+	if (fd == -1 || !sender->push(packetDataBuffer.getCompressed(), dataLen, packet->flows)) {
+		/* Compressed stream would continue from the dropped block, start a new one */
+		packetDataBuffer.requestConnectionReset();
+		return -1;
+	}
+
+	/* Update sequence number for next packet */
+	sequenceNum += packet->flows;
+
+	/* Increase packet counter */
+	exportedPackets++;
+
+	return 0;
+}
+
+/**
+ * \brief Collect drops of the sender thread and reconnect when it lost the connection
+ */
+void IPFIXExporter::check_sender()
+{
+	m_flows_dropped += sender->take_dropped_flows();
+
+	if (fd != -1 && sender->is_broken()) {
+		if (verbose) {
+			fprintf(stderr, "VERBOSE: Collector closed connection\n");
+		}
+		close_connection();
+		packetDataBuffer.requestConnectionReset();
+	}
+
+	reconnect();
+}
+
 /**
  * \brief Create connection to collector
  *
@@ -1129,6 +1673,9 @@ int IPFIXExporter::connect_to_collector()
 		if (verbose) {
 			fprintf(stderr, "VERBOSE: Successfully connected to collector\n");
 		}
+		if (sender != nullptr) {
+			sender->start(fd);
+		}
 		break;
 	}
 
@@ -1464,8 +2011,8 @@ void CompressBuffer::close()
 /**
  * \brief Fill template buffer with flow.
  * @param flow Flow
- * @param tmplt Template containing buffer
- * @return Number of written bytes or -1 if buffer is not big enough
+ * @param tmplt Template containing buffer, space for the record was checked by the caller
+ * @return Number of written bytes
  */
 int IPFIXExporter::fill_basic_flow(const Flow& flow, template_t* tmplt)
 {
@@ -1476,10 +2023,6 @@ int IPFIXExporter::fill_basic_flow(const Flow& flow, template_t* tmplt)
 	buffer = tmplt->buffer + tmplt->bufferSize;
 	p = buffer;
 	if (flow.ip_version == IP::v4) {
-		if (tmplt->bufferSize + GENERATE_FIELDS_SUMLEN(BASIC_TMPLT_V4) > tmpltMaxBufferSize) {
-			return -1;
-		}
-
 		/* Temporary disable warnings about breaking string-aliasing, since it is produced by
 		 * if-branches that are never going to be used - generated by C-preprocessor.
 		 */
@@ -1494,10 +2037,6 @@ int IPFIXExporter::fill_basic_flow(const Flow& flow, template_t* tmplt)
 #endif
 
 	} else {
-		if (tmplt->bufferSize + GENERATE_FIELDS_SUMLEN(BASIC_TMPLT_V6) > tmpltMaxBufferSize) {
-			return -1;
-		}
-
 		/* Temporary disable warnings about breaking string-aliasing, since it is produced by
 		 * if-branches that are never going to be used - generated by C-preprocessor.
 		 */
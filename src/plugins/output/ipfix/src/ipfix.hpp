@@ -14,8 +14,14 @@
 
 #pragma once
 
+#include "ipfix-sender.hpp"
+#include "ipfix-spool.hpp"
+
+#include <chrono>
 #include <cstdint>
-#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include <ipfixprobe/flowifc.hpp>
@@ -25,6 +31,8 @@
 #include <ipfixprobe/processPlugin.hpp>
 #include <ipfixprobe/utils.hpp>
 #include <lz4.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #define COUNT_IPFIX_TEMPLATES(T) +1
 
@@ -41,13 +49,19 @@
 #define RECONNECT_TIMEOUT 60
 #define TEMPLATE_REFRESH_TIME 600
 #define TEMPLATE_REFRESH_PACKETS 0
+#define TEMPLATE_CACHE_SIZE 64 // Initial number of template cache slots, power of 2
+#define UDP_BATCH_SIZE 32 // IPFIX messages sent by one sendmmsg() call
+#define SENDER_QUEUE_SIZE (4 * 1024 * 1024) // Bytes of TCP messages waiting for the sender
+#define SENDER_DRAIN_TIMEOUT 5 // Seconds given to the sender to send queued messages on exit
+#define SPOOL_SIZE (64 * 1024 * 1024) // Default size of the spool file
+#define SPOOL_REPLAY_RATE 1000 // Default number of spooled messages replayed per second
 
 namespace ipxp {
 
 class IpfixOptParser : public OptionsParser {
 public:
-	std::string m_host;
-	uint16_t m_port;
+	std::vector<std::string> m_hosts; /**< Collectors, flows are sharded among them */
+	std::vector<uint16_t> m_ports; /**< Port of every collector or one port of all of them */
 	uint16_t m_mtu;
 	bool m_udp;
 	bool m_non_blocking_tcp;
@@ -57,11 +71,16 @@ public:
 	bool m_verbose;
 	int m_lz4_buffer_size;
 	bool m_lz4_compression;
+	uint32_t m_sender_queue_size;
+	std::string m_spool_path;
+	uint64_t m_spool_size;
+	uint32_t m_spool_rate;
+	bool m_failover;
 
 	IpfixOptParser()
 		: OptionsParser("ipfix", "Output plugin for ipfix export")
-		, m_host("127.0.0.1")
-		, m_port(4739)
+		, m_hosts({"127.0.0.1"})
+		, m_ports({4739})
 		, m_mtu(DEFAULT_MTU)
 		, m_udp(false)
 		, m_non_blocking_tcp(false)
@@ -71,29 +90,47 @@ public:
 		, m_verbose(false)
 		, m_lz4_buffer_size(0)
 		, m_lz4_compression(false)
+		, m_sender_queue_size(SENDER_QUEUE_SIZE)
+		, m_spool_path("")
+		, m_spool_size(SPOOL_SIZE)
+		, m_spool_rate(SPOOL_REPLAY_RATE)
+		, m_failover(false)
 	{
 		register_option(
 			"h",
 			"host",
-			"ADDR",
-			"Remote collector address",
+			"ADDR[,ADDR...]",
+			"Remote collector address, flows are distributed among multiple collectors",
 			[this](const char* arg) {
-				m_host = arg;
-				return true;
+				m_hosts.clear();
+				std::istringstream list(arg);
+				std::string host;
+				while (std::getline(list, host, ',')) {
+					if (host.empty()) {
+						return false;
+					}
+					m_hosts.push_back(host);
+				}
+				return !m_hosts.empty();
 			},
 			OptionFlags::RequiredArgument);
 		register_option(
 			"p",
 			"port",
-			"PORT",
-			"Remote collector port",
+			"PORT[,PORT...]",
+			"Remote collector port, one for every collector or one for all of them",
 			[this](const char* arg) {
-				try {
-					m_port = str2num<decltype(m_port)>(arg);
-				} catch (std::invalid_argument& e) {
-					return false;
+				m_ports.clear();
+				std::istringstream list(arg);
+				std::string port;
+				while (std::getline(list, port, ',')) {
+					try {
+						m_ports.push_back(str2num<uint16_t>(port));
+					} catch (std::invalid_argument& e) {
+						return false;
+					}
 				}
-				return true;
+				return !m_ports.empty();
 			},
 			OptionFlags::RequiredArgument);
 		register_option(
@@ -210,6 +247,69 @@ public:
 				return true;
 			},
 			OptionFlags::RequiredArgument);
+		register_option(
+			"q",
+			"sender-queue",
+			"SIZE",
+			"Size of the TCP send queue in bytes, 0 sends from the output thread (default 4194304)",
+			[this](const char* arg) {
+				try {
+					m_sender_queue_size = str2num<decltype(m_sender_queue_size)>(arg);
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+				return true;
+			},
+			OptionFlags::RequiredArgument);
+		register_option(
+			"f",
+			"spool",
+			"PATH",
+			"Spool file keeping messages which could not be sent to the collector",
+			[this](const char* arg) {
+				m_spool_path = arg;
+				return true;
+			},
+			OptionFlags::RequiredArgument);
+		register_option(
+			"z",
+			"spool-size",
+			"SIZE",
+			"Size of the spool file in bytes (default 67108864)",
+			[this](const char* arg) {
+				try {
+					m_spool_size = str2num<decltype(m_spool_size)>(arg);
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+				return true;
+			},
+			OptionFlags::RequiredArgument);
+		register_option(
+			"r",
+			"spool-rate",
+			"NUM",
+			"Spooled messages replayed per second (default 1000)",
+			[this](const char* arg) {
+				try {
+					m_spool_rate = str2num<decltype(m_spool_rate)>(arg);
+				} catch (std::invalid_argument& e) {
+					return false;
+				}
+				return m_spool_rate > 0;
+			},
+			OptionFlags::RequiredArgument);
+		register_option(
+			"F",
+			"failover",
+			"",
+			"Send flows of a disconnected collector to the next connected one",
+			[this](const char* arg) {
+				(void) arg;
+				m_failover = true;
+				return true;
+			},
+			OptionFlags::NoArgument);
 	}
 };
 
@@ -234,6 +334,9 @@ typedef struct template_t {
 	uint8_t exported; /**< 1 indicates that the template was exported to collector*/
 	time_t exportTime; /**< Time when the template was last exported */
 	uint64_t exportPacket; /**< Number of packet when the template was last exported */
+	uint16_t minRecordSize; /**< Record size with variable-length fields empty */
+	uint8_t extCount; /**< Number of extensions in the record */
+	uint8_t extIDs[Record::MAX_EXTENSION_CNT]; /**< Extensions in the order of export */
 	struct template_t* next;
 } template_t;
 
@@ -565,16 +668,38 @@ public:
 	OptionsParser* get_parser() const { return new IpfixOptParser(); }
 	std::string get_name() const { return "ipfix"; }
 	int export_flow(const Flow& flow);
+	void export_flows(Flow* const* flows, size_t count);
+	void set_telemetry_dirs(std::shared_ptr<telemetry::Directory> output_dir) override;
 
 private:
+	/* Sharding, exporter with multiple collectors only distributes flows to its shards */
+	std::vector<std::unique_ptr<IPFIXExporter>> shards; /**< Exporter of every collector */
+	std::vector<std::vector<Flow*>> shardFlows; /**< Flows of export_flows() by shard */
+	bool failover; /**< Flows of disconnected shards go to the next connected one */
+
+	IPFIXExporter();
+	IPFIXExporter(const IpfixOptParser& parser, size_t shard);
+	void configure(const IpfixOptParser& parser, size_t shard);
+	size_t select_shard(const Flow& flow);
+	bool is_connected();
+	void update_shard_stats();
+
 	/* Templates */
 	enum TmpltMapIdx { TMPLT_IDX_V4 = 0, TMPLT_IDX_V6 = 1, TMPLT_MAP_IDX_CNT };
-	RecordExt** extensions;
+
+	/**
+	 * \brief Slot of the template cache, templates of one extension bitmask.
+	 */
+	struct TmpltCacheSlot {
+		uint64_t extMask;
+		template_t* tmplt[TMPLT_MAP_IDX_CNT]; /**< nullptr in free slots */
+	};
+
 	int extension_cnt;
-	std::map<uint64_t, template_t*> tmpltMap[TMPLT_MAP_IDX_CNT];
+	std::vector<TmpltCacheSlot> tmpltCache; /**< Open addressing, linear probing */
+	size_t tmpltCacheCount; /**< Number of used slots */
 	template_t* templates; /**< Templates in use by plugin */
 	uint16_t templatesDataSize; /**< Total data size stored in templates */
-	int basic_ifc_num;
 	bool verbose;
 
 	uint32_t sequenceNum; /**< Number of exported flows */
@@ -592,6 +717,25 @@ private:
 
 	CompressBuffer packetDataBuffer;
 
+	/* UDP data messages are sent in batches */
+	std::vector<uint8_t> udpBatchData; /**< Messages of the batch, mtu bytes each */
+	std::vector<struct mmsghdr> udpBatchMsgs;
+	std::vector<struct iovec> udpBatchIov;
+	std::vector<uint32_t> udpBatchFlows; /**< Number of records in every message */
+	uint64_t udpSendCalls; /**< Number of sendmmsg() calls */
+	uint64_t udpSentMessages; /**< Number of messages sent by sendmmsg() */
+	uint64_t udpDroppedMessages; /**< Number of messages which could not be sent */
+
+	/** TCP sender thread, nullptr when sending from the output thread */
+	std::unique_ptr<IpfixSender> sender;
+
+	/** Spool of messages which could not be sent, nullptr when disabled */
+	std::unique_ptr<IpfixSpool> spool;
+	uint32_t spoolRate; /**< Replayed messages per second */
+	double spoolCredit; /**< Number of messages which can be replayed now */
+	std::chrono::steady_clock::time_point spoolLastReplay;
+	uint64_t spoolReplayedMessages; /**< Number of messages replayed from the spool */
+
 	uint32_t reconnectTimeout; /**< Timeout between connection retries */
 	time_t lastReconnect; /**< Time in seconds of last connection retry */
 	uint32_t odid; /**< Observation Domain ID */
@@ -609,17 +753,26 @@ private:
 	template_file_record_t* get_template_record_by_name(const char* name);
 	void expire_templates();
 	template_t* create_template(const char** tmplt, const char** ext);
+	TmpltCacheSlot* find_template_slot(uint64_t extMask);
+	void grow_template_cache();
 	uint16_t create_template_packet(ipfix_packet_t* packet);
 	uint16_t create_data_packet(ipfix_packet_t* packet);
 	void send_templates();
 	void send_data();
+	void send_data_batch();
+	void send_batch(size_t count);
 	int send_packet(ipfix_packet_t* packet);
+	int queue_packet(ipfix_packet_t* packet);
+	bool spool_packet(const uint8_t* data, size_t len, uint32_t flows);
+	void replay_spool();
+	void check_sender();
+	void close_connection();
 	int connect_to_collector();
 	int reconnect();
 	int fill_basic_flow(const Flow& flow, template_t* tmplt);
-	int fill_extensions(RecordExt* ext, uint8_t* buffer, int size);
 
 	uint64_t get_template_id(const Record& flow);
+	int add_flow(const Flow& flow, template_t* tmplt);
 	template_t* get_template(const Flow& flow);
 	bool fill_template(const Flow& flow, template_t* tmplt);
 	void flush();
@@ -29,6 +29,9 @@
 #ifndef IPXP_PROCESS_DNS_UTILS_HPP
 #define IPXP_PROCESS_DNS_UTILS_HPP
 
+#include <cstddef>
+#include <cstring>
+
 #include <endian.h>
 #include <stdint.h>
 
@@ -66,6 +69,20 @@ namespace ipxp {
 
 #define DNS_HDR_LENGTH 12
 
+#define DNS_MAX_LABEL_LEN 63 // Longest label of a name.
+#define DNS_MAX_LABEL_CNT 127 // Labels and compression pointers followed while decoding a name.
+#define DNS_MAX_NAME_LEN 255 // Longest name in wire format, also sufficient for its text form.
+
+/**
+ * \brief Check for label pointer in DNS name.
+ */
+#define DNS_IS_POINTER(ch) (((ch) & 0xC0) == 0xC0)
+
+/**
+ * \brief Get offset from 2 byte pointer.
+ */
+#define DNS_GET_OFFSET(half1, half2) ((((uint8_t) (half1) & 0x3F) << 8) | (uint8_t) (half2))
+
 /**
  * \brief Struct containing DNS header fields.
  */
@@ -187,5 +204,94 @@ struct __attribute__((packed)) dns_dnskey {
 	/* public key */
 };
 
+/**
+ * \brief Get length of a name in place, up to the terminating zero or compression pointer.
+ * \param [in] msg Pointer to begin of DNS message.
+ * \param [in] msg_len Length of DNS message.
+ * \param [in] name Pointer to the name inside of the message.
+ * \return Number of bytes occupied by the name, 0 when the name exceeds the message.
+ */
+inline size_t dns_name_length(const char* msg, size_t msg_len, const char* name)
+{
+	size_t pos = name - msg;
+
+	while (pos < msg_len) {
+		const uint8_t len = msg[pos];
+		if (len == 0) {
+			return pos + 1 - (name - msg);
+		}
+		if (DNS_IS_POINTER(len)) {
+			return pos + 2 <= msg_len ? pos + 2 - (name - msg) : 0;
+		}
+		pos += len + 1;
+	}
+	return 0;
+}
+
+/**
+ * \brief Decompress name to dot separated labels without any allocation.
+ *
+ * Every read is checked against the end of the message. Labels and compression pointers are
+ * counted together and limited by DNS_MAX_LABEL_CNT, so pointer loops terminate.
+ *
+ * \param [in] msg Pointer to begin of DNS message.
+ * \param [in] msg_len Length of DNS message.
+ * \param [in] name Pointer to the name inside of the message.
+ * \param [out] out Buffer for the name terminated by '\0', the name is truncated to fit.
+ * \param [in] size Size of the buffer, at least 1.
+ * \param [out] out_len Length of the name written to the buffer.
+ * \return False when the name is malformed, the buffer then holds the labels decoded before.
+ */
+inline bool dns_decode_name(
+	const char* msg,
+	size_t msg_len,
+	const char* name,
+	char* out,
+	size_t size,
+	size_t& out_len)
+{
+	size_t pos = name - msg;
+	size_t written = 0;
+	int label_cnt = 0;
+
+	out_len = 0;
+	out[0] = 0;
+	while (pos < msg_len) {
+		const uint8_t len = msg[pos];
+		if (len == 0) {
+			out[written] = 0;
+			out_len = written;
+			return true;
+		}
+		if (label_cnt++ > DNS_MAX_LABEL_CNT) {
+			break;
+		}
+		if (DNS_IS_POINTER(len)) {
+			if (pos + 2 > msg_len) {
+				break;
+			}
+			pos = DNS_GET_OFFSET(msg[pos], msg[pos + 1]);
+			continue;
+		}
+		// Label must be followed by at least one byte of the name
+		if (len > DNS_MAX_LABEL_LEN || pos + len + 2 > msg_len) {
+			break;
+		}
+
+		if (written != 0 && written + 1 < size) {
+			out[written++] = '.';
+		}
+		const size_t copy = written + len < size ? len : size - 1 - written;
+		memcpy(out + written, msg + pos + 1, copy);
+		written += copy;
+		pos += len + 1;
+	}
+
+	// Malformed name, keep the labels decoded so far terminated
+	out[written] = 0;
+	out_len = written;
+	return false;
+}
+
 } // namespace ipxp
 #endif /* IPXP_PROCESS_DNS_UTILS_HPP */
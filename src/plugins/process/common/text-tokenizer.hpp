@@ -0,0 +1,321 @@
+/**
+ * @file
+ * @brief Line and header field tokenizer of text protocols (HTTP, RTSP, SIP, SMTP)
+ *
+ * Payload is scanned in blocks of 64 bytes. One pass over a block produces bit masks of all line
+ * feeds and colons in it, lines and header field delimiters are then taken from the masks
+ * without touching the payload again. Header names are matched by a case-insensitive hash
+ * computed when the field is split.
+ *
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <strings.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ipxp {
+
+/**
+ * @brief Case-insensitive FNV-1a hash of a header name.
+ */
+constexpr uint32_t text_hash(std::string_view str)
+{
+	uint32_t hash = 2166136261U;
+	for (const char c : str) {
+		hash ^= static_cast<uint8_t>(c >= 'A' && c <= 'Z' ? c | 0x20 : c);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/**
+ * @brief Header name with precomputed hash.
+ */
+struct TextKey {
+	std::string_view name;
+	uint32_t hash;
+
+	constexpr TextKey(std::string_view name)
+		: name(name)
+		, hash(text_hash(name))
+	{
+	}
+};
+
+/**
+ * @brief Header field "Name: value".
+ */
+struct TextHeaderField {
+	std::string_view name; /**< Name without surrounding whitespaces */
+	std::string_view value; /**< Value without surrounding whitespaces and CR */
+	uint32_t hash; /**< text_hash() of the name */
+
+	/**
+	 * @brief Check the field name case-insensitively.
+	 */
+	bool is(const TextKey& key) const
+	{
+		return hash == key.hash && name.size() == key.name.size()
+			&& strncasecmp(name.data(), key.name.data(), name.size()) == 0;
+	}
+};
+
+/**
+ * @brief Copy string to a buffer of the given size, truncate it when needed and append \0.
+ */
+inline void copy_text(char* dst, size_t size, std::string_view str)
+{
+	const size_t len = str.size() < size ? str.size() : size - 1;
+	std::memcpy(dst, str.data(), len);
+	dst[len] = 0;
+}
+
+/**
+ * @brief Result of TextTokenizer::next_header().
+ */
+enum class TextHeaderStatus {
+	FIELD, /**< Header field was parsed */
+	END, /**< Blank line terminating the header section was reached */
+	INCOMPLETE, /**< Payload ends before the header section does */
+};
+
+/**
+ * @brief Tokenizer of lines terminated by LF or CRLF.
+ *
+ * The tokenizer does not copy the payload, returned views point to it.
+ */
+class TextTokenizer {
+public:
+	/** Bytes scanned at once. */
+	static const size_t BLOCK_SIZE = 64;
+
+	TextTokenizer(const char* data, size_t len)
+		: m_data(data)
+		, m_len(len)
+		, m_pos(0)
+		, m_block(0)
+		, m_lf_mask(0)
+		, m_colon_mask(0)
+	{
+		scan_block();
+	}
+
+	/**
+	 * @brief Get the next line.
+	 * @param [out] line Line without the terminating LF or CRLF.
+	 * @return False when no terminated line remains.
+	 */
+	bool next_line(std::string_view& line)
+	{
+		size_t colon;
+		return next_line(line, colon);
+	}
+
+	/**
+	 * @brief Get the next header field.
+	 *
+	 * Lines without a colon are skipped.
+	 *
+	 * @param [out] field Parsed field, valid when FIELD is returned.
+	 */
+	TextHeaderStatus next_header(TextHeaderField& field)
+	{
+		std::string_view line;
+		size_t colon;
+		while (next_line(line, colon)) {
+			if (line.empty()) {
+				return TextHeaderStatus::END;
+			}
+			if (colon < line.size()) {
+				split_header(line, colon, field);
+				return TextHeaderStatus::FIELD;
+			}
+		}
+		return TextHeaderStatus::INCOMPLETE;
+	}
+
+	/**
+	 * @brief Take the unterminated rest of the payload.
+	 * @param [out] line Rest without trailing CR.
+	 * @return False when nothing remains.
+	 */
+	bool take_rest(std::string_view& line)
+	{
+		if (m_pos >= m_len) {
+			return false;
+		}
+		line = trim_cr(std::string_view(m_data + m_pos, m_len - m_pos));
+		m_pos = m_len;
+		m_lf_mask = 0;
+		m_colon_mask = 0;
+		return true;
+	}
+
+	/** Offset of the first byte not consumed yet. */
+	size_t offset() const { return m_pos; }
+
+	/**
+	 * @brief Split line to a header field.
+	 * @param line Line containing the field.
+	 * @param colon Offset of the colon delimiting name and value.
+	 * @param [out] field Parsed field.
+	 */
+	static void split_header(std::string_view line, size_t colon, TextHeaderField& field)
+	{
+		field.name = trim(line.substr(0, colon));
+		field.value = trim(line.substr(colon + 1));
+		field.hash = text_hash(field.name);
+	}
+
+	/**
+	 * @brief Split line to a header field.
+	 * @return False when the line contains no colon.
+	 */
+	static bool split_header(std::string_view line, TextHeaderField& field)
+	{
+		const size_t colon = line.find(':');
+		if (colon == std::string_view::npos) {
+			return false;
+		}
+		split_header(line, colon, field);
+		return true;
+	}
+
+private:
+	const char* m_data;
+	size_t m_len;
+	size_t m_pos; /**< Begin of the next line */
+	size_t m_block; /**< Offset of the scanned block */
+	uint64_t m_lf_mask; /**< Line feeds of the block at or after m_pos */
+	uint64_t m_colon_mask; /**< Colons of the block at or after m_pos */
+
+	static std::string_view trim_cr(std::string_view str)
+	{
+		if (!str.empty() && str.back() == '\r') {
+			str.remove_suffix(1);
+		}
+		return str;
+	}
+
+	static std::string_view trim(std::string_view str)
+	{
+		while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+			str.remove_prefix(1);
+		}
+		while (!str.empty()
+			   && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r')) {
+			str.remove_suffix(1);
+		}
+		return str;
+	}
+
+	/** Clear bits up to the given one including. */
+	static uint64_t clear_upto(uint64_t mask, unsigned bit)
+	{
+		return bit == 63 ? 0 : mask & (~static_cast<uint64_t>(0) << (bit + 1));
+	}
+
+	/**
+	 * @brief Get the next line and the offset of its first colon.
+	 * @param [out] colon Offset of the first colon in the line, npos when there is none.
+	 */
+	bool next_line(std::string_view& line, size_t& colon)
+	{
+		colon = std::string_view::npos;
+		for (;;) {
+			if (m_lf_mask != 0) {
+				const unsigned bit = __builtin_ctzll(m_lf_mask);
+				const uint64_t line_colons = m_colon_mask & ((static_cast<uint64_t>(1) << bit) - 1);
+				if (colon == std::string_view::npos && line_colons != 0) {
+					colon = m_block + __builtin_ctzll(line_colons) - m_pos;
+				}
+				const size_t end = m_block + bit;
+				line = trim_cr(std::string_view(m_data + m_pos, end - m_pos));
+				m_pos = end + 1;
+				m_lf_mask = clear_upto(m_lf_mask, bit);
+				m_colon_mask = clear_upto(m_colon_mask, bit);
+				return true;
+			}
+			// Line continues in the next block
+			if (colon == std::string_view::npos && m_colon_mask != 0) {
+				colon = m_block + __builtin_ctzll(m_colon_mask) - m_pos;
+			}
+			if (m_block + BLOCK_SIZE >= m_len) {
+				return false;
+			}
+			m_block += BLOCK_SIZE;
+			scan_block();
+		}
+	}
+
+	/**
+	 * @brief Fill masks of line feeds and colons of the block at m_block.
+	 */
+	void scan_block()
+	{
+		if (m_block >= m_len) {
+			return;
+		}
+
+		const char* block = m_data + m_block;
+		char padded[BLOCK_SIZE];
+		if (m_len - m_block < BLOCK_SIZE) {
+			// Zero padding matches neither LF nor colon
+			std::memset(padded, 0, sizeof(padded));
+			std::memcpy(padded, block, m_len - m_block);
+			block = padded;
+		}
+
+#if defined(__AVX2__)
+		const __m256i lf = _mm256_set1_epi8('\n');
+		const __m256i colon = _mm256_set1_epi8(':');
+		uint64_t lf_mask = 0;
+		uint64_t colon_mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i += 32) {
+			const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+			lf_mask |= static_cast<uint64_t>(static_cast<uint32_t>(
+						   _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, lf))))
+				<< i;
+			colon_mask |= static_cast<uint64_t>(static_cast<uint32_t>(
+							  _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, colon))))
+				<< i;
+		}
+#elif defined(__SSE2__)
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i colon = _mm_set1_epi8(':');
+		uint64_t lf_mask = 0;
+		uint64_t colon_mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+			const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+			lf_mask |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, lf))) << i;
+			colon_mask |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, colon)))
+				<< i;
+		}
+#else
+		uint64_t lf_mask = 0;
+		uint64_t colon_mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i++) {
+			lf_mask |= static_cast<uint64_t>(block[i] == '\n') << i;
+			colon_mask |= static_cast<uint64_t>(block[i] == ':') << i;
+		}
+#endif
+		m_lf_mask = lf_mask;
+		m_colon_mask = colon_mask;
+	}
+};
+
+} // namespace ipxp
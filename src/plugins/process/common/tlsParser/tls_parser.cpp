@@ -552,6 +552,8 @@ void TLSParser::clear_parsed_data() noexcept
 	m_alpns.clear();
 	m_supported_versions.clear();
 	m_server_names.clear();
+	m_quic_user_agents.clear();
+	m_handshake.reset();
 }
 
 void TLSParser::add_extension(uint16_t extension_type, uint16_t extension_length) noexcept
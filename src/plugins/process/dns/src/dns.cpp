@@ -54,18 +54,6 @@ static const PluginManifest dnsPluginManifest = {
 #define DEBUG_CODE(code)
 #endif
 
-/**
- * \brief Check for label pointer in DNS name.
- */
-#define IS_POINTER(ch) ((ch & 0xC0) == 0xC0)
-
-#define MAX_LABEL_CNT 127
-
-/**
- * \brief Get offset from 2 byte pointer.
- */
-#define GET_OFFSET(half1, half2) ((((uint8_t) (half1) & 0x3F) << 8) | (uint8_t) (half2))
-
 DNSPlugin::DNSPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
 	, queries(0)
@@ -147,94 +135,52 @@ void DNSPlugin::finish(bool print_stats)
  */
 size_t DNSPlugin::get_name_length(const char* data) const
 {
-	size_t len = 0;
-
-	while (1) {
-		if ((uint32_t) (data - data_begin) + 1 > data_len) {
-			throw "Error: overflow";
-		}
-		if (!data[0]) {
-			break;
-		}
-		if (IS_POINTER(data[0])) {
-			return len + 2;
-		}
-
-		len += (uint8_t) data[0] + 1;
-		data += (uint8_t) data[0] + 1;
+	const size_t len = dns_name_length(data_begin, data_len, data);
+	if (len == 0) {
+		throw "Error: overflow";
 	}
-
-	return len + 1;
+	return len;
 }
 
 /**
  * \brief Decompress dns name.
  * \param [in] data Pointer to compressed data.
- * \return String with decompressed dns name.
+ * \param [out] out Buffer for the decompressed name, the name is truncated to fit.
+ * \param [in] size Size of the buffer.
+ * \return Length of the decompressed name.
  */
-std::string DNSPlugin::get_name(const char* data) const
+size_t DNSPlugin::get_name(const char* data, char* out, size_t size) const
 {
-	std::string name = "";
-	int label_cnt = 0;
-
-	if ((uint32_t) (data - data_begin) > data_len) {
-		throw "Error: overflow";
-	}
-
-	while (data[0]) { /* Check for terminating character. */
-		if (IS_POINTER(data[0])) { /* Check for label pointer (11xxxxxx byte) */
-			data = data_begin + GET_OFFSET(data[0], data[1]);
-
-			/* Check for possible errors.*/
-			if (label_cnt++ > MAX_LABEL_CNT || (uint32_t) (data - data_begin) > data_len) {
-				throw "Error: label count exceed or overflow";
-			}
-
-			continue;
-		}
-
-		/* Check for possible errors.*/
-		if (label_cnt++ > MAX_LABEL_CNT || (uint8_t) data[0] > 63
-			|| (uint32_t) ((data - data_begin) + (uint8_t) data[0] + 2) > data_len) {
-			throw "Error: label count exceed or overflow";
-		}
-
-		name += '.' + std::string(data + 1, (uint8_t) data[0]);
-		data += ((uint8_t) data[0] + 1);
+	size_t len;
+	if (!dns_decode_name(data_begin, data_len, data, out, size, len)) {
+		throw "Error: label count exceed or overflow";
 	}
-
-	if (name[0] == '.') {
-		name.erase(0, 1);
-	}
-
-	return name;
+	return len;
 }
 
 /**
  * \brief Process SRV strings.
- * \param [in,out] str Raw SRV string.
+ * \param [in,out] str Raw SRV string terminated by '\0'.
  */
-void DNSPlugin::process_srv(std::string& str) const
+void DNSPlugin::process_srv(char* str) const
 {
-	bool underline_found = false;
-	for (int i = 0; str[i]; i++) {
-		if (str[i] == '_') {
-			str.erase(i--, 1);
-			if (underline_found) {
-				break;
-			}
-			underline_found = true;
+	// Drop the first two underscores and separate service, protocol and name by spaces
+	int underlines = 0;
+	int dots = 0;
+	size_t pos = 0;
+	for (size_t i = 0; str[i]; i++) {
+		if (str[i] == '_' && underlines < 2) {
+			underlines++;
+			continue;
 		}
-	}
-	size_t pos = str.find('.');
-	if (pos != std::string::npos) {
-		str[pos] = ' ';
-
-		pos = str.find('.', pos);
-		if (pos != std::string::npos) {
-			str[pos] = ' ';
+		if (str[i] == '.' && dots < 2) {
+			dots++;
+			str[pos++] = ' ';
+			continue;
 		}
+		str[pos++] = str[i];
 	}
+	str[pos] = 0;
 }
 
 /**
@@ -252,6 +198,8 @@ void DNSPlugin::process_rdata(
 	uint16_t type,
 	size_t length) const
 {
+	char name[DNS_MAX_NAME_LEN + 1];
+
 	rdata.str("");
 	rdata.clear();
 
@@ -267,31 +215,36 @@ void DNSPlugin::process_rdata(
 		DEBUG_MSG("\tData AAAA:\t\t%s\n", rdata.str().c_str());
 	} break;
 	case DNS_TYPE_NS:
-		rdata << get_name(data);
+		get_name(data, name, sizeof(name));
+		rdata << name;
 		DEBUG_MSG("\tData NS:\t\t\t%s\n", rdata.str().c_str());
 		break;
 	case DNS_TYPE_CNAME:
-		rdata << get_name(data);
+		get_name(data, name, sizeof(name));
+		rdata << name;
 		DEBUG_MSG("\tData CNAME:\t\t%s\n", rdata.str().c_str());
 		break;
 	case DNS_TYPE_PTR:
-		rdata << get_name(data);
+		get_name(data, name, sizeof(name));
+		rdata << name;
 		DEBUG_MSG("\tData PTR:\t\t%s\n", rdata.str().c_str());
 		break;
 	case DNS_TYPE_DNAME:
-		rdata << get_name(data);
+		get_name(data, name, sizeof(name));
+		rdata << name;
 		DEBUG_MSG("\tData DNAME:\t\t%s\n", rdata.str().c_str());
 		break;
 	case DNS_TYPE_SOA: {
-		rdata << get_name(data);
+		get_name(data, name, sizeof(name));
+		rdata << name;
 		data += get_name_length(data);
-		std::string tmp = get_name(data);
+		get_name(data, name, sizeof(name));
 		data += get_name_length(data);
 
 		DEBUG_MSG("\t\tMName:\t\t%s\n", rdata.str().c_str());
-		DEBUG_MSG("\t\tRName:\t\t%s\n", tmp.c_str());
+		DEBUG_MSG("\t\tRName:\t\t%s\n", name);
 
-		rdata << " " << tmp;
+		rdata << " " << name;
 
 		struct dns_soa* soa = (struct dns_soa*) data;
 		DEBUG_MSG("\t\tSerial:\t\t%u\n", ntohl(soa->serial));
@@ -304,27 +257,28 @@ void DNSPlugin::process_rdata(
 	} break;
 	case DNS_TYPE_SRV: {
 		DEBUG_MSG("\tData SRV:\n");
-		std::string tmp = get_name(record_begin);
-		process_srv(tmp);
+		get_name(record_begin, name, sizeof(name));
+		process_srv(name);
 		struct dns_srv* srv = (struct dns_srv*) data;
 
 		DEBUG_MSG("\t\tPriority:\t%u\n", ntohs(srv->priority));
 		DEBUG_MSG("\t\tWeight:\t\t%u\n", ntohs(srv->weight));
 		DEBUG_MSG("\t\tPort:\t\t%u\n", ntohs(srv->port));
 
-		rdata << tmp << " ";
-		tmp = get_name(data + 6);
+		rdata << name << " ";
+		get_name(data + 6, name, sizeof(name));
 
-		DEBUG_MSG("\t\tTarget:\t\t%s\n", tmp.c_str());
-		rdata << tmp << " " << ntohs(srv->priority) << " " << ntohs(srv->weight) << " "
+		DEBUG_MSG("\t\tTarget:\t\t%s\n", name);
+		rdata << name << " " << ntohs(srv->priority) << " " << ntohs(srv->weight) << " "
 			  << ntohs(srv->port);
 	} break;
 	case DNS_TYPE_MX: {
 		uint16_t preference = ntohs(*(uint16_t*) data);
-		rdata << preference << " " << get_name(data + 2);
+		get_name(data + 2, name, sizeof(name));
+		rdata << preference << " " << name;
 		DEBUG_MSG("\tData MX:\n");
 		DEBUG_MSG("\t\tPreference:\t%u\n", preference);
-		DEBUG_MSG("\t\tMail exchanger:\t%s\n", get_name(data + 2).c_str());
+		DEBUG_MSG("\t\tMail exchanger:\t%s\n", name);
 	} break;
 	case DNS_TYPE_TXT: {
 		DEBUG_MSG("\tData TXT:\n");
@@ -347,12 +301,14 @@ void DNSPlugin::process_rdata(
 	} break;
 	case DNS_TYPE_MINFO:
 		DEBUG_MSG("\tData MINFO:\n");
-		rdata << get_name(data);
-		DEBUG_MSG("\t\tRMAILBX:\t%s\n", rdata.str().c_str());
+		get_name(data, name, sizeof(name));
+		rdata << name;
+		DEBUG_MSG("\t\tRMAILBX:\t%s\n", name);
 		data += get_name_length(data);
 
-		rdata << get_name(data);
-		DEBUG_MSG("\t\tEMAILBX:\t%s\n", get_name(data).c_str());
+		get_name(data, name, sizeof(name));
+		rdata << name;
+		DEBUG_MSG("\t\tEMAILBX:\t%s\n", name);
 		break;
 	case DNS_TYPE_HINFO:
 		DEBUG_MSG("\tData HINFO:\n");
@@ -376,7 +332,6 @@ void DNSPlugin::process_rdata(
 	} break;
 	case DNS_TYPE_RRSIG: {
 		struct dns_rrsig* rrsig = (struct dns_rrsig*) data;
-		std::string tmp = "";
 		DEBUG_MSG("\tData RRSIG:\n");
 		DEBUG_MSG("\t\tType:\t\t%u\n", ntohs(rrsig->type));
 		DEBUG_MSG("\t\tAlgorithm:\t%u\n", rrsig->algorithm);
@@ -391,8 +346,8 @@ void DNSPlugin::process_rdata(
 			  << ntohl(rrsig->sig_expiration) << " " << ntohl(rrsig->sig_inception) << " "
 			  << ntohs(rrsig->keytag) << " <key>";
 
-		tmp = get_name(data + 18);
-		DEBUG_MSG("\t\tSigner's name:\t%s\n", tmp.c_str());
+		get_name(data + 18, name, sizeof(name));
+		DEBUG_MSG("\t\tSigner's name:\t%s\n", name);
 		DEBUG_MSG("\t\tSignature:\t(binary)\n");
 	} break;
 	case DNS_TYPE_DNSKEY: {
@@ -450,6 +405,7 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 
 		data_begin = data;
 		data_len = payload_len;
+		char name[DNS_MAX_NAME_LEN + 1];
 
 		struct dns_hdr* dns = (struct dns_hdr*) data;
 		uint16_t flags = ntohs(dns->flags);
@@ -492,8 +448,13 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 		data += sizeof(struct dns_hdr);
 		for (int i = 0; i < question_cnt; i++) {
 			DEBUG_MSG("\nDNS question #%d\n", i + 1);
-			std::string name = get_name(data);
-			DEBUG_MSG("\tName:\t\t\t%s\n", name.c_str());
+			if (i == 0) { // Copy only first question.
+				get_name(data, rec->qname, sizeof(rec->qname));
+				DEBUG_MSG("\tName:\t\t\t%s\n", rec->qname);
+			} else {
+				get_name(data, name, sizeof(name));
+				DEBUG_MSG("\tName:\t\t\t%s\n", name);
+			}
 
 			data += get_name_length(data);
 			struct dns_question* question = (struct dns_question*) data;
@@ -503,20 +464,9 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 				return 1;
 			}
 
-			if (i == 0) { // Copy only first question.
+			if (i == 0) {
 				rec->qtype = ntohs(question->qtype);
 				rec->qclass = ntohs(question->qclass);
-
-				size_t length = name.length();
-				if (length >= sizeof(rec->qname)) {
-					DEBUG_MSG(
-						"Truncating qname (length = %lu) to %lu.\n",
-						length,
-						sizeof(rec->qname) - 1);
-					length = sizeof(rec->qname) - 1;
-				}
-				memcpy(rec->qname, name.c_str(), length);
-				rec->qname[length] = 0;
 			}
 			DEBUG_MSG("\tType:\t\t\t%u\n", ntohs(question->qtype));
 			DEBUG_MSG("\tClass:\t\t\t%u\n", ntohs(question->qclass));
@@ -533,7 +483,8 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 			record_begin = data;
 
 			DEBUG_MSG("DNS answer #%d\n", i + 1);
-			DEBUG_MSG("\tAnswer name:\t\t%s\n", get_name(data).c_str());
+			DEBUG_CODE(get_name(data, name, sizeof(name)));
+			DEBUG_MSG("\tAnswer name:\t\t%s\n", name);
 			data += get_name_length(data);
 
 			struct dns_answer* answer = (struct dns_answer*) data;
@@ -579,7 +530,8 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 			record_begin = data;
 
 			DEBUG_MSG("DNS authority RR #%d\n", i + 1);
-			DEBUG_MSG("\tAnswer name:\t\t%s\n", get_name(data).c_str());
+			DEBUG_CODE(get_name(data, name, sizeof(name)));
+			DEBUG_MSG("\tAnswer name:\t\t%s\n", name);
 			data += get_name_length(data);
 
 			struct dns_answer* answer = (struct dns_answer*) data;
@@ -609,7 +561,8 @@ bool DNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp,
 			record_begin = data;
 
 			DEBUG_MSG("DNS additional RR #%d\n", i + 1);
-			DEBUG_MSG("\tAnswer name:\t\t%s\n", get_name(data).c_str());
+			DEBUG_CODE(get_name(data, name, sizeof(name)));
+			DEBUG_MSG("\tAnswer name:\t\t%s\n", name);
 			data += get_name_length(data);
 
 			struct dns_answer* answer = (struct dns_answer*) data;
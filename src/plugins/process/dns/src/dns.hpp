@@ -155,6 +155,12 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("dns", "Parse DNS packets"); }
 	std::string get_name() const { return "dns"; }
 	RecordExt* get_ext() const { return new RecordExtDNS(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {53};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
@@ -171,7 +177,7 @@ private:
 
 	bool parse_dns(const char* data, unsigned int payload_len, bool tcp, RecordExtDNS* rec);
 	int add_ext_dns(const char* data, unsigned int payload_len, bool tcp, Flow& rec);
-	void process_srv(std::string& str) const;
+	void process_srv(char* str) const;
 	void process_rdata(
 		const char* record_begin,
 		const char* data,
@@ -179,7 +185,7 @@ private:
 		uint16_t type,
 		size_t length) const;
 
-	std::string get_name(const char* data) const;
+	size_t get_name(const char* data, char* out, size_t size) const;
 	size_t get_name_length(const char* data) const;
 };
 
@@ -56,18 +56,6 @@ static const PluginManifest dnssdPluginManifest = {
 #define DEBUG_CODE(code)
 #endif
 
-/**
- * \brief Check for label pointer in DNS name.
- */
-#define IS_POINTER(ch) ((ch & 0xC0) == 0xC0)
-
-#define MAX_LABEL_CNT 127
-
-/**
- * \brief Get offset from 2 byte pointer.
- */
-#define GET_OFFSET(half1, half2) ((((uint8_t) (half1) & 0x3F) << 8) | (uint8_t) (half2))
-
 DNSSDPlugin::DNSSDPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
 	, txt_all_records(false)
@@ -208,67 +196,27 @@ void DNSSDPlugin::load_txtconfig(const char* config_file)
  */
 size_t DNSSDPlugin::get_name_length(const char* data) const
 {
-	size_t len = 0;
-
-	while (1) {
-		if ((uint32_t) (data - data_begin) + 1 > data_len) {
-			throw "Error: overflow";
-		}
-		if (!data[0]) {
-			break;
-		}
-		if (IS_POINTER(data[0])) {
-			return len + 2;
-		}
-
-		len += (uint8_t) data[0] + 1;
-		data += (uint8_t) data[0] + 1;
+	const size_t len = dns_name_length(data_begin, data_len, data);
+	if (len == 0) {
+		throw "Error: overflow";
 	}
-
-	return len + 1;
+	return len;
 }
 
 /**
  * \brief Decompress dns name.
  * \param [in] data Pointer to compressed data.
- * \return String with decompressed dns name.
+ * \param [out] out Buffer for the decompressed name, the name is truncated to fit.
+ * \param [in] size Size of the buffer.
+ * \return Length of the decompressed name.
  */
-std::string DNSSDPlugin::get_name(const char* data) const
+size_t DNSSDPlugin::get_name(const char* data, char* out, size_t size) const
 {
-	std::string name = "";
-	int label_cnt = 0;
-
-	if ((uint32_t) (data - data_begin) > data_len) {
-		throw "Error: overflow";
+	size_t len;
+	if (!dns_decode_name(data_begin, data_len, data, out, size, len)) {
+		throw "Error: label count exceed or overflow";
 	}
-
-	while (data[0]) { /* Check for terminating character. */
-		if (IS_POINTER(data[0])) { /* Check for label pointer (11xxxxxx byte) */
-			data = data_begin + GET_OFFSET(data[0], data[1]);
-
-			/* Check for possible errors. */
-			if (label_cnt++ > MAX_LABEL_CNT || (uint32_t) (data - data_begin) > data_len) {
-				throw "Error: label count exceed or overflow";
-			}
-
-			continue;
-		}
-
-		/* Check for possible errors. */
-		if (label_cnt++ > MAX_LABEL_CNT || (uint8_t) data[0] > 63
-			|| (uint32_t) ((data - data_begin) + (uint8_t) data[0] + 2) > data_len) {
-			throw "Error: label count exceed or overflow";
-		}
-
-		name += '.' + std::string(data + 1, (uint8_t) data[0]);
-		data += ((uint8_t) data[0] + 1);
-	}
-
-	if (name[0] == '.') {
-		name.erase(0, 1);
-	}
-
-	return name;
+	return len;
 }
 
 /**
@@ -279,18 +227,18 @@ std::string DNSSDPlugin::get_name(const char* data) const
  * As an example, given input "My MacBook Air._device-info._tcp.local"
  * returns "_device-info._tcp.local".
  */
-const std::string DNSSDPlugin::get_service_str(std::string& name) const
+std::string_view DNSSDPlugin::get_service_str(std::string_view name) const
 {
 	size_t begin = name.length();
 	int8_t underscore_counter = 0;
 
-	while (underscore_counter < 2 && begin != std::string::npos) {
-		begin = name.rfind("_", begin - 1);
-		if (begin != std::string::npos) {
+	while (underscore_counter < 2 && begin != std::string_view::npos) {
+		begin = name.rfind('_', begin - 1);
+		if (begin != std::string_view::npos) {
 			underscore_counter++;
 		}
 	}
-	return name.substr((begin == std::string::npos ? 0 : begin), name.length());
+	return name.substr(begin == std::string_view::npos ? 0 : begin);
 }
 
 /**
@@ -299,9 +247,9 @@ const std::string DNSSDPlugin::get_service_str(std::string& name) const
  */
 bool DNSSDPlugin::matches_service(
 	std::list<std::pair<std::string, std::list<std::string>>>::const_iterator& it,
-	std::string& name) const
+	std::string_view name) const
 {
-	std::string service = get_service_str(name);
+	std::string_view service = get_service_str(name);
 
 	for (it = txt_config.begin(); it != txt_config.end(); it++) {
 		if (it->first == service) {
@@ -314,6 +262,7 @@ bool DNSSDPlugin::matches_service(
 /**
  * \brief Process RDATA section.
  * \param [in] record_begin Pointer to start of current resource record.
+ * \param [in] name Domain name of the resource record.
  * \param [in] data Pointer to RDATA section.
  * \param [out] rdata String which stores processed data.
  * \param [in] type Type of RDATA section.
@@ -321,33 +270,34 @@ bool DNSSDPlugin::matches_service(
  */
 void DNSSDPlugin::process_rdata(
 	const char* record_begin,
+	std::string_view name,
 	const char* data,
 	DnsSdRr& rdata,
 	uint16_t type,
 	size_t length) const
 {
 	(void) record_begin;
-	std::string name = rdata.name;
-	rdata = DnsSdRr();
+	rdata.clear();
 
 	switch (type) {
 	case DNS_TYPE_PTR:
-		DEBUG_MSG("%16s\t\t    %s\n", "PTR", get_name(data).c_str());
+		DEBUG_CODE(char target[DNS_MAX_NAME_LEN + 1]; get_name(data, target, sizeof(target)));
+		DEBUG_MSG("%16s\t\t    %s\n", "PTR", target);
 		break;
 	case DNS_TYPE_SRV: {
 		struct dns_srv* srv = (struct dns_srv*) data;
+		char target[DNS_MAX_NAME_LEN + 1];
+		size_t target_len = get_name(data + 6, target, sizeof(target));
 
-		std::string tmp = get_name(data + 6);
-
-		DEBUG_MSG("%16s\t%8u    %s\n", "SRV", ntohs(srv->port), tmp.c_str());
+		DEBUG_MSG("%16s\t%8u    %s\n", "SRV", ntohs(srv->port), target);
 
 		rdata.srv_port = ntohs(srv->port);
-		rdata.srv_target = tmp;
+		rdata.srv_target.assign(target, target_len);
 	} break;
 	case DNS_TYPE_HINFO: {
-		rdata.hinfo[0] = std::string(data + 1, (uint8_t) data[0]);
+		rdata.hinfo[0].assign(data + 1, (uint8_t) data[0]);
 		data += ((uint8_t) data[0] + 1);
-		rdata.hinfo[1] = std::string(data + 1, (uint8_t) data[0]);
+		rdata.hinfo[1].assign(data + 1, (uint8_t) data[0]);
 		data += ((uint8_t) data[0] + 1);
 		DEBUG_MSG("%16s\t\t    %s, %s\n", "HINFO", rdata.hinfo[0].c_str(), rdata.hinfo[1].c_str());
 	} break;
@@ -359,19 +309,18 @@ void DNSSDPlugin::process_rdata(
 		size_t len = (uint8_t) *(data++);
 		size_t total_len = len + 1;
 		std::list<std::string>::const_iterator sit;
-		std::string txt;
 
 		while (length != 0 && total_len <= length) {
-			txt = std::string(data, len);
+			std::string_view txt(data, len);
 
 			if (txt_all_records) {
-				DEBUG_MSG("%16s\t\t    %s\n", "TXT", txt.c_str());
-				rdata.txt += txt + ":";
+				DEBUG_MSG("%16s\t\t    %.*s\n", "TXT", (int) txt.length(), txt.data());
+				rdata.txt.append(txt).append(":");
 			} else {
 				for (sit = it->second.begin(); sit != it->second.end(); sit++) {
-					if (*sit == txt.substr(0, txt.find("="))) {
-						DEBUG_MSG("%16s\t\t    %s\n", "TXT", txt.c_str());
-						rdata.txt += txt + ":";
+					if (*sit == txt.substr(0, txt.find('='))) {
+						DEBUG_MSG("%16s\t\t    %.*s\n", "TXT", (int) txt.length(), txt.data());
+						rdata.txt.append(txt).append(":");
 						break;
 					}
 				}
@@ -428,6 +377,7 @@ bool DNSSDPlugin::parse_dns(
 
 		data_begin = data;
 		data_len = payload_len;
+		char name[DNS_MAX_NAME_LEN + 1];
 
 		struct dns_hdr* dns = (struct dns_hdr*) data;
 		uint16_t flags = ntohs(dns->flags);
@@ -463,7 +413,7 @@ bool DNSSDPlugin::parse_dns(
 				DEBUG_MSG("\nDNS questions section\n");
 				DEBUG_MSG("%8s%8s%8s%8s%8s\n", "num", "type", "ttl", "port", "name");
 			});
-			std::string name = get_name(data);
+			get_name(data, name, sizeof(name));
 
 			data += get_name_length(data);
 			DEBUG_CODE(struct dns_question* question = (struct dns_question*) data);
@@ -475,7 +425,7 @@ bool DNSSDPlugin::parse_dns(
 
 			filtered_append(rec, name);
 
-			DEBUG_MSG("#%7d%8u%20s%s\n", i + 1, ntohs(question->qtype), "", name.c_str());
+			DEBUG_MSG("#%7d%8u%20s%s\n", i + 1, ntohs(question->qtype), "", name);
 			data += sizeof(struct dns_question);
 		}
 
@@ -493,7 +443,7 @@ bool DNSSDPlugin::parse_dns(
 			}
 
 			record_begin = data;
-			std::string name = get_name(data);
+			get_name(data, name, sizeof(name));
 
 			data += get_name_length(data);
 
@@ -511,13 +461,11 @@ bool DNSSDPlugin::parse_dns(
 				ntohs(answer->atype),
 				ntohl(answer->ttl),
 				"",
-				name.c_str());
+				name);
 
 			data += sizeof(struct dns_answer);
 			rdlength = ntohs(answer->rdlength);
-			rdata.name = name;
-
-			process_rdata(record_begin, data, rdata, ntohs(answer->atype), rdlength);
+			process_rdata(record_begin, name, data, rdata, ntohs(answer->atype), rdlength);
 			if (DNS_HDR_GET_QR(flags)) { // Ignore the known answers in a query.
 				filtered_append(rec, name, ntohs(answer->atype), rdata);
 			}
@@ -535,7 +483,7 @@ bool DNSSDPlugin::parse_dns(
 			});
 
 			record_begin = data;
-			std::string name = get_name(data);
+			get_name(data, name, sizeof(name));
 
 			data += get_name_length(data);
 
@@ -554,13 +502,11 @@ bool DNSSDPlugin::parse_dns(
 				ntohs(answer->atype),
 				ntohl(answer->ttl),
 				"",
-				name.c_str());
+				name);
 
 			data += sizeof(struct dns_answer);
 			rdlength = ntohs(answer->rdlength);
-			rdata.name = name;
-
-			process_rdata(record_begin, data, rdata, ntohs(answer->atype), rdlength);
+			process_rdata(record_begin, name, data, rdata, ntohs(answer->atype), rdlength);
 			filtered_append(rec, name, ntohs(answer->atype), rdata);
 
 			data += rdlength;
@@ -577,7 +523,7 @@ bool DNSSDPlugin::parse_dns(
 
 			record_begin = data;
 
-			std::string name = get_name(data);
+			get_name(data, name, sizeof(name));
 
 			data += get_name_length(data);
 
@@ -596,15 +542,13 @@ bool DNSSDPlugin::parse_dns(
 				ntohs(answer->atype),
 				ntohl(answer->ttl),
 				"",
-				name.c_str());
+				name);
 
 			rdlength = ntohs(answer->rdlength);
 
 			if (ntohs(answer->atype) != DNS_TYPE_OPT) {
 				data += sizeof(struct dns_answer);
-				rdata.name = name;
-
-				process_rdata(record_begin, data, rdata, ntohs(answer->atype), rdlength);
+				process_rdata(record_begin, name, data, rdata, ntohs(answer->atype), rdlength);
 				if (DNS_HDR_GET_QR(flags)) {
 					filtered_append(rec, name, ntohs(answer->atype), rdata);
 				}
@@ -633,11 +577,11 @@ bool DNSSDPlugin::parse_dns(
  * \param [in,out] rec Pointer to DNSSD extension record
  * \param [in] name Domain name of the DNS record.
  */
-void DNSSDPlugin::filtered_append(RecordExtDNSSD* rec, std::string name)
+void DNSSDPlugin::filtered_append(RecordExtDNSSD* rec, std::string_view name)
 {
-	if (name.rfind("arpa") == std::string::npos
+	if (name.rfind("arpa") == std::string_view::npos
 		&& std::find(rec->queries.begin(), rec->queries.end(), name) == rec->queries.end()) {
-		rec->queries.push_back(name);
+		rec->queries.emplace_back(name);
 	}
 }
 
@@ -650,15 +594,15 @@ void DNSSDPlugin::filtered_append(RecordExtDNSSD* rec, std::string name)
  */
 void DNSSDPlugin::filtered_append(
 	RecordExtDNSSD* rec,
-	std::string name,
+	std::string_view name,
 	uint16_t type,
 	DnsSdRr& rdata)
 {
 	if ((type != DNS_TYPE_SRV && type != DNS_TYPE_HINFO && type != DNS_TYPE_TXT)
-		|| name.rfind("arpa") != std::string::npos) {
+		|| name.rfind("arpa") != std::string_view::npos) {
 		return;
 	}
-	std::list<DnsSdRr>::iterator it;
+	std::vector<DnsSdRr>::iterator it;
 
 	for (it = rec->responses.begin(); it != rec->responses.end(); it++) {
 		if (it->name == name) {
@@ -18,6 +18,8 @@
 #include <list>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #ifdef WITH_NEMEA
 #include "fields.h"
@@ -81,14 +83,26 @@ struct DnsSdRr {
 		hinfo[0] = std::string();
 		txt = std::string();
 	}
+
+	/**
+	 * \brief Reset RDATA fields, keep allocated buffers.
+	 */
+	void clear()
+	{
+		srv_port = -1;
+		srv_target.clear();
+		hinfo[0].clear();
+		hinfo[1].clear();
+		txt.clear();
+	}
 };
 
 /**
  * \brief Flow record extension header for storing parsed DNSSD packets.
  */
 struct RecordExtDNSSD : public RecordExt {
-	std::list<std::string> queries;
-	std::list<DnsSdRr> responses;
+	std::vector<std::string> queries;
+	std::vector<DnsSdRr> responses;
 
 	/**
 	 * \brief Constructor.
@@ -127,7 +141,7 @@ struct RecordExtDNSSD : public RecordExt {
 	 * \brief Converts a response to semicolon separated string.
 	 * \param [in] response Iterator pointing at the response.
 	 */
-	std::string response_to_string(std::list<DnsSdRr>::const_iterator response) const
+	std::string response_to_string(std::vector<DnsSdRr>::const_iterator response) const
 	{
 		std::stringstream ret;
 
@@ -247,6 +261,12 @@ public:
 	OptionsParser* get_parser() const { return new DNSSDOptParser(); }
 	std::string get_name() const { return "dnssd"; }
 	RecordExt* get_ext() const { return new RecordExtDNSSD(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {5353};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
@@ -266,22 +286,24 @@ private:
 	int add_ext_dnssd(const char* data, unsigned int payload_len, bool tcp, Flow& rec);
 	void process_rdata(
 		const char* record_begin,
+		std::string_view name,
 		const char* data,
 		DnsSdRr& rdata,
 		uint16_t type,
 		size_t length) const;
-	void filtered_append(RecordExtDNSSD* rec, std::string name);
-	void filtered_append(RecordExtDNSSD* rec, std::string name, uint16_t type, DnsSdRr& rdata);
+	void filtered_append(RecordExtDNSSD* rec, std::string_view name);
+	void
+	filtered_append(RecordExtDNSSD* rec, std::string_view name, uint16_t type, DnsSdRr& rdata);
 
-	std::string get_name(const char* data) const;
+	size_t get_name(const char* data, char* out, size_t size) const;
 	size_t get_name_length(const char* data) const;
-	const std::string get_service_str(std::string& name) const;
+	std::string_view get_service_str(std::string_view name) const;
 
 	bool parse_params(const std::string& params, std::string& config_file);
 	void load_txtconfig(const char* config_file);
 	bool matches_service(
 		std::list<std::pair<std::string, std::list<std::string>>>::const_iterator& it,
-		std::string& name) const;
+		std::string_view name) const;
 
 	std::list<std::pair<std::string, std::list<std::string>>>
 		txt_config; /**< Configuration for TXT record filter. */
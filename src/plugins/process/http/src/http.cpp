@@ -13,6 +13,7 @@
 #include "http.hpp"
 
 #include "common.hpp"
+#include "text-tokenizer.hpp"
 
 #include <cstdlib>
 #include <cstring>
@@ -55,11 +56,16 @@ static const PluginManifest httpPluginManifest = {
 #define DEBUG_CODE(code)
 #endif
 
-#define HTTP_LINE_DELIMITER "\r\n"
-#define HTTP_KEYVAL_DELIMITER ':'
-#define HTTP_SETCOOKIE_NAME_DELIMITER "="
+#define HTTP_SETCOOKIE_NAME_DELIMITER '='
 #define STRING_DELIMITER ";"
 
+static constexpr TextKey HTTP_HDR_HOST("Host");
+static constexpr TextKey HTTP_HDR_USER_AGENT("User-Agent");
+static constexpr TextKey HTTP_HDR_REFERER("Referer");
+static constexpr TextKey HTTP_HDR_CONTENT_TYPE("Content-Type");
+static constexpr TextKey HTTP_HDR_SERVER("Server");
+static constexpr TextKey HTTP_HDR_SET_COOKIE("Set-Cookie");
+
 HTTPPlugin::HTTPPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
 	, recPrealloc(nullptr)
@@ -233,8 +239,9 @@ static uint32_t s_requests = 0, s_responses = 0;
 bool HTTPPlugin::parse_http_request(const char* data, int payload_len, RecordExtHTTP* rec)
 {
 	char buffer[64];
-	size_t remaining;
-	const char *begin, *end, *keyval_delimiter;
+	std::string_view line;
+	TextHeaderField field;
+	TextHeaderStatus status;
 
 	total++;
 
@@ -247,43 +254,42 @@ bool HTTPPlugin::parse_http_request(const char* data, int payload_len, RecordExt
 		return false;
 	}
 
+	TextTokenizer tokenizer(data, payload_len);
+	if (!tokenizer.next_line(line)) {
+		DEBUG_MSG("Parser quits:\tNo line delim after request line\n");
+		return false;
+	}
+
 	/* Request line:
 	 *
 	 * METHOD URI VERSION
 	 * |     |   |
-	 * |     |   -------- end
-	 * |     ------------ begin
-	 * ----- ------------ data
+	 * |     |   -------- uri_end
+	 * |     ------------ uri_begin
+	 * ----- ------------ line
 	 */
 
 	/* Find begin of URI. */
-	begin = static_cast<const char*>(memchr(data, ' ', payload_len));
-	if (begin == nullptr) {
+	const size_t uri_begin = line.find(' ');
+	if (uri_begin == std::string_view::npos) {
 		DEBUG_MSG("Parser quits:\tnot a http request header\n");
 		return false;
 	}
 
 	/* Find end of URI. */
-	if (check_payload_len(payload_len, (begin + 1) - data)) {
-		DEBUG_MSG("Parser quits:\tpayload end\n");
-		return false;
-	}
-
-	remaining = payload_len - ((begin + 1) - data);
-	end = static_cast<const char*>(memchr(begin + 1, ' ', remaining));
-
-	if (end == nullptr) {
+	const size_t uri_end = line.find(' ', uri_begin + 1);
+	if (uri_end == std::string_view::npos) {
 		DEBUG_MSG("Parser quits:\trequest is fragmented\n");
 		return false;
 	}
 
-	if (memcmp(end + 1, "HTTP", 4)) {
+	if (!line.substr(uri_end + 1).starts_with("HTTP")) {
 		DEBUG_MSG("Parser quits:\tnot a HTTP request\n");
 		return false;
 	}
 
 	/* Copy and check HTTP method */
-	copy_str(buffer, sizeof(buffer), data, begin);
+	copy_str(buffer, sizeof(buffer), line.data(), line.data() + uri_begin);
 	if (rec->req) {
 		flow_flush = true;
 		total--;
@@ -293,74 +299,36 @@ bool HTTPPlugin::parse_http_request(const char* data, int payload_len, RecordExt
 	strncpy(rec->method, buffer, sizeof(rec->method));
 	rec->method[sizeof(rec->method) - 1] = 0;
 
-	copy_str(rec->uri, sizeof(rec->uri), begin + 1, end);
+	copy_str(rec->uri, sizeof(rec->uri), line.data() + uri_begin + 1, line.data() + uri_end);
 	DEBUG_MSG("\tMethod: %s\n", rec->method);
 	DEBUG_MSG("\tURI: %s\n", rec->uri);
 
-	/* Find begin of next line after request line. */
-	if (check_payload_len(payload_len, end - data)) {
-		DEBUG_MSG("Parser quits:\tpayload end\n");
-		return false;
-	}
-	remaining = payload_len - (end - data);
-	begin = ipxp::strnstr(end, HTTP_LINE_DELIMITER, remaining);
-	if (begin == nullptr) {
-		DEBUG_MSG("Parser quits:\tNo line delim after request line\n");
-		return false;
-	}
-	begin += 2;
-
-	/* Header:
-	 *
-	 * REQ-FIELD: VALUE
-	 * |        |      |
-	 * |        |      ----- end
-	 * |        ------------ keyval_delimiter
-	 * --------------------- begin
-	 */
-
 	rec->host[0] = 0;
 	rec->user_agent[0] = 0;
 	rec->referer[0] = 0;
 	/* Process headers. */
-	while (begin - data < payload_len) {
-		remaining = payload_len - (begin - data);
-		end = ipxp::strnstr(begin, HTTP_LINE_DELIMITER, remaining);
-		keyval_delimiter
-			= static_cast<const char*>(memchr(begin, HTTP_KEYVAL_DELIMITER, remaining));
-
-		if (end == nullptr) {
-			DEBUG_MSG("Parser quits:\theader is fragmented\n");
-			return false;
-		}
-
-		end += 1;
-		int tmp = end - begin;
-		if (tmp == 0 || tmp == 1) { /* Check for blank line with \r\n or \n ending. */
-			break; /* Double LF found - end of header section. */
-		} else if (keyval_delimiter == nullptr) {
-			DEBUG_MSG("Parser quits:\theader is fragmented\n");
-			return false;
-		}
-
-		/* Copy field name. */
-		copy_str(buffer, sizeof(buffer), begin, keyval_delimiter);
-
-		DEBUG_CODE(char debug_buffer[4096]);
-		DEBUG_CODE(copy_str(debug_buffer, sizeof(debug_buffer), keyval_delimiter + 2, end));
-		DEBUG_MSG("\t%s: %s\n", buffer, debug_buffer);
+	while ((status = tokenizer.next_header(field)) == TextHeaderStatus::FIELD) {
+		DEBUG_MSG(
+			"\t%.*s: %.*s\n",
+			static_cast<int>(field.name.size()),
+			field.name.data(),
+			static_cast<int>(field.value.size()),
+			field.value.data());
 
 		/* Copy interesting field values. */
-		if (!strcmp(buffer, "Host")) {
-			copy_str(rec->host, sizeof(rec->host), keyval_delimiter + 2, end);
-		} else if (!strcmp(buffer, "User-Agent")) {
-			copy_str(rec->user_agent, sizeof(rec->user_agent), keyval_delimiter + 2, end);
-		} else if (!strcmp(buffer, "Referer")) {
-			copy_str(rec->referer, sizeof(rec->referer), keyval_delimiter + 2, end);
+		if (field.is(HTTP_HDR_HOST)) {
+			copy_text(rec->host, sizeof(rec->host), field.value);
+		} else if (field.is(HTTP_HDR_USER_AGENT)) {
+			copy_text(rec->user_agent, sizeof(rec->user_agent), field.value);
+		} else if (field.is(HTTP_HDR_REFERER)) {
+			copy_text(rec->referer, sizeof(rec->referer), field.value);
 		}
+	}
 
-		/* Go to next line. */
-		begin = end + 1;
+	/* Header section may also end with the payload. */
+	if (status == TextHeaderStatus::INCOMPLETE && tokenizer.offset() < size_t(payload_len)) {
+		DEBUG_MSG("Parser quits:\theader is fragmented\n");
+		return false;
 	}
 
 	DEBUG_MSG("Parser quits:\tend of header section\n");
@@ -379,8 +347,9 @@ bool HTTPPlugin::parse_http_request(const char* data, int payload_len, RecordExt
 bool HTTPPlugin::parse_http_response(const char* data, int payload_len, RecordExtHTTP* rec)
 {
 	char buffer[64];
-	const char *begin, *end, *keyval_delimiter, *cookie_name_end;
-	size_t remaining;
+	std::string_view line;
+	TextHeaderField field;
+	TextHeaderStatus status;
 	int code;
 
 	total++;
@@ -395,41 +364,41 @@ bool HTTPPlugin::parse_http_response(const char* data, int payload_len, RecordEx
 	}
 
 	/* Check begin of response header. */
-	if (memcmp(data, "HTTP", 4)) {
+	if (payload_len < 4 || memcmp(data, "HTTP", 4)) {
 		DEBUG_MSG("Parser quits:\tpacket contains http response data\n");
 		return false;
 	}
 
+	TextTokenizer tokenizer(data, payload_len);
+	if (!tokenizer.next_line(line)) {
+		DEBUG_MSG("Parser quits:\tNo line delim after response line\n");
+		return false;
+	}
+
 	/* Response line:
 	 *
 	 * VERSION CODE REASON
 	 * |      |    |
-	 * |      |    --------- end
-	 * |      -------------- begin
-	 * --------------------- data
+	 * |      |    --------- code_end
+	 * |      -------------- code_begin
+	 * --------------------- line
 	 */
 
 	/* Find begin of status code. */
-	begin = static_cast<const char*>(memchr(data, ' ', payload_len));
-	if (begin == nullptr) {
+	const size_t code_begin = line.find(' ');
+	if (code_begin == std::string_view::npos) {
 		DEBUG_MSG("Parser quits:\tnot a http response header\n");
 		return false;
 	}
 
-	/* Find end of status code. */
-	if (check_payload_len(payload_len, (begin + 1) - data)) {
-		DEBUG_MSG("Parser quits:\tpayload end\n");
-		return false;
-	}
-	remaining = payload_len - ((begin + 1) - data);
-	end = static_cast<const char*>(memchr(begin + 1, ' ', remaining));
-	if (end == nullptr) {
-		DEBUG_MSG("Parser quits:\tresponse is fragmented\n");
-		return false;
+	/* Find end of status code, reason phrase may be missing. */
+	size_t code_end = line.find(' ', code_begin + 1);
+	if (code_end == std::string_view::npos) {
+		code_end = line.size();
 	}
 
 	/* Copy and check HTTP response code. */
-	copy_str(buffer, sizeof(buffer), begin + 1, end);
+	copy_str(buffer, sizeof(buffer), line.data() + code_begin + 1, line.data() + code_end);
 	code = atoi(buffer);
 	if (code <= 0) {
 		DEBUG_MSG("Parser quits:\twrong response code: %d\n", code);
@@ -445,81 +414,42 @@ bool HTTPPlugin::parse_http_response(const char* data, int payload_len, RecordEx
 	}
 	rec->code = code;
 
-	/* Find begin of next line after request line. */
-	if (check_payload_len(payload_len, end - data)) {
-		DEBUG_MSG("Parser quits:\tpayload end\n");
-		return false;
-	}
-	remaining = payload_len - (end - data);
-	begin = ipxp::strnstr(end, HTTP_LINE_DELIMITER, remaining);
-	if (begin == nullptr) {
-		DEBUG_MSG("Parser quits:\tNo line delim after request line\n");
-		return false;
-	}
-	begin += 2;
-
-	/* Header:
-	 *
-	 * REQ-FIELD: VALUE
-	 * |        |      |
-	 * |        |      ----- end
-	 * |        ------------ keyval_delimiter
-	 * --------------------- begin
-	 */
-
 	rec->content_type[0] = 0;
 	rec->server[0] = 0;
 	rec->set_cookie[0] = 0;
 
 	/* Process headers. */
-	while (begin - data < payload_len) {
-		remaining = payload_len - (begin - data);
-		end = ipxp::strnstr(begin, HTTP_LINE_DELIMITER, remaining);
-		keyval_delimiter
-			= static_cast<const char*>(memchr(begin, HTTP_KEYVAL_DELIMITER, remaining));
-
-		if (end == nullptr) {
-			DEBUG_MSG("Parser quits:\theader is fragmented\n");
-			return false;
-		}
-
-		end += 1;
-		int tmp = end - begin;
-		if (tmp == 0 || tmp == 1) { /* Check for blank line with \r\n or \n ending. */
-			break; /* Double LF found - end of header section. */
-		} else if (keyval_delimiter == nullptr) {
-			DEBUG_MSG("Parser quits:\theader is fragmented\n");
-			return false;
-		}
-
-		/* Copy field name. */
-		copy_str(buffer, sizeof(buffer), begin, keyval_delimiter);
-
-		DEBUG_CODE(char debug_buffer[4096]);
-		DEBUG_CODE(copy_str(debug_buffer, sizeof(debug_buffer), keyval_delimiter + 2, end));
-		DEBUG_MSG("\t%s: %s\n", buffer, debug_buffer);
+	while ((status = tokenizer.next_header(field)) == TextHeaderStatus::FIELD) {
+		DEBUG_MSG(
+			"\t%.*s: %.*s\n",
+			static_cast<int>(field.name.size()),
+			field.name.data(),
+			static_cast<int>(field.value.size()),
+			field.value.data());
 
 		/* Copy interesting field values. */
-		if (!strcmp(buffer, "Content-Type")) {
-			copy_str(rec->content_type, sizeof(rec->content_type), keyval_delimiter + 2, end);
-		} else if (!strcmp(buffer, "Server")) {
-			copy_str(rec->server, sizeof(rec->server), keyval_delimiter + 2, end);
-		} else if (!strcmp(buffer, "Set-Cookie")) {
-			cookie_name_end
-				= ipxp::strnstr(begin, HTTP_SETCOOKIE_NAME_DELIMITER, size_t(end - begin));
-			if (cookie_name_end == nullptr) {
+		if (field.is(HTTP_HDR_CONTENT_TYPE)) {
+			copy_text(rec->content_type, sizeof(rec->content_type), field.value);
+		} else if (field.is(HTTP_HDR_SERVER)) {
+			copy_text(rec->server, sizeof(rec->server), field.value);
+		} else if (field.is(HTTP_HDR_SET_COOKIE)) {
+			const size_t cookie_name_end = field.value.find(HTTP_SETCOOKIE_NAME_DELIMITER);
+			if (cookie_name_end == std::string_view::npos) {
 				break;
 			}
 			add_str(
 				rec->set_cookie,
 				sizeof(rec->set_cookie),
-				keyval_delimiter + 2,
-				cookie_name_end,
+				field.value.data(),
+				field.value.data() + cookie_name_end,
 				STRING_DELIMITER);
 		}
+	}
 
-		/* Go to next line. */
-		begin = end + 1;
+	/* Header section may also end with the payload. */
+	if (status == TextHeaderStatus::INCOMPLETE && tokenizer.offset() < size_t(payload_len)) {
+		DEBUG_MSG("Parser quits:\theader is fragmented\n");
+		return false;
 	}
 
 	DEBUG_MSG("Parser quits:\tend of header section\n");
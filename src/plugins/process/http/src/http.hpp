@@ -194,6 +194,15 @@ public:
 	void init(const char* params);
 	void close();
 	RecordExt* get_ext() const { return new RecordExtHTTP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.payload = true;
+		interest.signatures
+			= {"GET ", "POST", "PUT ", "HEAD", "DELE", "TRAC", "OPTI", "CONN", "PATC", "HTTP"};
+		interest.request_line = "HTTP";
+		return interest;
+	}
 	OptionsParser* get_parser() const { return new OptionsParser("http", "Parse HTTP traffic"); }
 	std::string get_name() const { return "http"; }
 	ProcessPlugin* copy();
@@ -95,6 +95,12 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("icmp", "Parse ICMP traffic"); }
 	std::string get_name() const { return "icmp"; }
 	RecordExt* get_ext() const { return new RecordExtICMP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.protocols = PacketInterest::ICMP;
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
@@ -100,6 +100,12 @@ public:
 	}
 	std::string get_name() const { return "netbios"; }
 	RecordExt* get_ext() const { return new RecordExtNETBIOS(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {137};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
@@ -214,6 +214,12 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("ntp", "Parse NTP traffic"); }
 	std::string get_name() const { return "ntp"; }
 	RecordExt* get_ext() const { return new RecordExtNTP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {123};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
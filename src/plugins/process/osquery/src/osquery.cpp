@@ -14,15 +14,12 @@
 
 #include <cstdio>
 #include <cstring>
-#include <iomanip>
 #include <iostream>
 #include <sstream>
 
 #include <ipfixprobe/pluginFactory/pluginManifest.hpp>
 #include <ipfixprobe/pluginFactory/pluginRegistrar.hpp>
 
-#define HEX(x) std::setw(2) << std::setfill('0') << std::hex << (int) (x)
-
 namespace ipxp {
 
 static const PluginManifest osqueryPluginManifest = {
@@ -41,7 +38,8 @@ static const PluginManifest osqueryPluginManifest = {
 
 OSQUERYPlugin::OSQUERYPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
-	, manager(nullptr)
+	, worker(nullptr)
+	, osRecord(nullptr)
 	, numberOfSuccessfullyRequests(0)
 {
 	init(params.c_str());
@@ -49,8 +47,10 @@ OSQUERYPlugin::OSQUERYPlugin(const std::string& params, int pluginID)
 
 OSQUERYPlugin::OSQUERYPlugin(const OSQUERYPlugin& p)
 	: ProcessPlugin(p.m_pluginID)
+	, worker(nullptr)
+	, osRecord(nullptr)
+	, numberOfSuccessfullyRequests(0)
 {
-	(void) p;
 	init(nullptr);
 }
 
@@ -62,15 +62,21 @@ OSQUERYPlugin::~OSQUERYPlugin()
 void OSQUERYPlugin::init(const char* params)
 {
 	(void) params;
-	manager = new OsqueryRequestManager(m_pluginID);
+	OsqueryRequestManager* manager = new OsqueryRequestManager(m_pluginID);
 	manager->readInfoAboutOS();
+	osRecord = new RecordExtOSQUERY(manager->getRecord());
+	worker = new OsqueryWorker(manager);
 }
 
 void OSQUERYPlugin::close()
 {
-	if (manager != nullptr) {
-		delete manager;
-		manager = nullptr;
+	if (worker != nullptr) {
+		delete worker;
+		worker = nullptr;
+	}
+	if (osRecord != nullptr) {
+		delete osRecord;
+		osRecord = nullptr;
 	}
 }
 
@@ -82,25 +88,204 @@ ProcessPlugin* OSQUERYPlugin::copy()
 int OSQUERYPlugin::post_create(Flow& rec, const Packet& pkt)
 {
 	(void) pkt;
-	ConvertedFlowData flowDataIPv4(rec.src_ip.v4, rec.dst_ip.v4, rec.src_port, rec.dst_port);
-
-	if (manager->readInfoAboutProgram(flowDataIPv4)) {
-		RecordExtOSQUERY* record = new RecordExtOSQUERY(manager->getRecord());
-		rec.add_extension(record);
+	OsqueryProgramInfo info;
 
-		numberOfSuccessfullyRequests++;
+	if (worker->lookup(rec, true, info)) {
+		addExtension(rec, info);
 	}
 
 	return 0;
 }
 
+void OSQUERYPlugin::pre_export(Flow& rec)
+{
+	// Answer to the request of post_create may have arrived since
+	if (rec.get_extension(m_pluginID) != nullptr) {
+		return;
+	}
+
+	OsqueryProgramInfo info;
+	if (worker->lookup(rec, false, info)) {
+		addExtension(rec, info);
+	}
+}
+
+void OSQUERYPlugin::addExtension(Flow& rec, const OsqueryProgramInfo& info)
+{
+	RecordExtOSQUERY* record = new RecordExtOSQUERY(osRecord);
+	record->program_name = info.program_name;
+	record->username = info.username;
+	rec.add_extension(record);
+
+	numberOfSuccessfullyRequests++;
+}
+
 void OSQUERYPlugin::finish(bool print_stats)
 {
 	if (print_stats) {
 		std::cout << "OSQUERY plugin stats:" << std::endl;
 		std::cout << "Number of successfully processed requests: " << numberOfSuccessfullyRequests
 				  << std::endl;
+		std::cout << "Number of dropped requests: " << worker->getDroppedRequests() << std::endl;
+	}
+}
+
+OsqueryWorker::OsqueryWorker(OsqueryRequestManager* manager)
+	: manager(manager)
+	, stop(false)
+	, queue(REQUEST_QUEUE_SIZE)
+	, queueHead(0)
+	, queueCount(0)
+	, droppedRequests(0)
+{
+	thread = std::thread(&OsqueryWorker::run, this);
+}
+
+OsqueryWorker::~OsqueryWorker()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cond.notify_one();
+	thread.join();
+	delete manager;
+}
+
+bool OsqueryWorker::lookup(const Flow& flow, bool request, OsqueryProgramInfo& info)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const OsquerySocket sockets[2] = {getSocket(flow, true), getSocket(flow, false)};
+	bool sourceNotFound = false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (int i = 0; i < 2; i++) {
+		auto it = cache.find(sockets[i]);
+		if (it == cache.end()) {
+			continue;
+		}
+		if (it->second.expiration <= now) {
+			cache.erase(it);
+		} else if (it->second.found) {
+			info = it->second;
+			return true;
+		} else if (i == 0) {
+			sourceNotFound = true;
+		}
+	}
+
+	if (!request || sourceNotFound) {
+		return false;
+	}
+	if (queueCount == queue.size()) {
+		droppedRequests++;
+		return false;
 	}
+
+	Request& req = queue[(queueHead + queueCount) % queue.size()];
+	req.ipVersion = flow.ip_version;
+	req.proto = flow.ip_proto;
+	req.srcPort = flow.src_port;
+	req.dstPort = flow.dst_port;
+	req.srcIP = flow.src_ip;
+	req.dstIP = flow.dst_ip;
+	queueCount++;
+
+	lock.unlock();
+	cond.notify_one();
+	return false;
+}
+
+uint64_t OsqueryWorker::getDroppedRequests()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return droppedRequests;
+}
+
+void OsqueryWorker::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+		cond.wait(lock, [this] { return stop || queueCount > 0; });
+		if (stop) {
+			return;
+		}
+
+		const Request request = queue[queueHead];
+		queueHead = (queueHead + 1) % queue.size();
+		queueCount--;
+
+		// Socket may have been resolved by a flow queued earlier
+		const auto now = std::chrono::steady_clock::now();
+		auto source = cache.find(getSocket(request, true));
+		auto destination = cache.find(getSocket(request, false));
+		if ((source != cache.end() && source->second.expiration > now)
+			|| (destination != cache.end() && destination->second.found
+				&& destination->second.expiration > now)) {
+			continue;
+		}
+		lock.unlock();
+
+		const ConvertedFlowData flowData = request.ipVersion == IP::v4
+			? ConvertedFlowData(
+				request.srcIP.v4,
+				request.dstIP.v4,
+				request.srcPort,
+				request.dstPort)
+			: ConvertedFlowData(
+				request.srcIP.v6,
+				request.dstIP.v6,
+				request.srcPort,
+				request.dstPort);
+
+		// Not found sockets are stored as the flow source
+		bool sourceIsLocal = true;
+		OsqueryProgramInfo info;
+		info.found = manager->readInfoAboutProgram(flowData, sourceIsLocal);
+		info.expiration = std::chrono::steady_clock::now() + std::chrono::seconds(CACHE_TTL);
+		if (info.found) {
+			info.program_name = manager->getRecord()->program_name;
+			info.username = manager->getRecord()->username;
+		}
+
+		lock.lock();
+		store(getSocket(request, sourceIsLocal), std::move(info));
+	}
+}
+
+void OsqueryWorker::store(const OsquerySocket& socket, OsqueryProgramInfo&& info)
+{
+	if (cache.size() >= MAX_CACHE_SIZE) {
+		const auto now = std::chrono::steady_clock::now();
+		for (auto it = cache.begin(); it != cache.end();) {
+			it = it->second.expiration <= now ? cache.erase(it) : std::next(it);
+		}
+		if (cache.size() >= MAX_CACHE_SIZE) {
+			cache.clear();
+		}
+	}
+	cache[socket] = std::move(info);
+}
+
+OsquerySocket OsqueryWorker::getSocket(const Flow& flow, bool source)
+{
+	OsquerySocket socket;
+	socket.ip_version = flow.ip_version;
+	socket.proto = flow.ip_proto;
+	socket.port = source ? flow.src_port : flow.dst_port;
+	socket.addr = source ? flow.src_ip : flow.dst_ip;
+	return socket;
+}
+
+OsquerySocket OsqueryWorker::getSocket(const Request& request, bool source)
+{
+	OsquerySocket socket;
+	socket.ip_version = request.ipVersion;
+	socket.proto = request.proto;
+	socket.port = source ? request.srcPort : request.dstPort;
+	socket.addr = source ? request.srcIP : request.dstIP;
+	return socket;
 }
 
 ConvertedFlowData::ConvertedFlowData(
@@ -129,45 +314,17 @@ ConvertedFlowData::ConvertedFlowData(
 
 void ConvertedFlowData::convertIPv4(uint32_t addr, bool isSourceIP)
 {
-	std::stringstream ss;
-
-	ss << ((addr) & 0x000000ff) << "." << ((addr >> 8) & 0x000000ff) << "."
-	   << ((addr >> 16) & 0x000000ff) << "." << ((addr >> 24) & 0x000000ff);
-
-	if (isSourceIP) {
-		this->src_ip = ss.str();
-	} else {
-		this->dst_ip = ss.str();
-	}
+	inet_ntop(AF_INET, &addr, isSourceIP ? src_ip : dst_ip, INET6_ADDRSTRLEN);
 }
 
 void ConvertedFlowData::convertIPv6(const uint8_t* addr, bool isSourceIP)
 {
-	std::stringstream ss;
-
-	ss << HEX(addr[0]);
-	for (int i = 1; i < 16; i++) {
-		ss << ":" << HEX(addr[i]);
-	}
-
-	if (isSourceIP) {
-		this->src_ip = ss.str();
-	} else {
-		this->dst_ip = ss.str();
-	}
+	inet_ntop(AF_INET6, addr, isSourceIP ? src_ip : dst_ip, INET6_ADDRSTRLEN);
 }
 
 void ConvertedFlowData::convertPort(uint16_t port, bool isSourcePort)
 {
-	std::stringstream ss;
-
-	ss << port;
-
-	if (isSourcePort) {
-		this->src_port = ss.str();
-	} else {
-		this->dst_port = ss.str();
-	}
+	snprintf(isSourcePort ? src_port : dst_port, sizeof(src_port), "%u", port);
 }
 
 OsqueryRequestManager::OsqueryRequestManager(int pluginID)
@@ -219,7 +376,9 @@ void OsqueryRequestManager::readInfoAboutOS()
 	}
 }
 
-bool OsqueryRequestManager::readInfoAboutProgram(const ConvertedFlowData& flowData)
+bool OsqueryRequestManager::readInfoAboutProgram(
+	const ConvertedFlowData& flowData,
+	bool& sourceIsLocal)
 {
 	if (handler.isFatalError()) {
 		return false;
@@ -229,10 +388,12 @@ bool OsqueryRequestManager::readInfoAboutProgram(const ConvertedFlowData& flowDa
 	recOsquery->username = DEFAULT_FILL_TEXT;
 
 	std::string pid;
+	std::string localPort;
 
-	if (!getPID(pid, flowData)) {
+	if (!getPID(pid, localPort, flowData)) {
 		return false;
 	}
+	sourceIsLocal = localPort == flowData.src_port;
 
 	std::string query
 		= "SELECT p.name, u.username FROM processes AS p INNER JOIN users AS u ON p.uid=u.uid "
@@ -414,20 +575,23 @@ void OsqueryRequestManager::killPreviousProcesses(bool useWhonangOption) const
 	}
 }
 
-bool OsqueryRequestManager::getPID(std::string& pid, const ConvertedFlowData& flowData)
+bool OsqueryRequestManager::getPID(
+	std::string& pid,
+	std::string& localPort,
+	const ConvertedFlowData& flowData)
 {
-	std::string query = "SELECT pid FROM process_open_sockets WHERE "
-     "(local_address='" + flowData.src_ip + "' AND "
-     "remote_address='" + flowData.dst_ip + "' AND "
-     "local_port='" + flowData.src_port + "' AND "
-     "remote_port='" + flowData.dst_port + "') OR "
-     "(local_address='" + flowData.dst_ip + "' AND "
-     "remote_address='" + flowData.src_ip + "' AND "
-     "local_port='" + flowData.dst_port + "' AND "
-     "remote_port='" + flowData.src_port + "') LIMIT 1;\r\n";
+	std::string query = "SELECT pid, local_port FROM process_open_sockets WHERE ";
+	query = query + "(local_address='" + flowData.src_ip + "' AND "
+		+ "remote_address='" + flowData.dst_ip + "' AND "
+		+ "local_port='" + flowData.src_port + "' AND "
+		+ "remote_port='" + flowData.dst_port + "') OR "
+		+ "(local_address='" + flowData.dst_ip + "' AND "
+		+ "remote_address='" + flowData.src_ip + "' AND "
+		+ "local_port='" + flowData.dst_port + "' AND "
+		+ "remote_port='" + flowData.src_port + "') LIMIT 1;\r\n";
 
 	if (executeQuery(query) > 0) {
-		if (parseJsonSingleItem("pid", pid)) {
+		if (parseJsonSocket(pid, localPort)) {
 			return true;
 		}
 	}
@@ -467,6 +631,40 @@ bool OsqueryRequestManager::parseJsonSingleItem(
 	}
 }
 
+bool OsqueryRequestManager::parseJsonSocket(std::string& pid, std::string& localPort)
+{
+	int pos = getPositionForParseJson();
+
+	if (pos == -1) {
+		return false;
+	}
+
+	int count = 0;
+	std::string key, value;
+
+	while (true) {
+		key.clear();
+		value.clear();
+		pos = parseJsonItem(pos, key, value);
+		if (pos < 0) {
+			return false;
+		}
+		if (pos == 0) {
+			return count == 2;
+		}
+
+		if (key == "pid") {
+			pid = value;
+			count++;
+		} else if (key == "local_port") {
+			localPort = value;
+			count++;
+		} else {
+			return false;
+		}
+	}
+}
+
 bool OsqueryRequestManager::parseJsonOSVersion()
 {
 	int pos = getPositionForParseJson();
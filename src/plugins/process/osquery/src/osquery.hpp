@@ -12,10 +12,17 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include <arpa/inet.h>
 #include <poll.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -45,6 +52,11 @@
 #define WRITE_FD 1
 #define MAX_NUMBER_OF_ATTEMPTS 2 // Max number of osquery error correction attempts
 
+// OsqueryWorker
+#define REQUEST_QUEUE_SIZE 1024 // Max number of flows waiting for osquery, others are dropped
+#define CACHE_TTL 30 // seconds
+#define MAX_CACHE_SIZE 65536 // Max number of cached sockets
+
 #define OSQUERY_UNIREC_TEMPLATE                                                                    \
 	"OSQUERY_PROGRAM_NAME,OSQUERY_USERNAME,OSQUERY_OS_NAME,OSQUERY_OS_MAJOR,OSQUERY_OS_MINOR,"     \
 	"OSQUERY_OS_BUILD,OSQUERY_OS_PLATFORM,OSQUERY_OS_PLATFORM_LIKE,OSQUERY_OS_ARCH,OSQUERY_"       \
@@ -299,6 +311,7 @@ private:
  * dst_port) to string.
  */
 struct ConvertedFlowData {
+
 	/**
 	 * Constructor for IPv4-based flow.
 	 * @param sourceIPv4 source IPv4 address.
@@ -325,10 +338,10 @@ struct ConvertedFlowData {
 		uint16_t sourcePort,
 		uint16_t destinationPort);
 
-	std::string src_ip;
-	std::string dst_ip;
-	std::string src_port;
-	std::string dst_port;
+	char src_ip[INET6_ADDRSTRLEN];
+	char dst_ip[INET6_ADDRSTRLEN];
+	char src_port[6];
+	char dst_port[6];
 
 private:
 	/**
@@ -373,10 +386,11 @@ struct OsqueryRequestManager {
 
 	/**
 	 * Fills the record with program values from osquery.
-	 * @param flowData flow data converted to string.
+	 * @param[in]  flowData      flow data converted to string.
+	 * @param[out] sourceIsLocal true if the socket of the program is the flow source.
 	 * @return true if success or false.
 	 */
-	bool readInfoAboutProgram(const ConvertedFlowData& flowData);
+	bool readInfoAboutProgram(const ConvertedFlowData& flowData, bool& sourceIsLocal);
 
 private:
 	/**
@@ -429,11 +443,12 @@ private:
 
 	/**
 	 * Tries to get the process id from table "process_open_sockets".
-	 * @param[out] pid      process id.
-	 * @param[in]  flowData flow data converted to string.
+	 * @param[out] pid       process id.
+	 * @param[out] localPort local port of the socket.
+	 * @param[in]  flowData  flow data converted to string.
 	 * @return true true if success or false.
 	 */
-	bool getPID(std::string& pid, const ConvertedFlowData& flowData);
+	bool getPID(std::string& pid, std::string& localPort, const ConvertedFlowData& flowData);
 
 	/**
 	 * Parses json string with only one element.
@@ -443,6 +458,14 @@ private:
 	 */
 	bool parseJsonSingleItem(const std::string& singleKey, std::string& singleValue);
 
+	/**
+	 * Parses json by template.
+	 * @param[out] pid       process id.
+	 * @param[out] localPort local port of the socket.
+	 * @return true if success or false.
+	 */
+	bool parseJsonSocket(std::string& pid, std::string& localPort);
+
 	/**
 	 * Parses json by template.
 	 * @return true if success or false.
@@ -506,6 +529,114 @@ private:
 	OsqueryStateHandler handler;
 };
 
+/**
+ * \brief Local socket of a flow.
+ */
+struct OsquerySocket {
+	uint8_t ip_version;
+	uint8_t proto;
+	uint16_t port;
+	ipaddr_t addr;
+
+	bool operator==(const OsquerySocket& other) const
+	{
+		return ip_version == other.ip_version && proto == other.proto && port == other.port
+			&& memcmp(&addr, &other.addr, ip_version == IP::v4 ? 4 : 16) == 0;
+	}
+};
+
+struct OsquerySocketHash {
+	size_t operator()(const OsquerySocket& socket) const
+	{
+		uint64_t hash = (uint64_t) socket.ip_version << 24 | (uint64_t) socket.proto << 16
+			| socket.port;
+		const uint8_t* addr = (const uint8_t*) &socket.addr;
+		for (int i = 0; i < (socket.ip_version == IP::v4 ? 4 : 16); i++) {
+			hash = (hash ^ addr[i]) * 0x100000001b3ULL;
+		}
+		return hash;
+	}
+};
+
+/**
+ * \brief Program owning a socket, as reported by osquery.
+ */
+struct OsqueryProgramInfo {
+	bool found; /**< False when osquery does not know the socket */
+	std::chrono::steady_clock::time_point expiration;
+	std::string program_name;
+	std::string username;
+};
+
+/**
+ * \brief Resolves flows to programs on a background thread.
+ *
+ * Queries to osquery take milliseconds, so flows are only queued by the packet processing thread
+ * and the worker thread fills a cache of local sockets with the answers. Flows are looked up in
+ * the cache when they are created and again when they are exported, so answers arriving during
+ * the life of the flow are used as well. Flows of a socket not known to osquery are cached too
+ * and not queried again until the entry expires.
+ */
+class OsqueryWorker {
+public:
+	/**
+	 * Starts the worker thread.
+	 * @param manager manager used only by the worker thread from now on.
+	 */
+	OsqueryWorker(OsqueryRequestManager* manager);
+
+	/**
+	 * Stops the worker thread, queued flows are dropped.
+	 */
+	~OsqueryWorker();
+
+	/**
+	 * Looks up the program of a flow in the cache.
+	 * @param[in]  flow    flow to look up.
+	 * @param[in]  request if true - queue the flow for osquery when it is not cached.
+	 * @param[out] info    program of the flow.
+	 * @return true if the program is known.
+	 */
+	bool lookup(const Flow& flow, bool request, OsqueryProgramInfo& info);
+
+	/**
+	 * Number of flows not queued because the queue was full.
+	 */
+	uint64_t getDroppedRequests();
+
+private:
+	/**
+	 * Flow waiting for osquery.
+	 */
+	struct Request {
+		uint8_t ipVersion;
+		uint8_t proto;
+		uint16_t srcPort;
+		uint16_t dstPort;
+		ipaddr_t srcIP;
+		ipaddr_t dstIP;
+	};
+
+	void run();
+	void store(const OsquerySocket& socket, OsqueryProgramInfo&& info);
+
+	static OsquerySocket getSocket(const Flow& flow, bool source);
+	static OsquerySocket getSocket(const Request& request, bool source);
+
+	OsqueryRequestManager* manager;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool stop;
+
+	std::vector<Request> queue; /**< Ring buffer of REQUEST_QUEUE_SIZE flows */
+	size_t queueHead;
+	size_t queueCount;
+	uint64_t droppedRequests;
+
+	std::unordered_map<OsquerySocket, OsqueryProgramInfo, OsquerySocketHash> cache;
+};
+
 /**
  * \brief Flow cache plugin for parsing OSQUERY packets.
  */
@@ -527,10 +658,17 @@ public:
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
+	void pre_export(Flow& rec);
 	void finish(bool print_stats);
 
 private:
-	OsqueryRequestManager* manager;
+	/**
+	 * Adds extension with the program and OS information to the flow.
+	 */
+	void addExtension(Flow& rec, const OsqueryProgramInfo& info);
+
+	OsqueryWorker* worker;
+	RecordExtOSQUERY* osRecord; /**< OS information of all records */
 	int numberOfSuccessfullyRequests;
 };
 
@@ -16,15 +16,13 @@
 #include <unirec/unirec.h>
 #endif
 
+#include <cctype>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <limits>
 #include <sstream>
-#include <type_traits>
 
 #include <arpa/inet.h>
-#include <errno.h>
 #include <ipfixprobe/pluginFactory/pluginManifest.hpp>
 #include <ipfixprobe/pluginFactory/pluginRegistrar.hpp>
 #include <ipfixprobe/utils.hpp>
@@ -61,18 +59,6 @@ static const PluginManifest passivednsPluginManifest = {
 #define DEBUG_CODE(code)
 #endif
 
-/**
- * \brief Check for label pointer in DNS name.
- */
-#define IS_POINTER(ch) ((ch & 0xC0) == 0xC0)
-
-#define MAX_LABEL_CNT 127
-
-/**
- * \brief Get offset from 2 byte pointer.
- */
-#define GET_OFFSET(half1, half2) ((((uint8_t) (half1) & 0x3F) << 8) | (uint8_t) (half2))
-
 PassiveDNSPlugin::PassiveDNSPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
 	, total(0)
@@ -146,67 +132,27 @@ void PassiveDNSPlugin::finish(bool print_stats)
  */
 size_t PassiveDNSPlugin::get_name_length(const char* data) const
 {
-	size_t len = 0;
-
-	while (1) {
-		if ((uint32_t) (data - data_begin) + 1 > data_len) {
-			throw "Error: overflow";
-		}
-		if (!data[0]) {
-			break;
-		}
-		if (IS_POINTER(data[0])) {
-			return len + 2;
-		}
-
-		len += (uint8_t) data[0] + 1;
-		data += (uint8_t) data[0] + 1;
+	const size_t len = dns_name_length(data_begin, data_len, data);
+	if (len == 0) {
+		throw "Error: overflow";
 	}
-
-	return len + 1;
+	return len;
 }
 
 /**
  * \brief Decompress dns name.
  * \param [in] data Pointer to compressed data.
- * \return String with decompressed dns name.
+ * \param [out] out Buffer for the decompressed name, the name is truncated to fit.
+ * \param [in] size Size of the buffer.
+ * \return Length of the decompressed name.
  */
-std::string PassiveDNSPlugin::get_name(const char* data) const
+size_t PassiveDNSPlugin::get_name(const char* data, char* out, size_t size) const
 {
-	std::string name = "";
-	int label_cnt = 0;
-
-	if ((uint32_t) (data - data_begin) > data_len) {
-		throw "Error: overflow";
+	size_t len;
+	if (!dns_decode_name(data_begin, data_len, data, out, size, len)) {
+		throw "Error: label count exceed or overflow";
 	}
-
-	while (data[0]) { /* Check for terminating character. */
-		if (IS_POINTER(data[0])) { /* Check for label pointer (11xxxxxx byte) */
-			data = data_begin + GET_OFFSET(data[0], data[1]);
-
-			/* Check for possible errors.*/
-			if (label_cnt++ > MAX_LABEL_CNT || (uint32_t) (data - data_begin) > data_len) {
-				throw "Error: label count exceed or overflow";
-			}
-
-			continue;
-		}
-
-		/* Check for possible errors.*/
-		if (label_cnt++ > MAX_LABEL_CNT || (uint8_t) data[0] > 63
-			|| (uint32_t) ((data - data_begin) + (uint8_t) data[0] + 2) > data_len) {
-			throw "Error: label count exceed or overflow";
-		}
-
-		name += '.' + std::string(data + 1, (uint8_t) data[0]);
-		data += ((uint8_t) data[0] + 1);
-	}
-
-	if (name.length() > 0 && name[0] == '.') {
-		name.erase(0, 1);
-	}
-
-	return name;
+	return len;
 }
 
 /**
@@ -288,10 +234,11 @@ PassiveDNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp
 		*****                    DNS Answers section                    *****
 		********************************************************************/
 		size_t rdlength;
+		char name[DNS_MAX_NAME_LEN + 1];
 		for (int i = 0; i < answer_rr_cnt; i++) { // Process answers section.
 			DEBUG_MSG("DNS answer #%d\n", i + 1);
-			DEBUG_MSG("\tAnswer name:\t\t%s\n", get_name(data).c_str());
-			std::string name = get_name(data);
+			size_t name_len = get_name(data, name, sizeof(name));
+			DEBUG_MSG("\tAnswer name:\t\t%s\n", name);
 			data += get_name_length(data);
 
 			struct dns_answer* answer = (struct dns_answer*) data;
@@ -314,7 +261,7 @@ PassiveDNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp
 			if (type == DNS_TYPE_A || type == DNS_TYPE_AAAA) {
 				RecordExtPassiveDNS* rec = new RecordExtPassiveDNS(m_pluginID);
 
-				size_t length = name.length();
+				size_t length = name_len;
 				if (length >= sizeof(rec->aname)) {
 					DEBUG_MSG(
 						"Truncating aname (length = %lu) to %lu.\n",
@@ -322,7 +269,7 @@ PassiveDNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp
 						sizeof(rec->aname) - 1);
 					length = sizeof(rec->aname) - 1;
 				}
-				memcpy(rec->aname, name.c_str(), length);
+				memcpy(rec->aname, name, length);
 				rec->aname[length] = 0;
 
 				rec->id = ntohs(dns->id);
@@ -354,19 +301,9 @@ PassiveDNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp
 				rec->atype = type;
 
 				/* Copy domain name. */
-				std::string tmp = get_name(data);
-				size_t length = tmp.length();
-				if (length >= sizeof(rec->aname)) {
-					DEBUG_MSG(
-						"Truncating aname (length = %lu) to %lu.\n",
-						length,
-						sizeof(rec->aname) - 1);
-					length = sizeof(rec->aname) - 1;
-				}
-				memcpy(rec->aname, tmp.c_str(), length);
-				rec->aname[length] = 0;
+				get_name(data, rec->aname, sizeof(rec->aname));
 
-				if (!process_ptr_record(name, rec)) {
+				if (!process_ptr_record(std::string_view(name, name_len), rec)) {
 					delete rec;
 				} else {
 					parsed_ptr++;
@@ -390,32 +327,39 @@ PassiveDNSPlugin::parse_dns(const char* data, unsigned int payload_len, bool tcp
 }
 
 /**
- * \brief Provides conversion from string to uint4_t.
- * \param [in] str String representation of value.
- * \param [out] dst Destination variable.
- * \return True on success, false otherwise.
+ * \brief Remove suffix of domain name, compared case insensitively.
+ * \param [in,out] name Domain name.
+ * \param [in] suffix Lowercase suffix.
+ * \return True when the name ended with the suffix.
  */
-bool PassiveDNSPlugin::str_to_uint4(std::string str, uint8_t& dst)
+static bool strip_name_suffix(std::string_view& name, std::string_view suffix)
 {
-	size_t check;
-	errno = 0;
-	trim_str(str);
-	unsigned long long value;
-	try {
-		value = std::stoull(str, &check, 16);
-	} catch (std::invalid_argument& e) {
-		return false;
-	} catch (std::out_of_range& e) {
+	if (name.length() < suffix.length()) {
 		return false;
 	}
-	if (errno == ERANGE || str[0] == '-' || check != str.size() || value > 15) {
-		return false;
+	const size_t begin = name.length() - suffix.length();
+	for (size_t i = 0; i < suffix.length(); i++) {
+		if (tolower(static_cast<unsigned char>(name[begin + i])) != suffix[i]) {
+			return false;
+		}
 	}
-
-	dst = value;
+	name.remove_suffix(suffix.length());
 	return true;
 }
 
+/**
+ * \brief Split the first label off domain name.
+ * \param [in,out] name Domain name, the label and its dot are removed.
+ * \return The label.
+ */
+static std::string_view next_label(std::string_view& name)
+{
+	const size_t end = name.find('.');
+	const std::string_view label = name.substr(0, end);
+	name.remove_prefix(end == std::string_view::npos ? name.length() : end + 1);
+	return label;
+}
+
 /**
  * \brief Get IP address from domain name.
  *
@@ -423,78 +367,58 @@ bool PassiveDNSPlugin::str_to_uint4(std::string str, uint8_t& dst)
  * \param [out] rec Plugin data record.
  * \return True on success, false otherwise.
  */
-bool PassiveDNSPlugin::process_ptr_record(std::string name, RecordExtPassiveDNS* rec)
+bool PassiveDNSPlugin::process_ptr_record(std::string_view name, RecordExtPassiveDNS* rec)
 {
 	memset(&rec->ip, 0, sizeof(rec->ip));
 
-	if (name.length() > 0 && name[name.length() - 1] == '.') {
-		name.erase(name.length() - 1);
-	}
-
-	for (unsigned i = 0; i < name.length(); i++) {
-		name[i] = tolower(name[i]);
+	if (name.length() > 0 && name.back() == '.') {
+		name.remove_suffix(1);
 	}
 
-	std::string octet;
-	std::string type_str = ".in-addr.arpa";
-	size_t type_pos = name.find(type_str);
-	size_t begin = 0, end = 0, cnt = 0;
-	uint8_t* ip;
-	if (type_pos != std::string::npos && type_pos + type_str.length() == name.length()) {
-		// IPv4
-		name.erase(type_pos);
+	if (strip_name_suffix(name, ".in-addr.arpa")) {
+		// IPv4, decimal octets in reverse order
 		rec->ip_version = IP::v4;
-		ip = (uint8_t*) &rec->ip.v4;
-
-		while (end != std::string::npos) {
-			end = name.find(".", begin);
-			octet = name.substr(
-				begin,
-				(end == std::string::npos ? (name.length() - begin) : (end - begin)));
-			try {
-				ip[3 - cnt] = str2num<std::remove_reference<decltype(*ip)>::type>(octet);
-			} catch (std::invalid_argument& e) {
+		uint8_t* ip = (uint8_t*) &rec->ip.v4;
+		for (int cnt = 0; cnt < 4; cnt++) {
+			const std::string_view octet = next_label(name);
+			if (octet.empty() || octet.length() > 3) {
 				return false;
 			}
-			if (cnt > 3) {
-				return false;
-			}
-
-			cnt++;
-			begin = end + 1;
-		}
-		return cnt == 4;
-	} else {
-		type_str = ".ip6.arpa";
-		type_pos = name.find(type_str);
-		if (type_pos != std::string::npos && type_pos + type_str.length() == name.length()) {
-			// IPv6
-			name.erase(type_pos);
-			rec->ip_version = IP::v6;
-			ip = (uint8_t*) &rec->ip.v6;
-
-			uint8_t nums[32];
-			while (end != std::string::npos) {
-				end = name.find(".", begin);
-				octet = name.substr(
-					begin,
-					(end == std::string::npos ? (name.length() - begin) : (end - begin)));
-				if (cnt > 31 || !str_to_uint4(octet, nums[31 - cnt])) {
+			unsigned value = 0;
+			for (char c : octet) {
+				if (c < '0' || c > '9') {
 					return false;
 				}
-
-				cnt++;
-				begin = end + 1;
+				value = value * 10 + (c - '0');
 			}
-			if (cnt != 32) {
+			if (value > 255) {
 				return false;
 			}
+			ip[3 - cnt] = value;
+		}
+		return name.empty();
+	}
 
-			for (int i = 0; i < 16; i++) {
-				rec->ip.v6[i] = (nums[i] << 4) | nums[i];
+	if (strip_name_suffix(name, ".ip6.arpa")) {
+		// IPv6, hexadecimal nibbles in reverse order
+		rec->ip_version = IP::v6;
+		uint8_t nums[32];
+		for (int cnt = 0; cnt < 32; cnt++) {
+			const std::string_view nibble = next_label(name);
+			if (nibble.length() != 1 || !isxdigit(static_cast<unsigned char>(nibble[0]))) {
+				return false;
 			}
-			return true;
+			const int c = tolower(static_cast<unsigned char>(nibble[0]));
+			nums[31 - cnt] = c <= '9' ? c - '0' : c - 'a' + 10;
+		}
+		if (!name.empty()) {
+			return false;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			rec->ip.v6[i] = (nums[i] << 4) | nums[i];
 		}
+		return true;
 	}
 
 	return false;
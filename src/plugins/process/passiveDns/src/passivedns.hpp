@@ -15,6 +15,7 @@
 #include <cstring>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #ifdef WITH_NEMEA
 #include "fields.h"
@@ -137,6 +138,12 @@ public:
 	}
 	std::string get_name() const { return "passivedns"; }
 	RecordExt* get_ext() const { return new RecordExtPassiveDNS(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {53};
+		return interest;
+	}
 	ProcessPlugin* copy();
 	int post_create(Flow& rec, const Packet& pkt);
 	int post_update(Flow& rec, const Packet& pkt);
@@ -154,10 +161,9 @@ private:
 	RecordExtPassiveDNS* parse_dns(const char* data, unsigned int payload_len, bool tcp);
 	int add_ext_dns(const char* data, unsigned int payload_len, bool tcp, Flow& rec);
 
-	std::string get_name(const char* data) const;
+	size_t get_name(const char* data, char* out, size_t size) const;
 	size_t get_name_length(const char* data) const;
-	bool process_ptr_record(std::string name, RecordExtPassiveDNS* rec);
-	bool str_to_uint4(std::string str, uint8_t& dst);
+	bool process_ptr_record(std::string_view name, RecordExtPassiveDNS* rec);
 };
 
 } // namespace ipxp
@@ -520,6 +520,7 @@ int QUICPlugin::pre_update(Flow& rec, Packet& pkt)
 
 int QUICPlugin::post_update(Flow& rec, const Packet& pkt)
 {
+	// Multiplexed connections and 0-RTT packets are counted for the whole flow, stay active
 	return add_quic(rec, pkt);
 }
 
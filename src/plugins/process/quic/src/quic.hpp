@@ -367,6 +367,12 @@ public:
 	void init(const char* params);
 	void close();
 	RecordExt* get_ext() const { return new RecordExtQUIC(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.protocols = PacketInterest::UDP;
+		return interest;
+	}
 
 	OptionsParser* get_parser() const { return new OptionsParser("quic", "Parse QUIC traffic"); }
 
@@ -530,6 +530,218 @@ bool expand_label(
 	return true;
 }
 
+/**
+ * \brief OpenSSL contexts and derived initial secrets of one thread.
+ *
+ * Contexts are allocated once per thread and only reinitialized for every packet. HKDF is
+ * computed as HMAC-SHA256 over the reusable digest context, which avoids creating an
+ * EVP_PKEY_CTX for every Extract and Expand step.
+ *
+ * Initial secrets depend only on the QUIC version and the original DCID, so they are kept in
+ * a direct-mapped cache and retransmitted or coalesced Initial packets of the same connection
+ * skip the derivation.
+ */
+class QUICCrypto {
+public:
+	/** Number of cached initial secrets, power of two. */
+	static const size_t CACHE_SIZE = 1024;
+
+	QUICCrypto()
+		: md_ctx(EVP_MD_CTX_new())
+		, ecb_ctx(EVP_CIPHER_CTX_new())
+		, gcm_ctx(EVP_CIPHER_CTX_new())
+		, gcm_ready(false)
+		, cache()
+	{
+	}
+
+	~QUICCrypto()
+	{
+		EVP_MD_CTX_free(md_ctx);
+		EVP_CIPHER_CTX_free(ecb_ctx);
+		EVP_CIPHER_CTX_free(gcm_ctx);
+	}
+
+	QUICCrypto(const QUICCrypto&) = delete;
+	QUICCrypto& operator=(const QUICCrypto&) = delete;
+
+	static QUICCrypto& get()
+	{
+		static thread_local QUICCrypto crypto;
+		return crypto;
+	}
+
+	bool valid() const { return md_ctx != nullptr && ecb_ctx != nullptr && gcm_ctx != nullptr; }
+
+	/**
+	 * \brief HKDF-Extract with SHA-256.
+	 * \param [out] prk Pseudorandom key of HASH_SHA2_256_LENGTH bytes.
+	 */
+	bool hkdf_extract(
+		const uint8_t* salt,
+		size_t salt_len,
+		const uint8_t* ikm,
+		size_t ikm_len,
+		uint8_t* prk)
+	{
+		return hmac(salt, salt_len, ikm, ikm_len, nullptr, 0, prk);
+	}
+
+	/**
+	 * \brief HKDF-Expand with SHA-256 producing at most HASH_SHA2_256_LENGTH bytes.
+	 */
+	bool hkdf_expand(
+		const uint8_t* prk,
+		const uint8_t* info,
+		size_t info_len,
+		uint8_t* out,
+		size_t out_len)
+	{
+		// Output fits into the first block T(1) = HMAC(PRK, info || 0x01)
+		const uint8_t counter = 1;
+		uint8_t block[HASH_SHA2_256_LENGTH];
+
+		if (out_len > sizeof(block)
+			|| !hmac(prk, HASH_SHA2_256_LENGTH, info, info_len, &counter, 1, block)) {
+			return false;
+		}
+		memcpy(out, block, out_len);
+		return true;
+	}
+
+	EVP_CIPHER_CTX* get_ecb_ctx() { return ecb_ctx; }
+
+	/**
+	 * \brief Get AES-128-GCM context with the nonce length of TLS 1.3 set.
+	 */
+	EVP_CIPHER_CTX* get_gcm_ctx()
+	{
+		if (!gcm_ready) {
+			if (!EVP_DecryptInit_ex(gcm_ctx, EVP_aes_128_gcm(), NULL, NULL, NULL)
+				|| !EVP_CIPHER_CTX_ctrl(
+					gcm_ctx,
+					EVP_CTRL_AEAD_SET_IVLEN,
+					TLS13_AEAD_NONCE_LENGTH,
+					NULL)) {
+				return nullptr;
+			}
+			gcm_ready = true;
+		}
+		return gcm_ctx;
+	}
+
+	/**
+	 * \brief Find secrets derived for the DCID before.
+	 */
+	bool lookup(
+		const uint8_t* salt,
+		bool is_version2,
+		const uint8_t* dcid,
+		uint8_t dcid_len,
+		Initial_Secrets& secrets) const
+	{
+		if (dcid_len > MAX_CID_LEN) {
+			return false;
+		}
+		const CacheEntry& entry = cache[index(dcid, dcid_len)];
+		if (entry.salt != salt || entry.is_version2 != is_version2 || entry.dcid_len != dcid_len
+			|| memcmp(entry.dcid, dcid, dcid_len) != 0) {
+			return false;
+		}
+		secrets = entry.secrets;
+		return true;
+	}
+
+	void insert(
+		const uint8_t* salt,
+		bool is_version2,
+		const uint8_t* dcid,
+		uint8_t dcid_len,
+		const Initial_Secrets& secrets)
+	{
+		if (dcid_len > MAX_CID_LEN) {
+			return;
+		}
+		CacheEntry& entry = cache[index(dcid, dcid_len)];
+		entry.salt = salt;
+		entry.is_version2 = is_version2;
+		entry.dcid_len = dcid_len;
+		memcpy(entry.dcid, dcid, dcid_len);
+		entry.secrets = secrets;
+	}
+
+private:
+	struct CacheEntry {
+		const uint8_t* salt; /**< Salt of the version, nullptr for an empty entry */
+		bool is_version2;
+		uint8_t dcid_len;
+		uint8_t dcid[MAX_CID_LEN];
+		Initial_Secrets secrets; /**< Secrets with IV not combined with a packet number */
+	};
+
+	static const size_t SHA256_BLOCK_LENGTH = 64;
+
+	EVP_MD_CTX* md_ctx;
+	EVP_CIPHER_CTX* ecb_ctx;
+	EVP_CIPHER_CTX* gcm_ctx;
+	bool gcm_ready;
+	CacheEntry cache[CACHE_SIZE];
+
+	static size_t index(const uint8_t* dcid, uint8_t dcid_len)
+	{
+		uint32_t hash = 2166136261U;
+		for (uint8_t i = 0; i < dcid_len; i++) {
+			hash = (hash ^ dcid[i]) * 16777619U;
+		}
+		return hash & (CACHE_SIZE - 1);
+	}
+
+	/**
+	 * \brief HMAC-SHA256 of data || suffix.
+	 */
+	bool hmac(
+		const uint8_t* key,
+		size_t key_len,
+		const uint8_t* data,
+		size_t data_len,
+		const uint8_t* suffix,
+		size_t suffix_len,
+		uint8_t* out)
+	{
+		uint8_t pad[SHA256_BLOCK_LENGTH] = {0};
+		uint8_t inner[HASH_SHA2_256_LENGTH];
+
+		if (key_len > sizeof(pad)) {
+			if (!EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL)
+				|| !EVP_DigestUpdate(md_ctx, key, key_len)
+				|| !EVP_DigestFinal_ex(md_ctx, pad, NULL)) {
+				return false;
+			}
+		} else {
+			memcpy(pad, key, key_len);
+		}
+
+		for (size_t i = 0; i < sizeof(pad); i++) {
+			pad[i] ^= 0x36;
+		}
+		if (!EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL)
+			|| !EVP_DigestUpdate(md_ctx, pad, sizeof(pad))
+			|| !EVP_DigestUpdate(md_ctx, data, data_len)
+			|| (suffix_len != 0 && !EVP_DigestUpdate(md_ctx, suffix, suffix_len))
+			|| !EVP_DigestFinal_ex(md_ctx, inner, NULL)) {
+			return false;
+		}
+
+		for (size_t i = 0; i < sizeof(pad); i++) {
+			pad[i] ^= 0x36 ^ 0x5c;
+		}
+		return EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL)
+			&& EVP_DigestUpdate(md_ctx, pad, sizeof(pad))
+			&& EVP_DigestUpdate(md_ctx, inner, sizeof(inner))
+			&& EVP_DigestFinal_ex(md_ctx, out, NULL);
+	}
+};
+
 bool quic_derive_n_set(
 	uint8_t* secret,
 	uint8_t* expanded_label,
@@ -537,40 +749,10 @@ bool quic_derive_n_set(
 	size_t output_len,
 	uint8_t* store_data)
 {
-	EVP_PKEY_CTX* pctx;
-
-	pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
-	if (1 != EVP_PKEY_derive_init(pctx)) {
-		DEBUG_MSG("Error, context initialization failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY)) {
-		DEBUG_MSG("Error, mode initialization failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256())) {
-		DEBUG_MSG("Error, message digest initialization failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_add1_hkdf_info(pctx, expanded_label, size)) {
-		DEBUG_MSG("Error, info initialization failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set1_hkdf_key(pctx, secret, HASH_SHA2_256_LENGTH)) {
-		DEBUG_MSG("Error, key initialization failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_derive(pctx, store_data, &output_len)) {
+	if (!QUICCrypto::get().hkdf_expand(secret, expanded_label, size, store_data, output_len)) {
 		DEBUG_MSG("Error, HKDF-Expand derivation failed %s\n", (char*) expanded_label);
-		EVP_PKEY_CTX_free(pctx);
 		return false;
 	}
-	EVP_PKEY_CTX_free(pctx);
 	return true;
 } // QUICPlugin::quic_derive_n_set
 
@@ -653,47 +835,24 @@ bool QUICParser::quic_create_initial_secrets()
 		initial_dcid = (uint8_t*) dcid;
 	}
 
-	uint8_t extracted_secret[HASH_SHA2_256_LENGTH] = {0};
-	size_t extr_len = HASH_SHA2_256_LENGTH;
+	QUICCrypto& crypto = QUICCrypto::get();
+	if (!crypto.valid()) {
+		DEBUG_MSG("Error, crypto contexts are not allocated\n");
+		return false;
+	}
+	if (crypto.lookup(salt, is_version2, initial_dcid, initial_dcid_len, initial_secrets)) {
+		return true;
+	}
 
+	uint8_t extracted_secret[HASH_SHA2_256_LENGTH] = {0};
 	uint8_t expanded_secret[HASH_SHA2_256_LENGTH] = {0};
-	size_t expd_len = HASH_SHA2_256_LENGTH;
 
 	uint8_t expand_label_buffer[quic_clientin_hkdf];
 	uint8_t expand_label_len;
 
 	// HKDF-Extract
-	EVP_PKEY_CTX* pctx;
-
-	pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
-	if (1 != EVP_PKEY_derive_init(pctx)) {
-		DEBUG_MSG("Error, context initialization failed(Extract)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXTRACT_ONLY)) {
-		DEBUG_MSG("Error, mode initialization failed(Extract)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256())) {
-		DEBUG_MSG("Error, message digest initialization failed(Extract)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set1_hkdf_salt(pctx, salt, SALT_LENGTH)) {
-		DEBUG_MSG("Error, salt initialization failed(Extract)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set1_hkdf_key(pctx, initial_dcid, initial_dcid_len)) {
-		DEBUG_MSG("Error, key initialization failed(Extract)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_derive(pctx, extracted_secret, &extr_len)) {
+	if (!crypto.hkdf_extract(salt, SALT_LENGTH, initial_dcid, initial_dcid_len, extracted_secret)) {
 		DEBUG_MSG("Error, HKDF-Extract derivation failed\n");
-		EVP_PKEY_CTX_free(pctx);
 		return false;
 	}
 	// Expand-Label
@@ -706,71 +865,42 @@ bool QUICParser::quic_create_initial_secrets()
 		expand_label_buffer,
 		expand_label_len);
 	// HKDF-Expand
-	if (!EVP_PKEY_derive_init(pctx)) {
-		DEBUG_MSG("Error, context initialization failed(Expand)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY)) {
-		DEBUG_MSG("Error, mode initialization failed(Expand)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256())) {
-		DEBUG_MSG("Error, message digest initialization failed(Expand)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_add1_hkdf_info(pctx, expand_label_buffer, expand_label_len)) {
-		DEBUG_MSG("Error, info initialization failed(Expand)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_CTX_set1_hkdf_key(pctx, extracted_secret, HASH_SHA2_256_LENGTH)) {
-		DEBUG_MSG("Error, key initialization failed(Expand)\n");
-		EVP_PKEY_CTX_free(pctx);
-		return false;
-	}
-	if (1 != EVP_PKEY_derive(pctx, expanded_secret, &expd_len)) {
+	if (!crypto.hkdf_expand(
+			extracted_secret,
+			expand_label_buffer,
+			expand_label_len,
+			expanded_secret,
+			HASH_SHA2_256_LENGTH)) {
 		DEBUG_MSG("Error, HKDF-Expand derivation failed\n");
-		EVP_PKEY_CTX_free(pctx);
 		return false;
 	}
-	EVP_PKEY_CTX_free(pctx);
 	if (!quic_derive_secrets(expanded_secret)) {
 		DEBUG_MSG("Error, Derivation of initial secrets failed\n");
 		return false;
 	}
+	crypto.insert(salt, is_version2, initial_dcid, initial_dcid_len, initial_secrets);
 	return true;
 } // QUICPlugin::quic_create_initial_secrets
 
 bool QUICParser::quic_encrypt_sample(uint8_t* plaintext)
 {
 	int len = 0;
-	EVP_CIPHER_CTX* ctx;
+	EVP_CIPHER_CTX* ctx = QUICCrypto::get().get_ecb_ctx();
 
-	if (!(ctx = EVP_CIPHER_CTX_new())) {
-		DEBUG_MSG("Sample encryption, creating context failed\n");
-		return false;
-	}
 	if (!(EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, initial_secrets.hp, NULL))) {
 		DEBUG_MSG("Sample encryption, context initialization failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	// we need to disable padding so we can use EncryptFinal
 	EVP_CIPHER_CTX_set_padding(ctx, 0);
 	if (!(EVP_EncryptUpdate(ctx, plaintext, &len, sample, SAMPLE_LENGTH))) {
 		DEBUG_MSG("Sample encryption, decrypting header failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	if (!(EVP_EncryptFinal_ex(ctx, plaintext + len, &len))) {
 		DEBUG_MSG("Sample encryption, final header decryption failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
-	EVP_CIPHER_CTX_free(ctx);
 	return true;
 }
 
@@ -861,50 +991,35 @@ bool QUICParser::quic_decrypt_payload()
 	payload_len_offset = 16;
 
 	memcpy(&atag, &payload[payload_len], 16);
-	EVP_CIPHER_CTX* ctx;
+	// Cipher and NONCE length are kept from the previous use of the context
+	EVP_CIPHER_CTX* ctx = QUICCrypto::get().get_gcm_ctx();
 
-	if (!(ctx = EVP_CIPHER_CTX_new())) {
-		DEBUG_MSG("Payload decryption error, creating context failed\n");
-		return false;
-	}
-	if (!EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL)) {
+	if (ctx == nullptr) {
 		DEBUG_MSG("Payload decryption error, context initialization failed\n");
-		EVP_CIPHER_CTX_free(ctx);
-		return false;
-	}
-	if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, TLS13_AEAD_NONCE_LENGTH, NULL)) {
-		DEBUG_MSG("Payload decryption error, setting NONCE length failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	// SET NONCE and KEY
 	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, initial_secrets.key, initial_secrets.iv)) {
 		DEBUG_MSG("Payload decryption error, setting KEY and NONCE failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	// SET ASSOCIATED DATA (HEADER with unprotected PKN)
 	if (!EVP_DecryptUpdate(ctx, NULL, &len, header, header_len)) {
 		DEBUG_MSG("Payload decryption error, initializing authenticated data failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	if (!EVP_DecryptUpdate(ctx, decrypted_payload, &len, payload, payload_len)) {
 		DEBUG_MSG("Payload decryption error, decrypting payload failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, 16, atag)) {
 		DEBUG_MSG("Payload decryption error, TAG check failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
 	if (!EVP_DecryptFinal_ex(ctx, decrypted_payload + len, &len)) {
 		DEBUG_MSG("Payload decryption error, final payload decryption failed\n");
-		EVP_CIPHER_CTX_free(ctx);
 		return false;
 	}
-	EVP_CIPHER_CTX_free(ctx);
 	final_payload = decrypted_payload;
 	return true;
 } // QUICPlugin::quic_decrypt_payload
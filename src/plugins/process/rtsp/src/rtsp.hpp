@@ -175,6 +175,15 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("rtsp", "Parse RTSP traffic"); }
 	std::string get_name() const { return "rtsp"; }
 	RecordExt* get_ext() const { return new RecordExtRTSP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.payload = true;
+		interest.signatures
+			= {"GET ", "POST", "PUT ", "HEAD", "DELE", "TRAC", "OPTI", "CONN", "PATC", "DESC",
+			   "SETU", "PLAY", "PAUS", "TEAR", "RECO", "ANNO", "RTSP"};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
@@ -11,6 +11,8 @@
 
 #include "sip.hpp"
 
+#include "text-tokenizer.hpp"
+
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -36,6 +38,18 @@ static const PluginManifest sipPluginManifest = {
 		},
 };
 
+/* Header fields, compact forms have a single letter name */
+static constexpr TextKey SIP_HDR_FROM("From");
+static constexpr TextKey SIP_HDR_FROM_COMPACT("f");
+static constexpr TextKey SIP_HDR_TO("To");
+static constexpr TextKey SIP_HDR_TO_COMPACT("t");
+static constexpr TextKey SIP_HDR_VIA("Via");
+static constexpr TextKey SIP_HDR_VIA_COMPACT("v");
+static constexpr TextKey SIP_HDR_CALL_ID("Call-ID");
+static constexpr TextKey SIP_HDR_CALL_ID_COMPACT("i");
+static constexpr TextKey SIP_HDR_USER_AGENT("User-Agent");
+static constexpr TextKey SIP_HDR_CSEQ("CSeq");
+
 SIPPlugin::SIPPlugin(const std::string& params, int pluginID)
 	: ProcessPlugin(pluginID)
 	, requests(0)
@@ -451,22 +465,19 @@ void SIPPlugin::parser_field_uri(
 
 int SIPPlugin::parser_process_sip(const Packet& pkt, RecordExtSIP* sip_data)
 {
-	const unsigned char* payload;
-	const unsigned char* line;
-	int caplen;
-	unsigned int line_len = 0;
+	std::string_view line;
+	TextHeaderField field;
 	int field_len;
-	parser_strtok_t line_parser;
-	uint32_t first_bytes4;
-	uint32_t first_bytes3;
-	uint32_t first_bytes2;
 
-	/* Skip the packet headers: */
-	payload = (unsigned char*) pkt.payload;
-	caplen = pkt.payload_len;
+	/* Divide the packet payload by line breaks and process them one by one: */
+	const char* payload = reinterpret_cast<const char*>(pkt.payload);
+	TextTokenizer lines(payload, pkt.payload_len);
 
 	/* Grab the first line of the payload: */
-	line = parser_strtok(payload, caplen, '\n', &line_len, &line_parser);
+	if (!lines.next_line(line) && !lines.take_rest(line)) {
+		line = std::string_view(payload, 0);
+	}
+	const unsigned char* first_line = reinterpret_cast<const unsigned char*>(line.data());
 
 	/* Get Request-URI for SIP requests from first line of the payload: */
 	if (sip_data->msg_type <= 10) {
@@ -478,7 +489,8 @@ int SIPPlugin::parser_process_sip(const Packet& pkt, RecordExtSIP* sip_data)
 		unsigned int line_token_len;
 
 		/* Get Method part of request: */
-		line_token = parser_strtok(line, line_len, ' ', &line_token_len, &first_line_parser);
+		line_token
+			= parser_strtok(first_line, line.size(), ' ', &line_token_len, &first_line_parser);
 		/* Get Request-URI part of request: */
 		line_token = parser_strtok(nullptr, 0, ' ', &line_token_len, &first_line_parser);
 
@@ -500,7 +512,8 @@ int SIPPlugin::parser_process_sip(const Packet& pkt, RecordExtSIP* sip_data)
 			parser_strtok_t first_line_parser;
 			const unsigned char* line_token;
 			unsigned int line_token_len;
-			line_token = parser_strtok(line, line_len, ' ', &line_token_len, &first_line_parser);
+			line_token
+				= parser_strtok(first_line, line.size(), ' ', &line_token_len, &first_line_parser);
 			line_token = parser_strtok(nullptr, 0, ' ', &line_token_len, &first_line_parser);
 			sip_data->status_code = SIP_MSG_TYPE_UNDEFINED;
 			if (line_token) {
@@ -510,107 +523,57 @@ int SIPPlugin::parser_process_sip(const Packet& pkt, RecordExtSIP* sip_data)
 	}
 
 	total++;
-	/* Go to the next line. Divide the packet payload by line breaks and process them one by one: */
-	line = parser_strtok(nullptr, 0, ' ', &line_len, &line_parser);
 
 	/*
-	 * Process all the remaining attributes:
+	 * Process all the remaining attributes, blank line ends the header section:
 	 */
-	while (line != nullptr && line_len > 1) {
-		/* Get first 4, 3 and 2 bytes and compare them with searched SIP fields: */
-		first_bytes4 = SIP_UCFOUR(*((uint32_t*) line));
-		first_bytes3 = SIP_UCTHREE(*((uint32_t*) line));
-		first_bytes2 = SIP_UCTWO(*((uint32_t*) line));
-
-		/* From: */
-		if (first_bytes4 == SIP_FROM4) {
-			parser_field_uri(
-				line,
-				line_len,
-				5,
-				sip_data->calling_party,
-				sizeof(sip_data->calling_party));
-		} else if (first_bytes2 == SIP_FROM2) {
-			parser_field_uri(
-				line,
-				line_len,
-				2,
-				sip_data->calling_party,
-				sizeof(sip_data->calling_party));
+	while ((lines.next_line(line) || lines.take_rest(line)) && !line.empty()) {
+		if (!TextTokenizer::split_header(line, field)) {
+			continue;
 		}
+		const unsigned char* value = reinterpret_cast<const unsigned char*>(field.value.data());
+		const int value_len = field.value.size();
 
-		/* To: */
-		else if (first_bytes3 == SIP_TO3) {
+		if (field.is(SIP_HDR_FROM) || field.is(SIP_HDR_FROM_COMPACT)) {
 			parser_field_uri(
-				line,
-				line_len,
-				3,
-				sip_data->called_party,
-				sizeof(sip_data->called_party));
-		} else if (first_bytes2 == SIP_TO2) {
+				value,
+				value_len,
+				0,
+				sip_data->calling_party,
+				sizeof(sip_data->calling_party));
+		} else if (field.is(SIP_HDR_TO) || field.is(SIP_HDR_TO_COMPACT)) {
 			parser_field_uri(
-				line,
-				line_len,
-				2,
+				value,
+				value_len,
+				0,
 				sip_data->called_party,
 				sizeof(sip_data->called_party));
-		}
-
-		/* Via: */
-		else if (first_bytes4 == SIP_VIA4) {
+		} else if (field.is(SIP_HDR_VIA) || field.is(SIP_HDR_VIA_COMPACT)) {
 			/* Via fields can be present more times. Include all and separate them by semicolons: */
 			if (sip_data->via[0] == 0) {
-				parser_field_value(line, line_len, 4, sip_data->via, sizeof(sip_data->via));
+				parser_field_value(value, value_len, 0, sip_data->via, sizeof(sip_data->via));
 			} else {
 				field_len = strlen(sip_data->via);
 				sip_data->via[field_len++] = ';';
 				parser_field_value(
-					line,
-					line_len,
-					4,
+					value,
+					value_len,
+					0,
 					sip_data->via + field_len,
 					sizeof(sip_data->via) - field_len);
 			}
-		} else if (first_bytes2 == SIP_VIA2) {
-			if (sip_data->via[0] == 0) {
-				parser_field_value(line, line_len, 2, sip_data->via, sizeof(sip_data->via));
-			} else {
-				field_len = strlen(sip_data->via);
-				sip_data->via[field_len++] = ';';
-				parser_field_value(
-					line,
-					line_len,
-					2,
-					sip_data->via + field_len,
-					sizeof(sip_data->via) - field_len);
-			}
-		}
-
-		/* Call-ID: */
-		else if (first_bytes4 == SIP_CALLID4) {
-			parser_field_value(line, line_len, 8, sip_data->call_id, sizeof(sip_data->call_id));
-		} else if (first_bytes2 == SIP_CALLID2) {
-			parser_field_value(line, line_len, 2, sip_data->call_id, sizeof(sip_data->call_id));
-		}
-
-		/* User-Agent: */
-		else if (first_bytes4 == SIP_USERAGENT4) {
+		} else if (field.is(SIP_HDR_CALL_ID) || field.is(SIP_HDR_CALL_ID_COMPACT)) {
+			parser_field_value(value, value_len, 0, sip_data->call_id, sizeof(sip_data->call_id));
+		} else if (field.is(SIP_HDR_USER_AGENT)) {
 			parser_field_value(
-				line,
-				line_len,
-				11,
+				value,
+				value_len,
+				0,
 				sip_data->user_agent,
 				sizeof(sip_data->user_agent));
+		} else if (field.is(SIP_HDR_CSEQ)) {
+			parser_field_value(value, value_len, 0, sip_data->cseq, sizeof(sip_data->cseq));
 		}
-
-		/* CSeq: */
-		else if (first_bytes4 == SIP_CSEQ4) {
-			/* Save CSeq: */
-			parser_field_value(line, line_len, 5, sip_data->cseq, sizeof(sip_data->cseq));
-		}
-
-		/* Go to the next line: */
-		line = parser_strtok(nullptr, 0, ' ', &line_len, &line_parser);
 	}
 
 	return 0;
@@ -182,82 +182,8 @@ namespace ipxp {
 #define SIP_NOT_OPTIONS2 0x7369703a /* pis: */
 #endif
 
-/*
- * SIP fields table - these patterns are used to quickly
- * detect necessary SIP fields.
- */
 /* This macro converts low ASCII characters to upper case. Colon changes to 0x1a character: */
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
 #define SIP_UCFOUR(A) ((A) & 0xdfdfdfdf)
-#define SIP_UCTWO(A) ((A) & 0x0000dfdf)
-#define SIP_UCTHREE(A) ((A) & 0x00dfdfdf)
-#else
-#define SIP_UCFOUR(A) ((A) & 0xdfdfdfdf)
-#define SIP_UCTWO(A) ((A) & 0xdfdf0000)
-#define SIP_UCTHREE(A) ((A) & 0xdfdfdf00)
-#endif
-
-/* Encoded SIP field names - long and short alternatives. The trailing number means the number of
- * bytes to compare: */
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_VIA4 0x1a414956 /* :AIV */
-#else
-#define SIP_VIA4 0x5649411a /* VIA: */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_VIA2 0x00001a56 /*   :V */
-#else
-#define SIP_VIA2 0x561a0000 /* V:   */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_FROM4 0x4d4f5246 /* MORF */
-#else
-#define SIP_FROM4 0x46524f4d /* FROM */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_FROM2 0x00001a46 /*   :F */
-#else
-#define SIP_FROM2 0x461a0000 /* F:   */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_TO3 0x001a4f54 /*  :OT */
-#else
-#define SIP_TO3 0x544f1a00 /* TO:  */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_TO2 0x00001a54 /*   :T */
-#else
-#define SIP_TO2 0x541a0000 /* T:   */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_CALLID4 0x4c4c4143 /* LLAC */
-#else
-#define SIP_CALLID4 0x43414c4c /* CALL */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_CALLID2 0x00001a49 /*   :I */
-#else
-#define SIP_CALLID2 0x491a0000 /* I:   */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_CSEQ4 0x51455343 /* QESC */
-#else
-#define SIP_CSEQ4 0x43534551 /* CSEQ */
-#endif
-
-#if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
-#define SIP_USERAGENT4 0x52455355 /* RESU */
-#else
-#define SIP_USERAGENT4 0x55534552 /* USER */
-#endif
 
 /* Encoded SIP URI start: */
 #if defined(__BYTE_ORDER) && __BYTE_ORDER == __LITTLE_ENDIAN
@@ -470,6 +396,25 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("sip", "Parse SIP traffic"); }
 	std::string get_name() const { return "sip"; }
 	RecordExt* get_ext() const { return new RecordExtSIP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.payload = true;
+		interest.signatures = {
+			"REGI",
+			"INVI",
+			"OPTI",
+			"NOTI",
+			"CANC",
+			"INFO",
+			"SIP/",
+			"ACK ",
+			"BYE ",
+			"SUBS",
+			"PUBL",
+		};
+		return interest;
+	}
 	ProcessPlugin* copy();
 	int post_create(Flow& rec, const Packet& pkt);
 	int pre_update(Flow& rec, Packet& pkt);
@@ -13,6 +13,7 @@
 #include "smtp.hpp"
 
 #include "common.hpp"
+#include "text-tokenizer.hpp"
 
 #include <cstring>
 #include <iostream>
@@ -252,10 +253,8 @@ bool SMTPPlugin::smtp_keyword(const char* data)
  */
 bool SMTPPlugin::parse_smtp_command(const char* data, int payload_len, RecordExtSMTP* rec)
 {
-	const char *begin, *end;
 	char buffer[32];
-	size_t len;
-	size_t remaining;
+	std::string_view line;
 
 	if (payload_len == 0) {
 		return false;
@@ -269,39 +268,27 @@ bool SMTPPlugin::parse_smtp_command(const char* data, int payload_len, RecordExt
 		return true;
 	}
 
-	begin = data;
-	end = static_cast<const char*>(memchr(begin, '\r', payload_len));
-
-	len = end - begin;
-	if (end == nullptr) {
+	/* Command line:
+	 *
+	 * KEYWORD ARGUMENTS
+	 */
+	TextTokenizer tokenizer(data, payload_len);
+	if (!tokenizer.next_line(line)) {
 		return false;
 	}
-	end = static_cast<const char*>(memchr(begin, ' ', payload_len));
-	if (end != nullptr) {
-		len = end - begin;
-	}
-	if (len >= sizeof(buffer)) {
+	const size_t keyword_end = line.find(' ');
+	const bool has_args = keyword_end != std::string_view::npos;
+	const std::string_view keyword = line.substr(0, keyword_end);
+	const std::string_view args = has_args ? line.substr(keyword_end + 1) : std::string_view();
+	if (keyword.size() >= sizeof(buffer)) {
 		return false;
 	}
 
-	memcpy(buffer, begin, len);
-	buffer[len] = 0;
+	copy_text(buffer, sizeof(buffer), keyword);
 
 	if (!strcmp(buffer, "HELO") || !strcmp(buffer, "EHLO")) {
-		if (rec->domain[0] == 0 && end != nullptr) {
-			begin = end;
-			remaining = payload_len - (begin - data);
-			end = static_cast<const char*>(memchr(begin, '\r', remaining));
-			if (end != nullptr && begin != NULL) {
-				begin++;
-				len = end - begin;
-				if (len >= sizeof(rec->domain)) {
-					len = sizeof(rec->domain) - 1;
-				}
-
-				memcpy(rec->domain, begin, len);
-				rec->domain[len] = 0;
-			}
+		if (rec->domain[0] == 0 && has_args) {
+			copy_text(rec->domain, sizeof(rec->domain), args);
 		}
 		if (!strcmp(buffer, "HELO")) {
 			rec->command_flags |= SMTP_CMD_HELO;
@@ -310,48 +297,16 @@ bool SMTPPlugin::parse_smtp_command(const char* data, int payload_len, RecordExt
 		}
 	} else if (!strcmp(buffer, "RCPT")) {
 		rec->mail_rcpt_cnt++;
-		if (rec->first_recipient[0] == 0 && end != nullptr) {
-			if (check_payload_len(payload_len, (end + 1) - data)) {
-				return false;
-			}
-			remaining = payload_len - ((end + 1) - data);
-			begin = static_cast<const char*>(memchr(end + 1, ':', remaining));
-			remaining = payload_len - (end - data);
-			end = static_cast<const char*>(memchr(end, '\r', remaining));
-
-			if (end != nullptr && begin != NULL) {
-				begin++;
-				len = end - begin;
-				if (len >= sizeof(rec->first_recipient)) {
-					len = sizeof(rec->first_recipient) - 1;
-				}
-
-				memcpy(rec->first_recipient, begin, len);
-				rec->first_recipient[len] = 0;
-			}
+		const size_t colon = args.find(':');
+		if (rec->first_recipient[0] == 0 && colon != std::string_view::npos) {
+			copy_text(rec->first_recipient, sizeof(rec->first_recipient), args.substr(colon + 1));
 		}
 		rec->command_flags |= SMTP_CMD_RCPT;
 	} else if (!strcmp(buffer, "MAIL")) {
 		rec->mail_cmd_cnt++;
-		if (rec->first_sender[0] == 0 && end != nullptr) {
-			if (check_payload_len(payload_len, (end + 1) - data)) {
-				return false;
-			}
-			remaining = payload_len - ((end + 1) - data);
-			begin = static_cast<const char*>(memchr(end + 1, ':', remaining));
-			remaining = payload_len - (end - data);
-			end = static_cast<const char*>(memchr(end, '\r', remaining));
-
-			if (end != nullptr && begin != NULL) {
-				begin++;
-				len = end - begin;
-				if (len >= sizeof(rec->first_sender)) {
-					len = sizeof(rec->first_sender) - 1;
-				}
-
-				memcpy(rec->first_sender, begin, len);
-				rec->first_sender[len] = 0;
-			}
+		const size_t colon = args.find(':');
+		if (rec->first_sender[0] == 0 && colon != std::string_view::npos) {
+			copy_text(rec->first_sender, sizeof(rec->first_sender), args.substr(colon + 1));
 		}
 		rec->command_flags |= SMTP_CMD_MAIL;
 	} else if (!strcmp(buffer, "DATA")) {
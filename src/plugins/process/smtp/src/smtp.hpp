@@ -211,6 +211,12 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("smtp", "Parse SMTP traffic"); }
 	std::string get_name() const { return "smtp"; }
 	RecordExt* get_ext() const { return new RecordExtSMTP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {25};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
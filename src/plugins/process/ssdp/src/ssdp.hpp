@@ -152,6 +152,12 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("ssdp", "Parse SSDP traffic"); }
 	std::string get_name() const { return "ssdp"; }
 	RecordExt* get_ext() const { return new RecordExtSSDP(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.ports = {1900};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
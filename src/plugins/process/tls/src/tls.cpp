@@ -18,9 +18,7 @@
 
 #include <algorithm>
 #include <cctype>
-#include <functional>
 #include <iostream>
-#include <numeric>
 
 #include <ipfixprobe/pluginFactory/pluginManifest.hpp>
 #include <ipfixprobe/pluginFactory/pluginRegistrar.hpp>
@@ -75,6 +73,14 @@ RecordExtTLS* TLSPlugin::get_ext() const
 	return new RecordExtTLS(m_pluginID);
 }
 
+PacketInterest TLSPlugin::get_interest() const
+{
+	PacketInterest interest;
+	// Handshake record of SSL 3.0 or TLS 1.x
+	interest.signatures = {std::string("\x16\x03", 2)};
+	return interest;
+}
+
 TLSPlugin::~TLSPlugin()
 {
 	close();
@@ -113,62 +119,114 @@ int TLSPlugin::pre_update(Flow& rec, Packet& pkt)
 			// Add ALPN from server packet
 			parse_tls(pkt.payload, pkt.payload_len, ext, rec.ip_proto);
 		}
-		return 0;
+		// Nothing more to parse after both hellos
+		return ext->server_hello_parsed ? FLOW_PLUGIN_DONE : 0;
 	}
 	add_tls_record(rec, pkt);
 
 	return 0;
 }
 
-static std::string concatenate_vector_to_string(const std::vector<uint16_t>& vector)
-{
-	if (vector.empty()) {
-		return "";
+/**
+ * \brief Adapter of the SHA-256 implementation to the interface of the MD5 class.
+ */
+class SHA256 {
+public:
+	SHA256() { sha256::sha256_init(&m_buff); }
+
+	void update(const char* data, size_t length) { sha256::sha256_update(&m_buff, data, length); }
+
+	/**
+	 * \brief Finish hashing and get the beginning of the digest.
+	 * \param [out] digest Destination buffer.
+	 * \param [in] length Number of bytes to get, at most 32.
+	 */
+	void finalize(uint8_t* digest, size_t length)
+	{
+		sha256::sha256_finalize(&m_buff);
+		for (size_t i = 0; i < length; i++) {
+			digest[i] = m_buff.h[i / 4] >> (24 - 8 * (i % 4));
+		}
 	}
-	return std::accumulate(
-		std::next(vector.begin()),
-		vector.end(),
-		std::to_string(vector[0]),
-		[](const std::string& a, uint16_t b) { return a + "-" + std::to_string(b); });
-}
 
-static std::string concatenate_vector_to_hex_string(const std::vector<uint16_t>& vector)
-{
-	if (vector.empty()) {
-		return "";
+private:
+	sha256::sha256_buff m_buff;
+};
+
+/**
+ * \brief Writer of fingerprint text which passes it to a hash without building a string.
+ *
+ * Text is collected in a fixed buffer and handed to the hash whenever the buffer fills up.
+ */
+template<typename Hash>
+class HashWriter {
+public:
+	explicit HashWriter(Hash& hash)
+		: m_hash(hash)
+		, m_length(0)
+	{
 	}
-	auto res = std::accumulate(
-		vector.begin(),
-		vector.end(),
-		std::string {},
-		[](const std::string& acc, uint16_t value) {
-			std::array<char, 6> buffer = {};
-			std::snprintf(buffer.data(), buffer.size(), "%04x,", value);
-			return acc + buffer.data();
-		});
-	res.pop_back();
-	return res;
-}
 
-static std::string
-concatenate_extensions_vector_to_string(const std::vector<TLSExtension>& extensions)
-{
-	auto res = std::accumulate(
-		extensions.begin(),
-		extensions.end(),
-		std::string {},
-		[](const std::string& a, const auto& extension) {
-			if (TLSParser::is_grease_value(extension.type)) {
-				return a;
+	void put(char c)
+	{
+		if (m_length == sizeof(m_buffer)) {
+			flush();
+		}
+		m_buffer[m_length++] = c;
+	}
+
+	void put_dec(uint16_t value)
+	{
+		char digits[5];
+		int count = 0;
+		do {
+			digits[count++] = '0' + value % 10;
+			value /= 10;
+		} while (value != 0);
+		while (count > 0) {
+			put(digits[--count]);
+		}
+	}
+
+	void put_hex(uint16_t value)
+	{
+		static const char hex[] = "0123456789abcdef";
+		for (int shift = 12; shift >= 0; shift -= 4) {
+			put(hex[(value >> shift) & 0xF]);
+		}
+	}
+
+	/**
+	 * \brief Write values in decimal or hexadecimal separated by the delimiter.
+	 */
+	void put_list(const uint16_t* values, size_t count, char delimiter, bool hex)
+	{
+		for (size_t i = 0; i < count; i++) {
+			if (i != 0) {
+				put(delimiter);
 			}
-			return a + std::to_string(extension.type) + "-";
-		});
+			if (hex) {
+				put_hex(values[i]);
+			} else {
+				put_dec(values[i]);
+			}
+		}
+	}
 
-	if (!res.empty()) {
-		res.pop_back();
+	/**
+	 * \brief Pass the buffered text to the hash.
+	 */
+	void flush()
+	{
+		m_hash.update(m_buffer, m_length);
+		m_length = 0;
 	}
-	return res;
-}
+
+private:
+	Hash& m_hash;
+	char m_buffer[256];
+	size_t m_length;
+};
 
 static const char* convert_version_to_label(uint16_t version)
 {
@@ -196,14 +254,40 @@ static const char* convert_version_to_label(uint16_t version)
 	}
 }
 
-static std::string get_ja3_string(const TLSParser& parser)
+/**
+ * \brief Compute MD5 of the JA3 string "version,ciphers,extensions,curves,point_formats".
+ */
+static void get_ja3_hash(const TLSParser& parser, uint8_t* digest)
 {
-	std::string ja3_string = std::to_string(parser.get_handshake()->version.version) + ',';
-	ja3_string += concatenate_vector_to_string(parser.get_cipher_suits()) + ',';
-	ja3_string += concatenate_extensions_vector_to_string(parser.get_extensions()) + ',';
-	ja3_string += concatenate_vector_to_string(parser.get_elliptic_curves()) + ',';
-	ja3_string += concatenate_vector_to_string(parser.get_elliptic_curve_point_formats());
-	return ja3_string;
+	MD5 md5;
+	HashWriter<MD5> ja3(md5);
+
+	const auto& ciphers = parser.get_cipher_suits();
+	const auto& curves = parser.get_elliptic_curves();
+	const auto& point_formats = parser.get_elliptic_curve_point_formats();
+
+	ja3.put_dec(parser.get_handshake()->version.version);
+	ja3.put(',');
+	ja3.put_list(ciphers.data(), ciphers.size(), '-', false);
+	ja3.put(',');
+	bool first = true;
+	for (const auto& extension : parser.get_extensions()) {
+		if (TLSParser::is_grease_value(extension.type)) {
+			continue;
+		}
+		if (!first) {
+			ja3.put('-');
+		}
+		ja3.put_dec(extension.type);
+		first = false;
+	}
+	ja3.put(',');
+	ja3.put_list(curves.data(), curves.size(), '-', false);
+	ja3.put(',');
+	ja3.put_list(point_formats.data(), point_formats.size(), '-', false);
+	ja3.flush();
+
+	std::memcpy(digest, md5.finalize().binary_digest(), 16);
 }
 
 static char convert_alpn_byte_to_label(char alpn_byte, bool high_nibble)
@@ -228,98 +312,121 @@ static const char* get_version_label(const TLSParser& parser)
 	return convert_version_to_label(version);
 }
 
-static std::string get_truncated_hash_hex(const std::string& str)
+/**
+ * \brief Write first 6 bytes of the SHA-256 digest as 12 hex characters.
+ */
+static char* put_truncated_hash(char* pos, SHA256& sha)
 {
-	std::array<char, 32> hash {};
-	sha256::hash_it((const uint8_t*) str.c_str(), str.length(), (uint8_t*) hash.data());
-	std::ostringstream oss;
-	for (auto i = 0U; i < 6; ++i) {
-		oss << std::hex << std::setw(2) << std::setfill('0') << ((uint16_t) hash[i] & 0xFF);
+	static const char hex[] = "0123456789abcdef";
+	uint8_t digest[6];
+	sha.finalize(digest, sizeof(digest));
+	for (const uint8_t byte : digest) {
+		*pos++ = hex[byte >> 4];
+		*pos++ = hex[byte & 0xF];
 	}
-	return oss.str();
+	return pos;
 }
 
-static std::string get_truncated_cipher_hash(const TLSParser& parser)
+static char* put_truncated_cipher_hash(
+	char* pos,
+	const TLSParser& parser,
+	std::vector<uint16_t>& sort_buffer)
 {
-	std::string cipher_string;
-	std::vector<uint16_t> cipher_suits = parser.get_cipher_suits();
-	std::sort(cipher_suits.begin(), cipher_suits.end());
-
-	if (cipher_suits.empty()) {
-		cipher_string.assign(12, '0');
-		return cipher_string;
+	const auto& ciphers = parser.get_cipher_suits();
+	if (ciphers.empty()) {
+		return std::fill_n(pos, 12, '0');
 	}
-	cipher_string = concatenate_vector_to_hex_string(cipher_suits);
-	return get_truncated_hash_hex(cipher_string);
+
+	sort_buffer.assign(ciphers.begin(), ciphers.end());
+	std::sort(sort_buffer.begin(), sort_buffer.end());
+
+	SHA256 sha;
+	HashWriter<SHA256> cipher_string(sha);
+	cipher_string.put_list(sort_buffer.data(), sort_buffer.size(), ',', true);
+	cipher_string.flush();
+	return put_truncated_hash(pos, sha);
 }
 
-static std::string get_truncated_extensions_hash(const TLSParser& parser)
+static char* put_truncated_extensions_hash(
+	char* pos,
+	const TLSParser& parser,
+	std::vector<uint16_t>& sort_buffer)
 {
-	std::vector<uint16_t> extensions;
-	std::transform(
-		parser.get_extensions().begin(),
-		parser.get_extensions().end(),
-		std::back_inserter(extensions),
-		[](const TLSExtension& extension) { return extension.type; });
-	extensions.erase(
-		std::remove_if(
-			extensions.begin(),
-			extensions.end(),
-			[](uint16_t extension_type) {
-				return extension_type == TLS_EXT_ALPN || extension_type == TLS_EXT_SERVER_NAME
-					|| TLSParser::is_grease_value(extension_type);
-			}),
-		extensions.end());
-	std::sort(extensions.begin(), extensions.end());
-
-	auto extensions_string = concatenate_vector_to_hex_string(extensions);
-	std::vector<uint16_t> signature_algorithms = parser.get_signature_algorithms();
-	if (!signature_algorithms.empty()) {
-		signature_algorithms.erase(signature_algorithms.begin());
+	sort_buffer.clear();
+	for (const auto& extension : parser.get_extensions()) {
+		if (extension.type != TLS_EXT_ALPN && extension.type != TLS_EXT_SERVER_NAME
+			&& !TLSParser::is_grease_value(extension.type)) {
+			sort_buffer.push_back(extension.type);
+		}
 	}
-	auto signature_algorithms_string = concatenate_vector_to_hex_string(signature_algorithms);
-
-	auto extensions_and_algorithms_string = extensions_string + '_' + signature_algorithms_string;
-	return get_truncated_hash_hex(extensions_and_algorithms_string);
+	std::sort(sort_buffer.begin(), sort_buffer.end());
+
+	SHA256 sha;
+	HashWriter<SHA256> extensions_string(sha);
+	extensions_string.put_list(sort_buffer.data(), sort_buffer.size(), ',', true);
+	extensions_string.put('_');
+	// First item is the length of the algorithm list
+	const auto& algorithms = parser.get_signature_algorithms();
+	if (!algorithms.empty()) {
+		extensions_string.put_list(algorithms.data() + 1, algorithms.size() - 1, ',', true);
+	}
+	extensions_string.flush();
+	return put_truncated_hash(pos, sha);
 }
 
-static std::string get_alpn_label(const TLSParser& parser)
+static char* put_alpn_label(char* pos, const TLSParser& parser)
 {
-	std::string alpn_label;
 	if (parser.get_alpns().empty() || parser.get_alpns()[0].empty()) {
-		alpn_label = "00";
+		*pos++ = '0';
+		*pos++ = '0';
 	} else {
 		const auto& alpn_string = parser.get_alpns()[0];
-		alpn_label += convert_alpn_byte_to_label(alpn_string[0], true);
-		alpn_label += convert_alpn_byte_to_label(alpn_string[alpn_string.length() - 1], false);
+		*pos++ = convert_alpn_byte_to_label(alpn_string[0], true);
+		*pos++ = convert_alpn_byte_to_label(alpn_string[alpn_string.length() - 1], false);
 	}
-	return alpn_label;
+	return pos;
 }
 
-static std::string get_ja4_string(const TLSParser& parser, uint8_t ip_proto)
+static char* put_count(char* pos, size_t count)
 {
-	constexpr const uint8_t UDP_ID = 17;
-	const char protocol = ip_proto == UDP_ID ? 'q' : 't';
-
-	char version_label[3];
-	*(uint16_t*) version_label = *(uint16_t*) get_version_label(parser);
-	version_label[2] = 0;
-
-	const char sni_label = parser.get_server_names().empty() ? 'i' : 'd';
-
-	const uint8_t ciphers_count = std::min(parser.get_cipher_suits().size(), 99UL);
-
-	const uint8_t extension_count = std::min(parser.get_extensions().size(), 99UL);
-
-	const auto alpn_label = get_alpn_label(parser);
-
-	const auto truncated_cipher_hash = get_truncated_cipher_hash(parser);
-
-	const auto truncated_extensions_hash = get_truncated_extensions_hash(parser);
+	count = std::min(count, 99UL);
+	if (count >= 10) {
+		*pos++ = '0' + count / 10;
+	}
+	*pos++ = '0' + count % 10;
+	return pos;
+}
 
-	return std::string {} + protocol + version_label + sni_label + std::to_string(ciphers_count)
-		+ std::to_string(extension_count) + alpn_label + '_' + truncated_cipher_hash + '_'
-		+ truncated_extensions_hash;
+/**
+ * \brief Write the JA4 fingerprint.
+ * \param [out] ja4 Destination buffer, not terminated when the fingerprint fills it.
+ * \param [in] size Size of the destination buffer.
+ */
+static void get_ja4(
+	const TLSParser& parser,
+	uint8_t ip_proto,
+	std::vector<uint16_t>& sort_buffer,
+	char* ja4,
+	size_t size)
+{
+	constexpr const uint8_t UDP_ID = 17;
+	char buffer[64];
+	char* pos = buffer;
+
+	*pos++ = ip_proto == UDP_ID ? 'q' : 't';
+	const char* version_label = get_version_label(parser);
+	*pos++ = version_label[0];
+	*pos++ = version_label[1];
+	*pos++ = parser.get_server_names().empty() ? 'i' : 'd';
+	pos = put_count(pos, parser.get_cipher_suits().size());
+	pos = put_count(pos, parser.get_extensions().size());
+	pos = put_alpn_label(pos, parser);
+	*pos++ = '_';
+	pos = put_truncated_cipher_hash(pos, parser, sort_buffer);
+	*pos++ = '_';
+	pos = put_truncated_extensions_hash(pos, parser, sort_buffer);
+
+	std::memcpy(ja4, buffer, std::min<size_t>(pos - buffer, size));
 }
 
 static bool parse_client_hello_extensions(TLSParser& parser) noexcept
@@ -365,7 +472,8 @@ bool TLSPlugin::parse_tls(
 	RecordExtTLS* rec,
 	uint8_t ip_proto)
 {
-	TLSParser parser;
+	// Parser and sort buffer are reused to keep their allocations across packets
+	TLSParser& parser = tls_parser;
 	if (!parser.parse_tls(data, payload_len)) {
 		return false;
 	}
@@ -391,9 +499,8 @@ bool TLSPlugin::parse_tls(
 		}
 		rec->version = parser.get_handshake()->version.version;
 		parser.save_server_names(rec->sni, sizeof(rec->sni));
-		md5_get_bin(get_ja3_string(parser), rec->ja3);
-		auto ja4 = get_ja4_string(parser, ip_proto);
-		std::memcpy(rec->ja4, ja4.c_str(), ja4.length());
+		get_ja3_hash(parser, rec->ja3);
+		get_ja4(parser, ip_proto, sort_buffer, rec->ja4, sizeof(rec->ja4));
 		return true;
 	} else if (parser.is_server_hello()) {
 		if (!parse_server_hello_extensions(parser)) {
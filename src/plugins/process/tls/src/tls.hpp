@@ -197,6 +197,7 @@ public:
 	std::string get_name() const override;
 
 	RecordExtTLS* get_ext() const override;
+	PacketInterest get_interest() const override;
 
 	ProcessPlugin* copy();
 
@@ -210,6 +211,7 @@ private:
 
 	RecordExtTLS* ext_ptr {nullptr};
 	TLSParser tls_parser {};
+	std::vector<uint16_t> sort_buffer {};
 	uint32_t parsed_sni {0};
 };
 
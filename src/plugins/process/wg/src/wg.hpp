@@ -128,6 +128,19 @@ public:
 	OptionsParser* get_parser() const { return new OptionsParser("wg", "Parse WireGuard traffic"); }
 	std::string get_name() const { return "wg"; }
 	RecordExt* get_ext() const { return new RecordExtWG(m_pluginID); }
+	PacketInterest get_interest() const
+	{
+		PacketInterest interest;
+		interest.protocols = PacketInterest::UDP;
+		// Message type followed by three reserved bytes
+		interest.signatures = {
+			std::string("\x01\0\0\0", 4),
+			std::string("\x02\0\0\0", 4),
+			std::string("\x03\0\0\0", 4),
+			std::string("\x04\0\0\0", 4),
+		};
+		return interest;
+	}
 	ProcessPlugin* copy();
 
 	int post_create(Flow& rec, const Packet& pkt);
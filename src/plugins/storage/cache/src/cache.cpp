@@ -16,9 +16,11 @@
 
 #include "xxhash.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <new>
 
 #include <ipfixprobe/pluginFactory/pluginManifest.hpp>
 #include <ipfixprobe/pluginFactory/pluginRegistrar.hpp>
@@ -54,6 +56,8 @@ void FlowRecord::erase()
 	m_flow.remove_extensions();
 	m_hash = 0;
 
+	m_key_swapped = false;
+
 	memset(&m_flow.time_first, 0, sizeof(m_flow.time_first));
 	memset(&m_flow.time_last, 0, sizeof(m_flow.time_last));
 	m_flow.ip_version = 0;
@@ -68,6 +72,10 @@ void FlowRecord::erase()
 	m_flow.dst_bytes = 0;
 	m_flow.src_tcp_flags = 0;
 	m_flow.dst_tcp_flags = 0;
+	m_flow.plugins_mask = 0;
+	m_flow.plugins_active = 0;
+	m_flow.plugins_pending = 0;
+	m_flow.classified_pkts = 0;
 }
 void FlowRecord::reuse()
 {
@@ -91,11 +99,17 @@ inline __attribute__((always_inline)) bool FlowRecord::belongs(uint64_t hash) co
 	return hash == m_hash;
 }
 
-void FlowRecord::create(const Packet& pkt, uint64_t hash)
+inline __attribute__((always_inline)) bool FlowRecord::is_source(bool key_swapped) const
+{
+	return key_swapped == m_key_swapped;
+}
+
+void FlowRecord::create(const Packet& pkt, uint64_t hash, bool key_swapped)
 {
 	m_flow.src_packets = 1;
 
 	m_hash = hash;
+	m_key_swapped = key_swapped;
 
 	m_flow.time_first = pkt.ts;
 	m_flow.time_last = pkt.ts;
@@ -158,16 +172,22 @@ NHTFlowCache::NHTFlowCache(const std::string& params, ipx_ring_t* queue)
 	, m_line_new_idx(0)
 	, m_qsize(0)
 	, m_qidx(0)
-	, m_timeout_idx(0)
 	, m_active(0)
 	, m_inactive(0)
 	, m_split_biflow(false)
+	, m_canonical_key(false)
 	, m_enable_fragmentation_cache(true)
 	, m_keylen(0)
 	, m_key()
 	, m_key_inv()
 	, m_flow_table(nullptr)
 	, m_flow_records(nullptr)
+	, m_flow_tags(nullptr)
+	, m_ext_slots(nullptr)
+	, m_flow_table_memory()
+	, m_flow_records_memory()
+	, m_flow_tags_memory()
+	, m_ext_slots_memory()
 	, m_fragmentation_cache(0, 0)
 {
 	set_queue(queue);
@@ -193,7 +213,6 @@ void NHTFlowCache::init(const char* params)
 	m_active = parser.m_active;
 	m_inactive = parser.m_inactive;
 	m_qidx = 0;
-	m_timeout_idx = 0;
 	m_line_mask = (m_cache_size - 1) & ~(m_line_size - 1);
 	m_line_new_idx = m_line_size / 2;
 
@@ -208,17 +227,43 @@ void NHTFlowCache::init(const char* params)
 		throw PluginError("flow cache won't properly work with 0 records");
 	}
 
+	/* Pipeline policy decides about hugepages and NUMA node of the tables. */
+	MemoryPolicy plain_memory;
+	MemoryPolicy* memory = MemoryPolicy::get_current();
+	if (memory == nullptr) {
+		memory = &plain_memory;
+	}
+	/* Records index their extensions in one array with a slot per process plugin. */
+	const uint32_t ext_cnt = ProcessPluginIDGenerator::instance().getPluginsCount();
 	try {
-		m_flow_table = new FlowRecord*[m_cache_size + m_qsize];
-		m_flow_records = new FlowRecord[m_cache_size + m_qsize];
+		if (ext_cnt > 0) {
+			m_ext_slots_memory
+				= memory->allocate(sizeof(RecordExt*) * ext_cnt * (m_cache_size + m_qsize));
+			m_ext_slots = static_cast<RecordExt**>(m_ext_slots_memory.ptr);
+		}
+		m_flow_table_memory = memory->allocate(sizeof(FlowRecord*) * (m_cache_size + m_qsize));
+		m_flow_table = static_cast<FlowRecord**>(m_flow_table_memory.ptr);
+		m_flow_records_memory = memory->allocate(sizeof(FlowRecord) * (m_cache_size + m_qsize));
+		m_flow_records = static_cast<FlowRecord*>(m_flow_records_memory.ptr);
 		for (decltype(m_cache_size + m_qsize) i = 0; i < m_cache_size + m_qsize; i++) {
-			m_flow_table[i] = m_flow_records + i;
+			m_flow_table[i] = new (m_flow_records + i) FlowRecord();
+			if (m_ext_slots != nullptr) {
+				m_flow_table[i]->m_flow.set_extension_slots(m_ext_slots + i * ext_cnt, ext_cnt);
+			}
 		}
+		// Padded, match_flow_tags() always reads whole chunk even for short flow lines
+		m_flow_tags_memory = memory->allocate((m_cache_size + FLOW_TAG_CHUNK) * sizeof(uint16_t));
+		m_flow_tags = static_cast<uint16_t*>(m_flow_tags_memory.ptr);
+		std::fill_n(m_flow_tags, m_cache_size + FLOW_TAG_CHUNK, FLOW_TAG_EMPTY);
 	} catch (std::bad_alloc& e) {
 		throw PluginError("not enough memory for flow cache allocation");
 	}
 
 	m_split_biflow = parser.m_split_biflow;
+	m_canonical_key = parser.m_canonical_key;
+	if (m_split_biflow && m_canonical_key) {
+		throw PluginError("canonical flow key can't be used with split biflows");
+	}
 	m_enable_fragmentation_cache = parser.m_enable_fragmentation_cache;
 
 	if (m_enable_fragmentation_cache) {
@@ -244,13 +289,24 @@ void NHTFlowCache::init(const char* params)
 void NHTFlowCache::close()
 {
 	if (m_flow_records != nullptr) {
-		delete[] m_flow_records;
+		for (decltype(m_cache_size + m_qsize) i = 0; i < m_cache_size + m_qsize; i++) {
+			m_flow_records[i].~FlowRecord();
+		}
+		MemoryPolicy::free(m_flow_records_memory);
 		m_flow_records = nullptr;
 	}
 	if (m_flow_table != nullptr) {
-		delete[] m_flow_table;
+		MemoryPolicy::free(m_flow_table_memory);
 		m_flow_table = nullptr;
 	}
+	if (m_flow_tags != nullptr) {
+		MemoryPolicy::free(m_flow_tags_memory);
+		m_flow_tags = nullptr;
+	}
+	if (m_ext_slots != nullptr) {
+		MemoryPolicy::free(m_ext_slots_memory);
+		m_ext_slots = nullptr;
+	}
 }
 
 void NHTFlowCache::set_queue(ipx_ring_t* queue)
@@ -267,16 +323,18 @@ void NHTFlowCache::export_flow(size_t index)
 		m_flow_table[index]->m_flow.src_packets + m_flow_table[index]->m_flow.dst_packets);
 	m_flows_in_cache--;
 
+	m_timer_wheel.cancel(m_flow_table[index]);
 	ipx_ring_push(m_export_queue, &m_flow_table[index]->m_flow);
 	std::swap(m_flow_table[index], m_flow_table[m_cache_size + m_qidx]);
 	m_flow_table[index]->erase();
+	m_flow_tags[index] = FLOW_TAG_EMPTY;
 	m_qidx = (m_qidx + 1) % m_qsize;
 }
 
 void NHTFlowCache::finish()
 {
 	for (decltype(m_cache_size) i = 0; i < m_cache_size; i++) {
-		if (!m_flow_table[i]->is_empty()) {
+		if (m_flow_tags[i] != FLOW_TAG_EMPTY) {
 			plugins_pre_export(m_flow_table[i]->m_flow);
 			m_flow_table[i]->m_flow.end_reason = FLOW_END_FORCED;
 			export_flow(i);
@@ -296,6 +354,7 @@ void NHTFlowCache::flush(Packet& pkt, size_t flow_index, int ret, bool source_fl
 	if (ret == FLOW_FLUSH_WITH_REINSERT) {
 		FlowRecord* flow = m_flow_table[flow_index];
 		flow->m_flow.end_reason = FLOW_END_FORCED;
+		m_timer_wheel.cancel(flow);
 		ipx_ring_push(m_export_queue, &flow->m_flow);
 
 		std::swap(m_flow_table[flow_index], m_flow_table[m_cache_size + m_qidx]);
@@ -305,9 +364,10 @@ void NHTFlowCache::flush(Packet& pkt, size_t flow_index, int ret, bool source_fl
 		*flow = *m_flow_table[m_cache_size + m_qidx];
 		m_qidx = (m_qidx + 1) % m_qsize;
 
-		flow->m_flow.m_exts = nullptr;
+		flow->m_flow.detach_extensions();
 		flow->reuse(); // Clean counters, set time first to last
 		flow->update(pkt, source_flow); // Set new counters from packet
+		m_timer_wheel.schedule(flow, get_flow_deadline(*flow));
 
 		ret = plugins_post_create(flow->m_flow, pkt);
 		if (ret & FLOW_FLUSH) {
@@ -324,51 +384,130 @@ int NHTFlowCache::put_pkt(Packet& pkt)
 	if (m_enable_fragmentation_cache) {
 		try_to_fill_ports_to_fragmented_packet(pkt);
 	}
-	return put_pkt_recursive(pkt);
-}
-
-int NHTFlowCache::put_pkt_recursive(Packet& pkt)
-{
-	int ret = plugins_pre_create(pkt);
 
 	if (!create_hash_key(pkt)) { // saves key value and key length into attributes NHTFlowCache::key
 								 // and NHTFlowCache::m_keylen
+		plugins_pre_create(pkt);
 		return 0;
 	}
 
-	prefetch_export_expired();
+	/* Calculates hash values from keys created before. */
+	const uint64_t hashval = hash_key(pkt);
+	const uint64_t hashval_inv
+		= m_split_biflow || m_canonical_key ? hashval : XXH64(m_key_inv, m_keylen, 0);
+	put_pkt_recursive(pkt, hashval, hashval_inv);
+
+	export_expired(pkt.ts.tv_sec);
+	return 0;
+}
+
+int NHTFlowCache::put_pkt_block(PacketBlock& block)
+{
+	if (m_block_hash.size() < block.cnt) {
+		m_block_hash.resize(block.cnt);
+		m_block_hash_inv.resize(block.cnt);
+		m_block_has_key.resize(block.cnt);
+	}
+
+	/* Hash all packets first. */
+	for (size_t i = 0; i < block.cnt; i++) {
+		Packet& pkt = block.pkts[i];
+		if (m_enable_fragmentation_cache) {
+			try_to_fill_ports_to_fragmented_packet(pkt);
+		}
+		m_block_has_key[i] = create_hash_key(pkt);
+		if (!m_block_has_key[i]) {
+			continue;
+		}
+		m_block_hash[i] = hash_key(pkt);
+		m_block_hash_inv[i]
+			= m_split_biflow || m_canonical_key ? m_block_hash[i] : XXH64(m_key_inv, m_keylen, 0);
+	}
 
-	uint64_t hashval
-		= XXH64(m_key, m_keylen, 0); /* Calculates hash value from key created before. */
+	/* Inverse flow line is searched only when the biflow key depends on direction. */
+	const bool prefetch_inv = !m_split_biflow && !m_canonical_key;
+
+	/* Warm up the prefetch pipeline. */
+	for (size_t i = 0; i < block.cnt && i < 2 * FLOW_PREFETCH_DISTANCE; i++) {
+		if (!m_block_has_key[i]) {
+			continue;
+		}
+		prefetch_flow_line(m_block_hash[i]);
+		if (prefetch_inv) {
+			prefetch_flow_line(m_block_hash_inv[i]);
+		}
+	}
+	for (size_t i = 0; i < block.cnt && i < FLOW_PREFETCH_DISTANCE; i++) {
+		if (!m_block_has_key[i]) {
+			continue;
+		}
+		prefetch_flow_records(m_block_hash[i]);
+		if (prefetch_inv) {
+			prefetch_flow_records(m_block_hash_inv[i]);
+		}
+	}
+
+	for (size_t i = 0; i < block.cnt; i++) {
+		const size_t line_ahead = i + 2 * FLOW_PREFETCH_DISTANCE;
+		const size_t records_ahead = i + FLOW_PREFETCH_DISTANCE;
+		if (line_ahead < block.cnt && m_block_has_key[line_ahead]) {
+			prefetch_flow_line(m_block_hash[line_ahead]);
+			if (prefetch_inv) {
+				prefetch_flow_line(m_block_hash_inv[line_ahead]);
+			}
+		}
+		if (records_ahead < block.cnt && m_block_has_key[records_ahead]) {
+			prefetch_flow_records(m_block_hash[records_ahead]);
+			if (prefetch_inv) {
+				prefetch_flow_records(m_block_hash_inv[records_ahead]);
+			}
+		}
+
+		Packet& pkt = block.pkts[i];
+		if (!m_block_has_key[i]) {
+			plugins_pre_create(pkt);
+			continue;
+		}
+		put_pkt_recursive(pkt, m_block_hash[i], m_block_hash_inv[i]);
+	}
+
+	/* Timeouts have one second resolution, one tick per block is enough. */
+	if (block.cnt) {
+		export_expired(block.pkts[block.cnt - 1].ts.tv_sec);
+	}
+	return 0;
+}
+
+int NHTFlowCache::put_pkt_recursive(Packet& pkt, uint64_t hashval, uint64_t hashval_inv)
+{
+	int ret = plugins_pre_create(pkt);
 
 	FlowRecord* flow; /* Pointer to flow we will be working with. */
 	bool found = false;
 	bool source_flow = true;
+	bool key_swapped = false;
 	uint32_t line_index = hashval & m_line_mask; /* Get index of flow line. */
 	uint32_t flow_index = 0;
 	uint32_t next_line = line_index + m_line_size;
 
 	/* Find existing flow record in flow cache. */
-	for (flow_index = line_index; flow_index < next_line; flow_index++) {
-		if (m_flow_table[flow_index]->belongs(hashval)) {
-			found = true;
-			break;
-		}
+	flow_index = find_flow(line_index, hashval);
+	found = flow_index != next_line;
+
+	if (found && m_canonical_key) {
+		/* Both directions share the key, the record knows which side initiated the flow. */
+		key_swapped = is_key_swapped(pkt);
+		source_flow = m_flow_table[flow_index]->is_source(key_swapped);
 	}
 
 	/* Find inversed flow. */
-	if (!found && !m_split_biflow) {
-		uint64_t hashval_inv = XXH64(m_key_inv, m_keylen, 0);
-		uint64_t line_index_inv = hashval_inv & m_line_mask;
-		uint64_t next_line_inv = line_index_inv + m_line_size;
-		for (flow_index = line_index_inv; flow_index < next_line_inv; flow_index++) {
-			if (m_flow_table[flow_index]->belongs(hashval_inv)) {
-				found = true;
-				source_flow = false;
-				hashval = hashval_inv;
-				line_index = line_index_inv;
-				break;
-			}
+	if (!found && !m_split_biflow && !m_canonical_key) {
+		uint32_t line_index_inv = hashval_inv & m_line_mask;
+		flow_index = find_flow(line_index_inv, hashval_inv);
+		if (flow_index != line_index_inv + m_line_size) {
+			found = true;
+			source_flow = false;
+			line_index = line_index_inv;
 		}
 	}
 
@@ -379,24 +518,15 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 		m_lookups2 += (flow_index - line_index + 1) * (flow_index - line_index + 1);
 #endif /* FLOW_CACHE_STATS */
 
-		flow = m_flow_table[flow_index];
-		for (decltype(flow_index) j = flow_index; j > line_index; j--) {
-			m_flow_table[j] = m_flow_table[j - 1];
-		}
-
-		m_flow_table[line_index] = flow;
+		move_flow(flow_index, line_index);
 		flow_index = line_index;
 #ifdef FLOW_CACHE_STATS
 		m_hits++;
 #endif /* FLOW_CACHE_STATS */
 	} else {
 		/* Existing flow record was not found. Find free place in flow line. */
-		for (flow_index = line_index; flow_index < next_line; flow_index++) {
-			if (m_flow_table[flow_index]->is_empty()) {
-				found = true;
-				break;
-			}
-		}
+		flow_index = find_empty(line_index);
+		found = flow_index != next_line;
 		if (!found) {
 			/* If free place was not found (flow line is full), find
 			 * record which will be replaced by new record. */
@@ -411,12 +541,8 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 			m_expired++;
 #endif /* FLOW_CACHE_STATS */
 			uint32_t flow_new_index = line_index + m_line_new_idx;
-			flow = m_flow_table[flow_index];
-			for (decltype(flow_index) j = flow_index; j > flow_new_index; j--) {
-				m_flow_table[j] = m_flow_table[j - 1];
-			}
+			move_flow(flow_index, flow_new_index);
 			flow_index = flow_new_index;
-			m_flow_table[flow_new_index] = flow;
 #ifdef FLOW_CACHE_STATS
 			m_not_empty++;
 		} else {
@@ -433,13 +559,18 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 		// Flows with FIN or RST TCP flags are exported when new SYN packet arrives
 		m_flow_table[flow_index]->m_flow.end_reason = FLOW_END_EOF;
 		export_flow(flow_index);
-		put_pkt_recursive(pkt);
+		put_pkt_recursive(pkt, hashval, hashval_inv);
 		return 0;
 	}
 
 	if (flow->is_empty()) {
 		m_flows_in_cache++;
-		flow->create(pkt, hashval);
+		if (m_canonical_key) {
+			key_swapped = is_key_swapped(pkt);
+		}
+		flow->create(pkt, hashval, key_swapped);
+		m_flow_tags[flow_index] = flow_tag(hashval);
+		m_timer_wheel.schedule(flow, get_flow_deadline(*flow));
 		ret = plugins_post_create(flow->m_flow, pkt);
 
 		if (ret & FLOW_FLUSH) {
@@ -457,7 +588,7 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 #ifdef FLOW_CACHE_STATS
 			m_expired++;
 #endif /* FLOW_CACHE_STATS */
-			return put_pkt_recursive(pkt);
+			return put_pkt_recursive(pkt, hashval, hashval_inv);
 		}
 
 		/* Check if flow record is expired (active timeout). */
@@ -468,7 +599,13 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 #ifdef FLOW_CACHE_STATS
 			m_expired++;
 #endif /* FLOW_CACHE_STATS */
-			return put_pkt_recursive(pkt);
+			return put_pkt_recursive(pkt, hashval, hashval_inv);
+		}
+
+		if (!plugins_needed(flow->m_flow)) {
+			/* No plugin processes the flow anymore, just update counters. */
+			flow->update(pkt, source_flow);
+			return 0;
 		}
 
 		ret = plugins_pre_update(flow->m_flow, pkt);
@@ -486,7 +623,6 @@ int NHTFlowCache::put_pkt_recursive(Packet& pkt)
 		}
 	}
 
-	export_expired(pkt.ts.tv_sec);
 	return 0;
 }
 
@@ -507,19 +643,113 @@ uint8_t NHTFlowCache::get_export_reason(Flow& flow)
 
 void NHTFlowCache::export_expired(time_t ts)
 {
-	for (decltype(m_timeout_idx) i = m_timeout_idx; i < m_timeout_idx + m_line_new_idx; i++) {
-		if (!m_flow_table[i]->is_empty()
-			&& ts - m_flow_table[i]->m_flow.time_last.tv_sec >= m_inactive) {
-			m_flow_table[i]->m_flow.end_reason = get_export_reason(m_flow_table[i]->m_flow);
-			plugins_pre_export(m_flow_table[i]->m_flow);
-			export_flow(i);
+	m_timer_wheel.advance(ts, [this](TimerWheelNode* node, time_t now) {
+		expire_flow(static_cast<FlowRecord*>(node), now);
+	});
+}
+
+time_t NHTFlowCache::get_flow_deadline(const FlowRecord& flow) const
+{
+	return std::min<time_t>(
+		flow.m_flow.time_last.tv_sec + m_inactive,
+		flow.m_flow.time_first.tv_sec + m_active);
+}
+
+void NHTFlowCache::expire_flow(FlowRecord* flow, time_t now)
+{
+	/* Flow could be updated since it was scheduled, deadlines only move forward. */
+	const time_t deadline = get_flow_deadline(*flow);
+	if (deadline > now) {
+		m_timer_wheel.schedule(flow, deadline);
+		return;
+	}
+
+	const uint32_t line_index = flow->m_flow.flow_hash & m_line_mask;
+	for (uint32_t flow_index = line_index; flow_index < line_index + m_line_size; flow_index++) {
+		if (m_flow_table[flow_index] != flow) {
+			continue;
+		}
+		if (now - flow->m_flow.time_last.tv_sec >= m_inactive) {
+			flow->m_flow.end_reason = get_export_reason(flow->m_flow);
+		} else {
+			flow->m_flow.end_reason = FLOW_END_ACTIVE;
+		}
+		plugins_pre_export(flow->m_flow);
+		export_flow(flow_index);
 #ifdef FLOW_CACHE_STATS
-			m_expired++;
+		m_expired++;
 #endif /* FLOW_CACHE_STATS */
+		return;
+	}
+}
+
+uint32_t NHTFlowCache::find_flow(uint32_t line_index, uint64_t hashval)
+{
+	const uint32_t next_line = line_index + m_line_size;
+	const uint16_t tag = flow_tag(hashval);
+
+	m_flow_lookup_stats.lookups++;
+	for (uint32_t chunk = line_index; chunk < next_line; chunk += FLOW_TAG_CHUNK) {
+		uint32_t mask = match_flow_tags(&m_flow_tags[chunk], next_line - chunk, tag);
+		/* Only records with matching tag are dereferenced. */
+		while (mask) {
+			const uint32_t flow_index = chunk + __builtin_ctz(mask);
+			m_flow_lookup_stats.probes++;
+			if (m_flow_table[flow_index]->belongs(hashval)) {
+				return flow_index;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return next_line;
+}
+
+uint32_t NHTFlowCache::find_empty(uint32_t line_index) const
+{
+	const uint32_t next_line = line_index + m_line_size;
+
+	for (uint32_t chunk = line_index; chunk < next_line; chunk += FLOW_TAG_CHUNK) {
+		const uint32_t mask
+			= match_flow_tags(&m_flow_tags[chunk], next_line - chunk, FLOW_TAG_EMPTY);
+		if (mask) {
+			return chunk + __builtin_ctz(mask);
 		}
 	}
+	return next_line;
+}
+
+void NHTFlowCache::move_flow(uint32_t from, uint32_t to)
+{
+	FlowRecord* flow = m_flow_table[from];
+	const uint16_t tag = m_flow_tags[from];
+	for (uint32_t j = from; j > to; j--) {
+		m_flow_table[j] = m_flow_table[j - 1];
+		m_flow_tags[j] = m_flow_tags[j - 1];
+	}
+	m_flow_table[to] = flow;
+	m_flow_tags[to] = tag;
+}
+
+uint64_t NHTFlowCache::hash_key(const Packet& pkt) const
+{
+	/* Canonical key always starts with the lower endpoint, see is_key_swapped(). */
+	const bool swapped = m_canonical_key && is_key_swapped(pkt);
+	return XXH64(swapped ? m_key_inv : m_key, m_keylen, 0);
+}
 
-	m_timeout_idx = (m_timeout_idx + m_line_new_idx) & (m_cache_size - 1);
+bool NHTFlowCache::is_key_swapped(const Packet& pkt)
+{
+	if (pkt.ip_version == IP::v4) {
+		if (pkt.src_ip.v4 != pkt.dst_ip.v4) {
+			return pkt.src_ip.v4 > pkt.dst_ip.v4;
+		}
+	} else {
+		const int cmp = memcmp(pkt.src_ip.v6, pkt.dst_ip.v6, sizeof(pkt.src_ip.v6));
+		if (cmp != 0) {
+			return cmp > 0;
+		}
+	}
+	return pkt.src_port > pkt.dst_port;
 }
 
 bool NHTFlowCache::create_hash_key(Packet& pkt)
@@ -661,13 +891,38 @@ telemetry::Content NHTFlowCache::get_cache_telemetry()
 
 	dict["TotalExportedFlows"] = m_total_exported;
 
+	dict["FlowLookup:Lookups"] = m_flow_lookup_stats.lookups;
+	dict["FlowLookup:RecordProbes"] = m_flow_lookup_stats.probes;
+	dict["FlowLookup:ProbesPerLookup"] = m_flow_lookup_stats.lookups
+		? double(m_flow_lookup_stats.probes) / m_flow_lookup_stats.lookups
+		: 0.0;
+
 	return dict;
 }
 
-void NHTFlowCache::prefetch_export_expired() const
+void NHTFlowCache::prefetch_flow_line(uint64_t hashval) const
 {
-	for (decltype(m_timeout_idx) i = m_timeout_idx; i < m_timeout_idx + m_line_new_idx; i++) {
-		__builtin_prefetch(m_flow_table[i], 0, 1);
+	const uint32_t line_index = hashval & m_line_mask;
+	for (uint32_t i = 0; i < m_line_size; i += 64 / sizeof(uint16_t)) {
+		__builtin_prefetch(&m_flow_tags[line_index + i], 0, 3);
+	}
+	for (uint32_t i = 0; i < m_line_size; i += 64 / sizeof(FlowRecord*)) {
+		__builtin_prefetch(&m_flow_table[line_index + i], 0, 3);
+	}
+}
+
+void NHTFlowCache::prefetch_flow_records(uint64_t hashval) const
+{
+	const uint32_t line_index = hashval & m_line_mask;
+	const uint32_t next_line = line_index + m_line_size;
+	const uint16_t tag = flow_tag(hashval);
+
+	for (uint32_t chunk = line_index; chunk < next_line; chunk += FLOW_TAG_CHUNK) {
+		uint32_t mask = match_flow_tags(&m_flow_tags[chunk], next_line - chunk, tag);
+		while (mask) {
+			__builtin_prefetch(m_flow_table[chunk + __builtin_ctz(mask)], 1, 3);
+			mask &= mask - 1;
+		}
 	}
 }
 
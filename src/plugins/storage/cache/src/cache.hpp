@@ -14,11 +14,15 @@
 
 #pragma once
 
+#include "flowTags.hpp"
 #include "fragmentationCache/fragmentationCache.hpp"
+#include "timerWheel.hpp"
 
 #include <string>
+#include <vector>
 
 #include <ipfixprobe/flowifc.hpp>
+#include <ipfixprobe/memory.hpp>
 #include <ipfixprobe/options.hpp>
 #include <ipfixprobe/storagePlugin.hpp>
 #include <ipfixprobe/telemetry-utils.hpp>
@@ -60,6 +64,13 @@ static const uint32_t DEFAULT_FLOW_LINE_SIZE = IPXP_FLOW_LINE_SIZE;
 static const uint32_t DEFAULT_FLOW_LINE_SIZE = 4; // 16 records per line
 #endif /* IPXP_FLOW_LINE_SIZE */
 
+/**
+ * Number of packets the flow lines are prefetched ahead in NHTFlowCache::put_pkt_block().
+ * Flow line (tags and pointers) of packet i + 2 * distance and flow records with matching tag
+ * of packet i + distance are prefetched before packet i is processed.
+ */
+static const uint32_t FLOW_PREFETCH_DISTANCE = 4;
+
 static const uint32_t DEFAULT_INACTIVE_TIMEOUT = 30;
 static const uint32_t DEFAULT_ACTIVE_TIMEOUT = 300;
 
@@ -85,6 +96,7 @@ public:
 	uint32_t m_active;
 	uint32_t m_inactive;
 	bool m_split_biflow;
+	bool m_canonical_key;
 	bool m_enable_fragmentation_cache;
 	std::size_t m_frag_cache_size;
 	time_t m_frag_cache_timeout;
@@ -96,6 +108,7 @@ public:
 		, m_active(DEFAULT_ACTIVE_TIMEOUT)
 		, m_inactive(DEFAULT_INACTIVE_TIMEOUT)
 		, m_split_biflow(false)
+		, m_canonical_key(false)
 		, m_enable_fragmentation_cache(true)
 		, m_frag_cache_size(10007)
 		, // Prime for better distribution in hash table
@@ -175,6 +188,17 @@ public:
 				return true;
 			},
 			OptionFlags::NoArgument);
+		register_option(
+			"C",
+			"canonical",
+			"",
+			"Use direction-agnostic biflow key, both directions are found with a single lookup",
+			[this](const char* arg) {
+				(void) arg;
+				m_canonical_key = true;
+				return true;
+			},
+			OptionFlags::NoArgument);
 		register_option(
 			"fe",
 			"frag-enable",
@@ -220,8 +244,9 @@ public:
 	}
 };
 
-class alignas(64) FlowRecord {
+class alignas(64) FlowRecord : public TimerWheelNode {
 	uint64_t m_hash;
+	bool m_key_swapped; /**< Initiator is the greater endpoint of canonical key */
 
 public:
 	Flow m_flow;
@@ -234,7 +259,8 @@ public:
 
 	inline bool is_empty() const;
 	inline bool belongs(uint64_t pkt_hash) const;
-	void create(const Packet& pkt, uint64_t pkt_hash);
+	inline bool is_source(bool key_swapped) const;
+	void create(const Packet& pkt, uint64_t pkt_hash, bool key_swapped = false);
 	void update(const Packet& pkt, bool src);
 };
 
@@ -246,6 +272,11 @@ struct FlowEndReasonStats {
 	uint64_t forced;
 };
 
+struct FlowLookupStats {
+	uint64_t lookups; /**< Number of flow line searches */
+	uint64_t probes; /**< Number of flow records compared during the searches */
+};
+
 struct FlowRecordStats {
 	uint64_t packets_count_1;
 	uint64_t packets_count_2_5;
@@ -268,6 +299,7 @@ public:
 	std::string get_name() const { return "cache"; }
 
 	int put_pkt(Packet& pkt);
+	int put_pkt_block(PacketBlock& block) override;
 	void export_expired(time_t ts);
 
 	/**
@@ -282,7 +314,6 @@ private:
 	uint32_t m_line_new_idx;
 	uint32_t m_qsize;
 	uint32_t m_qidx;
-	uint32_t m_timeout_idx;
 	uint64_t m_flows_in_cache = 0;
 	uint64_t m_total_exported = 0;
 #ifdef FLOW_CACHE_STATS
@@ -297,29 +328,49 @@ private:
 	uint32_t m_active;
 	uint32_t m_inactive;
 	bool m_split_biflow;
+	bool m_canonical_key;
 	bool m_enable_fragmentation_cache;
 	uint8_t m_keylen;
 	char m_key[MAX_KEY_LENGTH];
 	char m_key_inv[MAX_KEY_LENGTH];
 	FlowRecord** m_flow_table;
 	FlowRecord* m_flow_records;
+	uint16_t* m_flow_tags; /**< Tags of m_flow_table records, FLOW_TAG_EMPTY for empty record */
+	RecordExt** m_ext_slots; /**< Extension slots of all records, see Record::set_extension_slots */
+	MemoryPolicy::Region m_flow_table_memory;
+	MemoryPolicy::Region m_flow_records_memory;
+	MemoryPolicy::Region m_flow_tags_memory;
+	MemoryPolicy::Region m_ext_slots_memory;
+	std::vector<uint64_t> m_block_hash;
+	std::vector<uint64_t> m_block_hash_inv;
+	std::vector<uint8_t> m_block_has_key; /**< Packet of the block has a flow key */
 
 	FragmentationCache m_fragmentation_cache;
 	FlowEndReasonStats m_flow_end_reason_stats = {};
 	FlowRecordStats m_flow_record_stats = {};
+	FlowLookupStats m_flow_lookup_stats = {};
+	TimerWheel m_timer_wheel; /**< Inactive and active timeouts of flows in cache */
 
-	int put_pkt_recursive(Packet& pkt);
+	int put_pkt_recursive(Packet& pkt, uint64_t hashval, uint64_t hashval_inv);
 	void try_to_fill_ports_to_fragmented_packet(Packet& packet);
 	void flush(Packet& pkt, size_t flow_index, int ret, bool source_flow);
 	bool create_hash_key(Packet& pkt);
+	uint64_t hash_key(const Packet& pkt) const;
+	static bool is_key_swapped(const Packet& pkt);
+	uint32_t find_flow(uint32_t line_index, uint64_t hashval);
+	uint32_t find_empty(uint32_t line_index) const;
+	void move_flow(uint32_t from, uint32_t to);
 	void export_flow(size_t index);
+	time_t get_flow_deadline(const FlowRecord& flow) const;
+	void expire_flow(FlowRecord* flow, time_t now);
 	static uint8_t get_export_reason(Flow& flow);
 	void finish();
 
 	void update_flow_end_reason_stats(uint8_t reason);
 	void update_flow_record_stats(uint64_t packets_count);
 	telemetry::Content get_cache_telemetry();
-	void prefetch_export_expired() const;
+	void prefetch_flow_line(uint64_t hashval) const;
+	void prefetch_flow_records(uint64_t hashval) const;
 
 #ifdef FLOW_CACHE_STATS
 	void print_report();
@@ -0,0 +1,78 @@
+/**
+ * @file
+ * @brief Compact flow hash tags used to speed up flow line lookup
+ *
+ * Every flow cache slot has a 16 bit tag derived from the flow hash, stored in an array parallel
+ * to the flow table. Tags of one flow line are stored contiguously, so the whole line can be
+ * compared with a single SIMD instruction and only records with matching tags are dereferenced.
+ *
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ipxp {
+
+/** Tag of an empty flow cache slot. */
+static const uint16_t FLOW_TAG_EMPTY = 0;
+
+/** Number of tags compared by one call of match_flow_tags(). */
+static const uint32_t FLOW_TAG_CHUNK = 16;
+
+/**
+ * @brief Derive tag from the flow hash.
+ *
+ * Low bits of the hash select the flow line, so the tag is taken from the most significant bits.
+ * Value FLOW_TAG_EMPTY is reserved for empty slots.
+ */
+inline uint16_t flow_tag(uint64_t hash)
+{
+	const uint16_t tag = hash >> 48;
+	return tag == FLOW_TAG_EMPTY ? 1 : tag;
+}
+
+/**
+ * @brief Compare FLOW_TAG_CHUNK tags with the given tag.
+ *
+ * Always reads FLOW_TAG_CHUNK tags, the tag array must be padded accordingly.
+ *
+ * @param tags Pointer to the first tag.
+ * @param count Number of valid tags (at most FLOW_TAG_CHUNK).
+ * @param tag Tag to search.
+ * @return Bit mask with bit i set when tags[i] equals the tag (i < count).
+ */
+inline uint32_t match_flow_tags(const uint16_t* tags, uint32_t count, uint16_t tag)
+{
+	const uint32_t valid = count >= FLOW_TAG_CHUNK ? 0xFFFF : (1U << count) - 1;
+#if defined(__AVX2__)
+	const __m256i line = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags));
+	const __m256i cmp = _mm256_cmpeq_epi16(line, _mm256_set1_epi16(static_cast<short>(tag)));
+	// Packing works within 128 bit lanes, bytes 0-7 hold tags 0-7 and bytes 16-23 tags 8-15
+	const uint32_t mask = _mm256_movemask_epi8(_mm256_packs_epi16(cmp, cmp));
+	return ((mask & 0xFF) | ((mask >> 8) & 0xFF00)) & valid;
+#elif defined(__SSE2__)
+	const __m128i needle = _mm_set1_epi16(static_cast<short>(tag));
+	const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags));
+	const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + 8));
+	const __m128i cmp = _mm_packs_epi16(_mm_cmpeq_epi16(lo, needle), _mm_cmpeq_epi16(hi, needle));
+	return static_cast<uint32_t>(_mm_movemask_epi8(cmp)) & valid;
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < FLOW_TAG_CHUNK; i++) {
+		mask |= static_cast<uint32_t>(tags[i] == tag) << i;
+	}
+	return mask & valid;
+#endif
+}
+
+} // namespace ipxp
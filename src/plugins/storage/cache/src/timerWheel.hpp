@@ -0,0 +1,175 @@
+/**
+ * @file
+ * @brief Two level hierarchical timer wheel with one second resolution
+ *
+ * Timers are intrusive nodes embedded in the owner objects, so scheduling and cancelling
+ * a timer is O(1) and needs no allocation. The wheel is advanced with the time of processed
+ * packets. Nodes of the buckets which became due are handed to a callback which decides whether
+ * the owner really expired or schedules it again (deadlines may only move forward, so owners
+ * don't need to be rescheduled on every update).
+ *
+ * @date 2025
+ *
+ * Copyright (c) 2025 CESNET
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+
+namespace ipxp {
+
+/**
+ * @brief Intrusive timer wheel list hook.
+ */
+struct TimerWheelNode {
+	TimerWheelNode* m_timer_next = nullptr;
+	/** Pointer to the pointer referencing this node, nullptr when the node is not scheduled. */
+	TimerWheelNode** m_timer_pprev = nullptr;
+
+	bool is_scheduled() const { return m_timer_pprev != nullptr; }
+};
+
+class TimerWheel {
+public:
+	/** Number of one second buckets of the first level. */
+	static const uint32_t LEVEL0_SIZE = 256;
+	/** Number of LEVEL0_SIZE seconds long buckets of the second level. */
+	static const uint32_t LEVEL1_SIZE = 256;
+
+	TimerWheel()
+		: m_now(0)
+		, m_count(0)
+	{
+		m_level0.fill(nullptr);
+		m_level1.fill(nullptr);
+	}
+
+	/**
+	 * @brief Schedule the node to be returned by advance() at the deadline.
+	 *
+	 * Deadlines in the past are due in the next second. Deadlines beyond the wheel span are
+	 * clamped, the callback of advance() schedules such node again.
+	 */
+	void schedule(TimerWheelNode* node, time_t deadline)
+	{
+		if (deadline <= m_now) {
+			deadline = m_now + 1;
+		}
+		if (deadline - m_now < static_cast<time_t>(LEVEL0_SIZE)) {
+			link(m_level0[deadline % LEVEL0_SIZE], node);
+			return;
+		}
+		const time_t last_period = m_now / LEVEL0_SIZE + LEVEL1_SIZE - 1;
+		if (deadline / LEVEL0_SIZE > last_period) {
+			deadline = last_period * LEVEL0_SIZE;
+		}
+		link(m_level1[(deadline / LEVEL0_SIZE) % LEVEL1_SIZE], node);
+	}
+
+	/**
+	 * @brief Remove the node from the wheel, no-op when the node is not scheduled.
+	 */
+	void cancel(TimerWheelNode* node)
+	{
+		if (!node->is_scheduled()) {
+			return;
+		}
+		*node->m_timer_pprev = node->m_timer_next;
+		if (node->m_timer_next != nullptr) {
+			node->m_timer_next->m_timer_pprev = node->m_timer_pprev;
+		}
+		node->m_timer_next = nullptr;
+		node->m_timer_pprev = nullptr;
+		m_count--;
+	}
+
+	/**
+	 * @brief Move the wheel time forward and pass all due nodes to the callback.
+	 *
+	 * Nodes are removed from the wheel before the callback is called. The callback may schedule
+	 * the node again or cancel any other node.
+	 *
+	 * @param now Current time, ignored when it is not greater than the wheel time.
+	 * @param callback Callable with signature void(TimerWheelNode* node, time_t now).
+	 */
+	template<typename Callback>
+	void advance(time_t now, Callback&& callback)
+	{
+		if (now <= m_now) {
+			return;
+		}
+		if (m_count == 0) {
+			m_now = now;
+			return;
+		}
+		if (now - m_now >= static_cast<time_t>(LEVEL0_SIZE * LEVEL1_SIZE)) {
+			/* Time jumped over the whole wheel, every node is due. */
+			m_now = now;
+			for (auto& bucket : m_level0) {
+				fire(bucket, callback);
+			}
+			for (auto& bucket : m_level1) {
+				fire(bucket, callback);
+			}
+			return;
+		}
+		while (m_now < now && m_count != 0) {
+			m_now++;
+			if (m_now % LEVEL0_SIZE == 0) {
+				fire(m_level1[(m_now / LEVEL0_SIZE) % LEVEL1_SIZE], callback);
+			}
+			fire(m_level0[m_now % LEVEL0_SIZE], callback);
+		}
+		m_now = now;
+	}
+
+	/**
+	 * @brief Number of scheduled nodes.
+	 */
+	uint64_t size() const { return m_count; }
+
+	/**
+	 * @brief Current wheel time.
+	 */
+	time_t now() const { return m_now; }
+
+private:
+	time_t m_now;
+	uint64_t m_count;
+	std::array<TimerWheelNode*, LEVEL0_SIZE> m_level0;
+	std::array<TimerWheelNode*, LEVEL1_SIZE> m_level1;
+
+	void link(TimerWheelNode*& head, TimerWheelNode* node)
+	{
+		node->m_timer_next = head;
+		node->m_timer_pprev = &head;
+		if (head != nullptr) {
+			head->m_timer_pprev = &node->m_timer_next;
+		}
+		head = node;
+		m_count++;
+	}
+
+	template<typename Callback>
+	void fire(TimerWheelNode*& head, Callback& callback)
+	{
+		/* Detach the bucket first, callback may schedule the node back to the same bucket. */
+		TimerWheelNode* due = head;
+		head = nullptr;
+		if (due != nullptr) {
+			due->m_timer_pprev = &due;
+		}
+		while (due != nullptr) {
+			TimerWheelNode* node = due;
+			cancel(node);
+			callback(node, m_now);
+		}
+	}
+};
+
+} // namespace ipxp
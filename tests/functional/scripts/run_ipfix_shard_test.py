@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+#
+# Smoke test of IPFIX export to multiple collectors.
+#
+# Flows of a pcap are exported with split biflows to two UDP collectors. Both collectors must
+# receive flows, together all of them, and both directions of a connection must go to the same
+# collector. Then one TCP collector is down and failover must deliver all flows to the other one.
+#
+# Usage: run_ipfix_shard_test.py TEST_DIR BUILD_DIR
+
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+PCAP_FILENAME = "mixed.pcap"
+
+IPFIX_VERSION = 10
+IPFIX_HEADER_SIZE = 16
+TEMPLATE_SET_ID = 2
+OPTIONS_TEMPLATE_SET_ID = 3
+VARIABLE_LENGTH = 65535
+
+# Information elements of the flow key
+PROTO = 4
+SRC_PORT = 7
+DST_PORT = 11
+SRC_IPV4 = 8
+DST_IPV4 = 12
+SRC_IPV6 = 27
+DST_IPV6 = 28
+
+
+class Collector:
+	"""Collector counting flow keys of received data records."""
+
+	def __init__(self, tcp):
+		self.tcp = tcp
+		self.flows = []
+		self.errors = []
+		self.templates = {}
+		self.lock = threading.Lock()
+		self.threads = []
+		kind = socket.SOCK_STREAM if tcp else socket.SOCK_DGRAM
+		self.sock = socket.socket(socket.AF_INET, kind)
+		self.sock.bind(("127.0.0.1", 0))
+		self.port = self.sock.getsockname()[1]
+		if tcp:
+			self.sock.listen()
+		else:
+			self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+		self.sock.settimeout(0.2)
+		self.running = True
+		self.thread = threading.Thread(target=self.accept if tcp else self.receive)
+		self.thread.start()
+
+	def receive(self):
+		while self.running:
+			try:
+				data = self.sock.recv(65535)
+			except socket.timeout:
+				continue
+			self.parse(data)
+
+	def accept(self):
+		while self.running:
+			try:
+				conn, _ = self.sock.accept()
+			except socket.timeout:
+				continue
+			thread = threading.Thread(target=self.read_stream, args=(conn,))
+			thread.start()
+			self.threads.append(thread)
+
+	def read_stream(self, conn):
+		data = b""
+		with conn:
+			while True:
+				chunk = conn.recv(65535)
+				if not chunk:
+					break
+				data += chunk
+				while len(data) >= IPFIX_HEADER_SIZE:
+					length = struct.unpack_from("!H", data, 2)[0]
+					if len(data) < length:
+						break
+					self.parse(data[:length])
+					data = data[length:]
+
+	def stop(self):
+		# Give the exporter time to deliver the last messages
+		time.sleep(0.5)
+		self.running = False
+		self.thread.join()
+		for thread in self.threads:
+			thread.join(timeout=10)
+		self.sock.close()
+		if self.errors:
+			raise RuntimeError(self.errors[0])
+
+	def parse(self, data):
+		try:
+			self.parse_message(data)
+		except (RuntimeError, struct.error, KeyError) as e:
+			self.errors.append(str(e))
+
+	def parse_message(self, data):
+		version, length, _, _, odid = struct.unpack_from("!HHIII", data)
+		if version != IPFIX_VERSION or length != len(data):
+			raise RuntimeError("malformed IPFIX message")
+		pos = IPFIX_HEADER_SIZE
+		while pos + 4 <= length:
+			set_id, set_len = struct.unpack_from("!HH", data, pos)
+			if set_len < 4 or pos + set_len > length:
+				raise RuntimeError("malformed IPFIX set")
+			body = data[pos + 4 : pos + set_len]
+			if set_id == TEMPLATE_SET_ID:
+				self.parse_templates(odid, body)
+			elif set_id >= 256:
+				self.parse_records(odid, set_id, body)
+			elif set_id != OPTIONS_TEMPLATE_SET_ID:
+				raise RuntimeError("unknown IPFIX set " + str(set_id))
+			pos += set_len
+
+	def parse_templates(self, odid, body):
+		pos = 0
+		while pos + 4 <= len(body):
+			template_id, count = struct.unpack_from("!HH", body, pos)
+			pos += 4
+			fields = []
+			for _ in range(count):
+				field_id, field_len = struct.unpack_from("!HH", body, pos)
+				pos += 4
+				if field_id & 0x8000:
+					# Enterprise specific element
+					field_id = None
+					pos += 4
+				fields.append((field_id, field_len))
+			self.templates[(odid, template_id)] = fields
+
+	def parse_records(self, odid, template_id, body):
+		fields = self.templates.get((odid, template_id))
+		if fields is None:
+			raise RuntimeError("data set without template " + str(template_id))
+		min_len = sum(1 if flen == VARIABLE_LENGTH else flen for _, flen in fields)
+		pos = 0
+		while len(body) - pos >= min_len and min_len > 0:
+			values = {}
+			for field_id, field_len in fields:
+				if field_len == VARIABLE_LENGTH:
+					field_len = body[pos]
+					pos += 1
+					if field_len == 255:
+						field_len = struct.unpack_from("!H", body, pos)[0]
+						pos += 2
+				values[field_id] = body[pos : pos + field_len]
+				pos += field_len
+			src_ip = values.get(SRC_IPV4, values.get(SRC_IPV6))
+			dst_ip = values.get(DST_IPV4, values.get(DST_IPV6))
+			key = (src_ip, values[SRC_PORT], dst_ip, values[DST_PORT], values[PROTO])
+			with self.lock:
+				self.flows.append(key)
+
+
+def connection(flow):
+	"""Flow key with endpoints in canonical order."""
+	src = (flow[0], flow[1])
+	dst = (flow[2], flow[3])
+	return (min(src, dst), max(src, dst), flow[4])
+
+
+def run_ipfixprobe(test_dir, build_dir, output):
+	subprocess.run(
+		[
+			build_dir + "/src/core/ipfixprobe",
+			"-i",
+			"pcap;file=" + test_dir + "/inputs/" + PCAP_FILENAME,
+			"-L",
+			build_dir + "/src/plugins",
+			"-s",
+			"cache;split",
+			"-o",
+			output,
+		],
+		stdout=subprocess.DEVNULL,
+		check=True,
+		timeout=60,
+	)
+
+
+def export(test_dir, build_dir, collectors, options):
+	hosts = ",".join("127.0.0.1" for _ in collectors)
+	ports = ",".join(str(port) for port in collectors)
+	output = "ipfix;host=" + hosts + ";port=" + ports + options
+	run_ipfixprobe(test_dir, build_dir, output)
+
+
+def test_distribution(test_dir, build_dir):
+	single = Collector(tcp=False)
+	export(test_dir, build_dir, [single.port], ";udp")
+	single.stop()
+
+	shards = [Collector(tcp=False), Collector(tcp=False)]
+	export(test_dir, build_dir, [shard.port for shard in shards], ";udp")
+	for shard in shards:
+		shard.stop()
+
+	if not single.flows:
+		raise RuntimeError("no flows exported")
+	if any(not shard.flows for shard in shards):
+		raise RuntimeError("flows are not distributed among collectors")
+	if sorted(shards[0].flows + shards[1].flows) != sorted(single.flows):
+		raise RuntimeError("collectors did not receive all flows")
+
+	connections = [set(connection(flow) for flow in shard.flows) for shard in shards]
+	if connections[0] & connections[1]:
+		raise RuntimeError("directions of a connection were sent to different collectors")
+	return len(single.flows)
+
+
+def test_failover(test_dir, build_dir, flow_count):
+	live = Collector(tcp=True)
+
+	# Bound but not listening socket refuses connections
+	down = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	down.bind(("127.0.0.1", 0))
+	down_port = down.getsockname()[1]
+
+	export(test_dir, build_dir, [down_port, live.port], ";failover")
+	live.stop()
+	down.close()
+
+	if len(live.flows) != flow_count:
+		raise RuntimeError(
+			"failover delivered %d of %d flows" % (len(live.flows), flow_count))
+
+
+def main():
+	test_dir = sys.argv[1]
+	build_dir = sys.argv[2]
+
+	try:
+		flow_count = test_distribution(test_dir, build_dir)
+		test_failover(test_dir, build_dir, flow_count)
+	except (RuntimeError, subprocess.SubprocessError) as e:
+		print("ipfix shard test FAILED: " + str(e))
+		return 1
+
+	print("ipfix shard test OK")
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())